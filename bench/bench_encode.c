@@ -0,0 +1,206 @@
+// Raspberry Pi PCA9685 Example
+//
+// Copyright (c) 2022 Benjamin Spencer
+// ============================================================================
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+// ============================================================================
+
+// Microbenchmark for the duty cycle encoder
+//
+// Compares the original set_pwm_duty_cycle() calculation (floating point
+// ROUND() and the register dump printf()s) with the integer encoder used
+// now. The original tested 'duty_cycle < 1' where it meant full scale, so
+// almost every value took its constant full-on branch; legacy_fixed runs
+// it with that test corrected so it does the same work as the encoder.
+// Prints one CSV line per case: name,frames,ns_per_channel
+
+// Include C standard libraries:
+#include <stdlib.h> // C Standard library
+#include <stdio.h>  // C Standard I/O libary
+#include <time.h>   // C Standard date and time manipulation
+#include <stdint.h> // C Standard integer types
+
+#include "pca9685_encode.h" // PCA9685 duty cycle encoder
+
+// Round to the nearest integer
+#define ROUND(n) (((n - (int)n) >= 0.5) ? (int)(n + 1) : (int)(n))
+
+#define ENCODE_FRAMES 1000000 // Frames of 16 channels per integer case
+#define PRINTF_FRAMES 20000   // Frames of 16 channels with printf()
+
+static FILE *null_output;
+
+// Calculation as it was in set_pwm_duty_cycle() (fixed corrects the range
+// test):
+static void legacy_encode(int duty_cycle, int *led_register_values,
+                          int log, int fixed) {
+    int led_delay_time = 0;
+    int led_on_counts = 0;
+    int led_off_time = 0;
+
+    led_delay_time = ROUND(0.10 * 4096) - 1;
+
+    if (fixed ? (duty_cycle < 4095) : (duty_cycle < 1)) {
+        led_on_counts = duty_cycle;
+        led_off_time = led_delay_time + led_on_counts;
+
+        if ((led_delay_time + led_on_counts > 4096)) {
+            led_off_time = led_off_time - 4096;
+        }
+    } else {
+        led_delay_time = led_delay_time | (0x01 << 12);
+    }
+
+    led_register_values[0] = led_delay_time;
+    led_register_values[1] = led_delay_time >> 8;
+    led_register_values[2] = led_off_time;
+    led_register_values[3] = led_off_time >> 8;
+
+    if (log) {
+        fprintf(null_output, "Calculated LED ON/OFF registers for duty "
+                "cycle = %d\n", duty_cycle);
+        fprintf(null_output, "led_delay_time = %d\n",
+                (uint8_t) led_delay_time);
+        fprintf(null_output, "led_on_counts = %d\n", (uint8_t) led_on_counts);
+        fprintf(null_output, "led_off_time = %d\n", (uint8_t) led_off_time);
+        fprintf(null_output, "led_on_l = 0x%x\n",
+                (uint8_t) led_register_values[0]);
+        fprintf(null_output, "led_on_h = 0x%x\n",
+                (uint8_t) led_register_values[1]);
+        fprintf(null_output, "led_off_l = 0x%x\n",
+                (uint8_t) led_register_values[2]);
+        fprintf(null_output, "led_off_h = 0x%x\n",
+                (uint8_t) led_register_values[3]);
+    }
+}
+
+static double elapsed_ns(struct timespec *start, struct timespec *end) {
+    return (end->tv_sec - start->tv_sec) * 1e9
+           + (end->tv_nsec - start->tv_nsec);
+}
+
+// Duty cycles that change every frame so nothing gets hoisted:
+static void fill_frame(int frame, int *duty_cycles) {
+    int led_id;
+
+    for (led_id = 0; led_id < NUM_LED_CHANNELS; led_id++) {
+        duty_cycles[led_id] = (frame * 7 + led_id * 257) & (PWM_COUNTS - 1);
+    }
+}
+
+static void report(const char *name, int frames, struct timespec *start,
+                   struct timespec *end) {
+    printf("%s,%d,%.2f\n", name, frames,
+           elapsed_ns(start, end) / ((double) frames * NUM_LED_CHANNELS));
+}
+
+int main(void) {
+    int duty_cycles[NUM_LED_CHANNELS];
+    int led_delay_times[NUM_LED_CHANNELS];
+    int led_bank[LED_BANK_BYTES];
+
+    struct timespec start;
+    struct timespec end;
+
+    volatile int sink = 0;
+
+    int frame;
+    int led_id;
+
+    if ((null_output = fopen("/dev/null", "w")) == NULL) {
+        printf("Could not open /dev/null\n");
+        return -1;
+    }
+
+    for (led_id = 0; led_id < NUM_LED_CHANNELS; led_id++) {
+        led_delay_times[led_id] = PWM_DEFAULT_DELAY;
+    }
+
+    printf("name,frames,ns_per_channel\n");
+
+    // Cost of generating the inputs, included in every other case:
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (frame = 0; frame < ENCODE_FRAMES; frame++) {
+        fill_frame(frame, duty_cycles);
+        sink += duty_cycles[frame & (NUM_LED_CHANNELS - 1)];
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    report("baseline", ENCODE_FRAMES, &start, &end);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (frame = 0; frame < PRINTF_FRAMES; frame++) {
+        fill_frame(frame, duty_cycles);
+        for (led_id = 0; led_id < NUM_LED_CHANNELS; led_id++) {
+            legacy_encode(duty_cycles[led_id],
+                          &led_bank[led_id * LED_REG_BYTES], 1, 0);
+        }
+        sink += led_bank[frame & (LED_BANK_BYTES - 1)];
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    report("legacy_printf", PRINTF_FRAMES, &start, &end);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (frame = 0; frame < ENCODE_FRAMES; frame++) {
+        fill_frame(frame, duty_cycles);
+        for (led_id = 0; led_id < NUM_LED_CHANNELS; led_id++) {
+            legacy_encode(duty_cycles[led_id],
+                          &led_bank[led_id * LED_REG_BYTES], 0, 0);
+        }
+        sink += led_bank[frame & (LED_BANK_BYTES - 1)];
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    report("legacy", ENCODE_FRAMES, &start, &end);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (frame = 0; frame < ENCODE_FRAMES; frame++) {
+        fill_frame(frame, duty_cycles);
+        for (led_id = 0; led_id < NUM_LED_CHANNELS; led_id++) {
+            legacy_encode(duty_cycles[led_id],
+                          &led_bank[led_id * LED_REG_BYTES], 0, 1);
+        }
+        sink += led_bank[frame & (LED_BANK_BYTES - 1)];
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    report("legacy_fixed", ENCODE_FRAMES, &start, &end);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (frame = 0; frame < ENCODE_FRAMES; frame++) {
+        fill_frame(frame, duty_cycles);
+        for (led_id = 0; led_id < NUM_LED_CHANNELS; led_id++) {
+            encode_pwm_registers(duty_cycles[led_id], led_delay_times[led_id],
+                                 &led_bank[led_id * LED_REG_BYTES]);
+        }
+        sink += led_bank[frame & (LED_BANK_BYTES - 1)];
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    report("encode_pwm_registers", ENCODE_FRAMES, &start, &end);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (frame = 0; frame < ENCODE_FRAMES; frame++) {
+        fill_frame(frame, duty_cycles);
+        encode_pwm_bank(duty_cycles, led_delay_times, led_bank);
+        sink += led_bank[frame & (LED_BANK_BYTES - 1)];
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    report("encode_pwm_bank", ENCODE_FRAMES, &start, &end);
+
+    fclose(null_output);
+
+    return (sink == 0x7FFFFFFF) ? 1 : 0;
+}
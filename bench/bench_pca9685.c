@@ -0,0 +1,351 @@
+// Raspberry Pi PCA9685 Example
+//
+// Copyright (c) 2022 Benjamin Spencer
+// ============================================================================
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+// ============================================================================
+
+// PCA9685 bus cost benchmark
+//
+// Runs the driver against simulated devices behind a recording bus and
+// reports, per iteration of each scenario, what went over the wire and how
+// long that takes on a real bus. Prints CSV:
+// scenario,iterations,bytes,transactions,starts,model_us_full_speed,
+// model_us_standard,wall_ns
+
+// Include C standard libraries:
+#include <stdlib.h> // C Standard library
+#include <stdio.h>  // C Standard I/O libary
+#include <time.h>   // C Standard date and time manipulation
+#include <stdint.h> // C Standard integer types
+#include <unistd.h> // POSIX dup()
+
+#include <pi_i2c.h> // Pi I2C library! (speed grades)
+
+#include "pca9685_registers.h" // PCA9685 register definitions
+#include "pca9685_bus.h"       // PCA9685 bus backend
+#include "pca9685_sim.h"       // Simulated PCA9685 bus
+#include "pca9685_cache.h"     // PCA9685 shadow register cache
+#include "pca9685_pwm.h"       // PCA9685 PWM output helpers
+#include "pca9685_multi.h"     // PCA9685 multi-board manager
+#include "pca9685.h"           // PCA9685 driver
+
+#define STANDARD_SPEED 100000 // [Hz] I2C standard mode
+#define ITERATIONS 1000       // Iterations of each scenario
+#define NUM_BENCH_BOARDS 8    // Boards in the multi-board scenarios
+#define BENCH_ADDR 0x40       // Board used by single board scenarios
+
+// Bits on the wire: 8 data bits plus ACK per byte and one bit time each
+// for start, repeated start and stop conditions:
+#define BYTE_BITS 9
+#define CONDITION_BITS 1
+
+struct bus_recorder {
+    const struct pca9685_bus *target; // Bus doing the actual work
+
+    long bytes;
+    long transactions;
+    long starts;
+    long bits;
+
+    struct pca9685_bus bus;
+};
+
+static struct pca9685_sim sim;
+static struct bus_recorder recorder;
+static struct pca9685_multi multi;
+
+static int duty_cycles[NUM_BENCH_BOARDS * NUM_LED_CHANNELS];
+
+static FILE *results;
+
+static int record_read(void *context, int device_addr, int reg_addr,
+                       int *data, int bytes) {
+    struct bus_recorder *rec = context;
+
+    // Start, address + W, register, repeated start, address + R, data, stop:
+    rec->transactions++;
+    rec->starts += 2;
+    rec->bytes += 3 + bytes;
+    rec->bits += (3 + bytes) * BYTE_BITS + 3 * CONDITION_BITS;
+
+    return rec->target->read(rec->target->context, device_addr, reg_addr,
+                             data, bytes);
+}
+
+static int record_write(void *context, int device_addr, int reg_addr,
+                        int *data, int bytes) {
+    struct bus_recorder *rec = context;
+
+    // Start, address + W, register, data, stop:
+    rec->transactions++;
+    rec->starts++;
+    rec->bytes += 2 + bytes;
+    rec->bits += (2 + bytes) * BYTE_BITS + 2 * CONDITION_BITS;
+
+    return rec->target->write(rec->target->context, device_addr, reg_addr,
+                              data, bytes);
+}
+
+static int record_scan(void *context, int *address_book) {
+    struct bus_recorder *rec = context;
+
+    // One start, address, stop probe per address:
+    rec->transactions += SIM_ADDRESS_BOOK;
+    rec->starts += SIM_ADDRESS_BOOK;
+    rec->bytes += SIM_ADDRESS_BOOK;
+    rec->bits += SIM_ADDRESS_BOOK * (BYTE_BITS + 2 * CONDITION_BITS);
+
+    return rec->target->scan(rec->target->context, address_book);
+}
+
+static int record_power_cycle(void *context) {
+    struct bus_recorder *rec = context;
+
+    return rec->target->power_cycle(rec->target->context);
+}
+
+static void reset_recorder(void) {
+    recorder.bytes = 0;
+    recorder.transactions = 0;
+    recorder.starts = 0;
+    recorder.bits = 0;
+}
+
+// Fresh devices and caches for every scenario:
+static void reset_bench(int num_boards) {
+    int board;
+
+    init_sim(&sim);
+
+    for (board = 0; board < num_boards; board++) {
+        add_sim_device(&sim, BENCH_ADDR + board);
+    }
+
+    recorder.target = &sim.bus;
+    recorder.bus.read = record_read;
+    recorder.bus.write = record_write;
+    recorder.bus.scan = record_scan;
+    recorder.bus.power_cycle = record_power_cycle;
+    recorder.bus.context = &recorder;
+
+    set_bus(&recorder.bus);
+
+    invalidate_register_cache(ALL_DEVICES);
+}
+
+// Every channel gets a new (not fully on or off) value each iteration:
+static void fill_duty_cycles(int iteration, int num_channels, int shared) {
+    int channel;
+
+    for (channel = 0; channel < num_channels; channel++) {
+        duty_cycles[channel] = 1 + (iteration * 37 + (shared ? channel
+            % NUM_LED_CHANNELS : channel) * 251) % (PWM_FULL_SCALE - 1);
+    }
+}
+
+static void setup_single(void) {
+    int config[2] = {AI, ALLCALL};
+
+    reset_bench(1);
+    init_register_cache(BENCH_ADDR);
+    configure_device(BENCH_ADDR, MODE1, config, 2);
+}
+
+static void setup_multi(void) {
+    reset_bench(NUM_BENCH_BOARDS);
+    discover_boards(&multi);
+}
+
+static void run_configure(int iteration) {
+    int config[1];
+
+    // Production toggles between low power and normal mode:
+    config[0] = (iteration & 0x01) ? NORMAL_MODE : LOW_POWER;
+
+    configure_device(BENCH_ADDR, MODE1, config, 1);
+}
+
+static void run_set_frequency(int iteration) {
+    set_frequency(BENCH_ADDR, (iteration & 0x01) ? 1526 : 24);
+}
+
+// The three steps main() used to take to change frequency:
+static void run_frequency_change(int iteration) {
+    int config[1] = {LOW_POWER};
+
+    configure_device(BENCH_ADDR, MODE1, config, 1);
+    set_frequency(BENCH_ADDR, (iteration & 0x01) ? 1526 : 24);
+
+    config[0] = NORMAL_MODE;
+    configure_device(BENCH_ADDR, MODE1, config, 1);
+}
+
+// Wall time includes the 500 us oscillator wait:
+static void run_retune(int iteration) {
+    retune_device(BENCH_ADDR, (iteration & 0x01) ? 1526 : 24);
+}
+
+static void run_retune_multi(int iteration) {
+    retune_boards(&multi, (iteration & 0x01) ? 1526 : 24);
+}
+
+static void run_single_channel(int iteration) {
+    fill_duty_cycles(iteration, 1, 0);
+    set_pwm_duty_cycle(BENCH_ADDR, 15, duty_cycles[0]);
+}
+
+static void run_sweep_single(int iteration) {
+    int led_id;
+
+    fill_duty_cycles(iteration, NUM_LED_CHANNELS, 0);
+
+    for (led_id = 0; led_id < NUM_LED_CHANNELS; led_id++) {
+        set_pwm_duty_cycle(BENCH_ADDR, led_id, duty_cycles[led_id]);
+    }
+}
+
+static void run_sweep_batched(int iteration) {
+    fill_duty_cycles(iteration, NUM_LED_CHANNELS, 0);
+    set_pwm_duty_cycles(BENCH_ADDR, duty_cycles, NUM_LED_CHANNELS);
+}
+
+static void run_multi_per_board(int iteration) {
+    int board;
+
+    fill_duty_cycles(iteration, NUM_BENCH_BOARDS * NUM_LED_CHANNELS, 0);
+
+    for (board = 0; board < NUM_BENCH_BOARDS; board++) {
+        set_pwm_duty_cycles(BENCH_ADDR + board,
+                            &duty_cycles[board * NUM_LED_CHANNELS],
+                            NUM_LED_CHANNELS);
+    }
+}
+
+static void run_multi_distinct(int iteration) {
+    fill_duty_cycles(iteration, NUM_BENCH_BOARDS * NUM_LED_CHANNELS, 0);
+    set_multi_duty_cycles(&multi, duty_cycles);
+}
+
+static void run_multi_shared(int iteration) {
+    fill_duty_cycles(iteration, NUM_BENCH_BOARDS * NUM_LED_CHANNELS, 1);
+    set_multi_duty_cycles(&multi, duty_cycles);
+}
+
+// Full on/off only flips the full bits:
+static void run_full_toggle(int iteration) {
+    set_pwm_duty_cycle(BENCH_ADDR, 15,
+                       (iteration & 0x01) ? PWM_FULL_SCALE : 0);
+}
+
+// Alternate between distinct values and all channels off:
+static void run_blackout(int iteration) {
+    int led_id;
+
+    fill_duty_cycles(iteration, NUM_LED_CHANNELS, 0);
+
+    if (iteration & 0x01) {
+        for (led_id = 0; led_id < NUM_LED_CHANNELS; led_id++) {
+            duty_cycles[led_id] = 0;
+        }
+    }
+
+    set_pwm_duty_cycles(BENCH_ADDR, duty_cycles, NUM_LED_CHANNELS);
+}
+
+static void run_blackout_per_board(int iteration) {
+    int board;
+
+    for (board = 0; board < NUM_BENCH_BOARDS; board++) {
+        blackout(BENCH_ADDR + board);
+    }
+}
+
+static void run_emergency_stop(int iteration) {
+    emergency_stop(&multi);
+}
+
+static void run_scenario(const char *name, void (*setup)(void),
+                         void (*run)(int iteration)) {
+    struct timespec start;
+    struct timespec end;
+
+    double wall_ns;
+
+    int iteration;
+
+    setup();
+    reset_recorder();
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (iteration = 0; iteration < ITERATIONS; iteration++) {
+        run(iteration);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    wall_ns = (end.tv_sec - start.tv_sec) * 1e9
+              + (end.tv_nsec - start.tv_nsec);
+
+    fprintf(results, "%s,%d,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f\n", name,
+            ITERATIONS, (double) recorder.bytes / ITERATIONS,
+            (double) recorder.transactions / ITERATIONS,
+            (double) recorder.starts / ITERATIONS,
+            recorder.bits * 1e6 / I2C_FULL_SPEED / ITERATIONS,
+            recorder.bits * 1e6 / STANDARD_SPEED / ITERATIONS,
+            wall_ns / ITERATIONS);
+}
+
+int main(void) {
+    // Keep the results on stdout and send the driver's logging elsewhere:
+    if ((results = fdopen(dup(STDOUT_FILENO), "w")) == NULL) {
+        printf("Could not duplicate stdout\n");
+        return -1;
+    }
+
+    if (freopen("/dev/null", "w", stdout) == NULL) {
+        fprintf(results, "Could not silence driver output\n");
+        return -1;
+    }
+
+    fprintf(results, "scenario,iterations,bytes,transactions,starts,"
+            "model_us_full_speed,model_us_standard,wall_ns\n");
+
+    run_scenario("configure_device_toggle", setup_single, run_configure);
+    run_scenario("set_frequency", setup_single, run_set_frequency);
+    run_scenario("frequency_change_3step", setup_single,
+                 run_frequency_change);
+    run_scenario("retune", setup_single, run_retune);
+    run_scenario("retune_multi8", setup_multi, run_retune_multi);
+    run_scenario("single_channel", setup_single, run_single_channel);
+    run_scenario("sweep16_per_channel", setup_single, run_sweep_single);
+    run_scenario("sweep16_batched", setup_single, run_sweep_batched);
+    run_scenario("multi8_per_board", setup_multi, run_multi_per_board);
+    run_scenario("multi8_distinct", setup_multi, run_multi_distinct);
+    run_scenario("multi8_shared", setup_multi, run_multi_shared);
+    run_scenario("full_toggle_single", setup_single, run_full_toggle);
+    run_scenario("sweep16_blackout", setup_single, run_blackout);
+    run_scenario("blackout_per_board8", setup_multi, run_blackout_per_board);
+    run_scenario("emergency_stop_multi8", setup_multi, run_emergency_stop);
+
+    fclose(results);
+
+    return 0;
+}
@@ -0,0 +1,215 @@
+// Raspberry Pi PCA9685 Example
+//
+// Copyright (c) 2022 Benjamin Spencer
+// ============================================================================
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+// ============================================================================
+
+// pca9685d command line client
+//
+//   pca9685ctl [-s socket_path] COMMAND [ARGS...]
+//       Send one command (see pca9685d.h) and print the reply
+//   pca9685ctl [-s socket_path] push CHANNEL DUTY [COUNT]
+//       Map the setpoint ring and push COUNT setpoints (DUTY ramping up by
+//       one each time) without going through the socket
+
+// Include C standard libraries:
+#include <stdio.h>      // C Standard I/O libary
+#include <stdlib.h>     // C Standard library
+#include <stdint.h>     // C Standard integer types
+#include <string.h>     // C Standard string manipulation
+#include <unistd.h>     // POSIX read(), write(), close()
+#include <sys/mman.h>   // POSIX mmap()
+#include <sys/socket.h> // POSIX sockets
+#include <sys/un.h>     // POSIX UNIX domain sockets
+
+#include "pca9685d.h" // pca9685d shared memory protocol
+
+static int connect_daemon(const char *path) {
+    struct sockaddr_un address;
+
+    int fd;
+
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        return -1;
+    }
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, path);
+
+    if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+        return -1;
+    }
+
+    if (connect(fd, (struct sockaddr *) &address, sizeof(address)) < 0) {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+// Read one reply line (up to its newline) and the num_fds descriptors that
+// come with its first byte:
+static int read_reply(int fd, char *reply, int *fds, int num_fds) {
+    char control[CMSG_SPACE(2 * sizeof(int))];
+
+    struct iovec iov;
+    struct msghdr message;
+    struct cmsghdr *header;
+
+    ssize_t received;
+
+    int length = 0;
+
+    reply[0] = '\0';
+
+    while (strchr(reply, '\n') == NULL) {
+        if (length == PCA9685D_REPLY_LENGTH - 1) {
+            return -1;
+        }
+
+        iov.iov_base = reply + length;
+        iov.iov_len = PCA9685D_REPLY_LENGTH - 1 - length;
+
+        memset(&message, 0, sizeof(message));
+
+        message.msg_iov = &iov;
+        message.msg_iovlen = 1;
+        message.msg_control = control;
+        message.msg_controllen = sizeof(control);
+
+        if ((received = recvmsg(fd, &message, 0)) <= 0) {
+            return -1;
+        }
+
+        header = CMSG_FIRSTHDR(&message);
+
+        if ((length == 0) && (num_fds > 0)) {
+            if ((header == NULL) || (header->cmsg_type != SCM_RIGHTS)
+                || (header->cmsg_len != CMSG_LEN(num_fds * sizeof(int)))) {
+                return -1;
+            }
+
+            memcpy(fds, CMSG_DATA(header), num_fds * sizeof(int));
+        }
+
+        length += received;
+        reply[length] = '\0';
+    }
+
+    return 0;
+}
+
+static int push(int fd, int channel, int duty_cycle, int count) {
+    struct pca9685d_ring *ring;
+
+    char reply[PCA9685D_REPLY_LENGTH];
+
+    int fds[2]; // Ring memfd, eventfd
+    int pushed = 0;
+    int i;
+
+    if (dprintf(fd, "MAP\n") < 0) {
+        return -1;
+    }
+
+    if ((read_reply(fd, reply, fds, 2) < 0) || strncmp(reply, "OK", 2)) {
+        fprintf(stderr, "MAP failed: %s", reply);
+        return -1;
+    }
+
+    ring = mmap(NULL, sizeof(*ring), PROT_READ | PROT_WRITE, MAP_SHARED,
+                fds[0], 0);
+
+    if ((ring == MAP_FAILED) || (ring->magic != PCA9685D_MAGIC)
+        || (ring->version != PCA9685D_VERSION)) {
+        fprintf(stderr, "Not a pca9685d ring\n");
+        return -1;
+    }
+
+    for (i = 0; i < count; i++) {
+        pushed += (pca9685d_push(ring, channel, duty_cycle + i) == 0);
+    }
+
+    pca9685d_wake(ring, fds[1]);
+
+    printf("Pushed %d of %d setpoints\n", pushed, count);
+
+    return (pushed == count) ? 0 : -1;
+}
+
+int main(int argc, char **argv) {
+    char line[PCA9685D_LINE_LENGTH];
+    char reply[PCA9685D_REPLY_LENGTH];
+
+    const char *socket_path = PCA9685D_SOCKET;
+
+    int length = 0;
+    int fd;
+    int i;
+    int ret;
+
+    if ((argc > 2) && !strcmp(argv[1], "-s")) {
+        socket_path = argv[2];
+        argc -= 2;
+        argv += 2;
+    }
+
+    if (argc < 2) {
+        fprintf(stderr, "Usage: pca9685ctl [-s socket_path] COMMAND "
+                "[ARGS...]\n");
+        return 1;
+    }
+
+    if ((fd = connect_daemon(socket_path)) < 0) {
+        perror(socket_path);
+        return 1;
+    }
+
+    if (!strcmp(argv[1], "push") && (argc >= 4)) {
+        ret = push(fd, atoi(argv[2]), atoi(argv[3]),
+                   (argc > 4) ? atoi(argv[4]) : 1);
+        close(fd);
+        return (ret < 0) ? 1 : 0;
+    }
+
+    for (i = 1; i < argc; i++) {
+        length += snprintf(line + length, sizeof(line) - length, "%s%s",
+                           (i > 1) ? " " : "", argv[i]);
+
+        if (length >= (int) sizeof(line) - 1) {
+            fprintf(stderr, "Command too long\n");
+            return 1;
+        }
+    }
+
+    if ((dprintf(fd, "%s\n", line) < 0)
+        || (read_reply(fd, reply, NULL, 0) < 0)) {
+        perror("pca9685ctl");
+        return 1;
+    }
+
+    printf("%s", reply);
+
+    close(fd);
+
+    return strncmp(reply, "OK", 2) ? 1 : 0;
+}
@@ -0,0 +1,689 @@
+// Raspberry Pi PCA9685 Example
+//
+// Copyright (c) 2022 Benjamin Spencer
+// ============================================================================
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+// ============================================================================
+
+// PCA9685 control daemon
+//
+// Runs the boards for other processes: setpoints arrive through the shared
+// memory ring in pca9685d.h and configuration through a UNIX socket (see
+// pca9685d.h for the commands). Whatever is pending is collected per board
+// and sent with set_pwm_duty_cycles_mask(), so a burst of updates to one
+// board becomes a single auto-increment write.
+//
+//   pca9685d [-c config_file] [-s socket_path]
+//
+// With a config file the boards it lists are brought up and driven as
+// configured; without one the buses are scanned. The socket is created
+// with mode 0660, so only the daemon's user and group can connect.
+
+#define _GNU_SOURCE // memfd_create()
+
+// Include C standard libraries:
+#include <stdio.h>      // C Standard I/O libary
+#include <stdlib.h>     // C Standard library
+#include <stdarg.h>     // C Standard variable arguments
+#include <stdint.h>     // C Standard integer types
+#include <string.h>     // C Standard string manipulation
+#include <signal.h>     // C Standard signals
+#include <stdatomic.h>  // C Standard atomic operations
+#include <unistd.h>     // POSIX read(), write(), close()
+#include <poll.h>       // POSIX poll()
+#include <sys/mman.h>   // POSIX mmap(), memfd_create()
+#include <sys/socket.h> // POSIX sockets
+#include <sys/un.h>     // POSIX UNIX domain sockets
+#include <sys/stat.h>   // POSIX umask()
+#include <sys/eventfd.h> // Linux eventfd()
+
+#include <pi_i2c.h> // Pi I2C library!
+
+#include "pca9685_registers.h" // PCA9685 register definitions
+#include "pca9685_bus.h"       // PCA9685 bus backend
+#include "pca9685_cache.h"     // PCA9685 shadow register cache
+#include "pca9685_pwm.h"       // PCA9685 PWM output helpers
+#include "pca9685_multi.h"     // PCA9685 multi-board manager
+#include "pca9685_recovery.h"  // PCA9685 bus recovery
+#include "pca9685_config.h"    // PCA9685 configuration file
+#include "pca9685_metrics.h"   // PCA9685 bus metrics (clock)
+#include "pca9685.h"           // PCA9685 driver
+#include "pca9685d.h"          // pca9685d shared memory protocol
+
+// Use the default I2C pins (Raspian I2C interface disabled via
+// rasp-config):
+#define SDA_PIN 2                  // UPDATE
+#define SCL_PIN 3                  // UPDATE
+#define SPEED_GRADE I2C_FULL_SPEED // UPDATE
+
+#define MAX_CLIENTS 16
+#define MAX_CHANNELS (MAX_BOARDS * NUM_LED_CHANNELS)
+
+#define SOCKET_UMASK 0117 // Socket file mode 0660
+#define NS_PER_MS 1000000
+#define RETRY_MS 10 // Wait before resending setpoints a board refused
+
+// Poll slots: eventfd, listening socket, then the clients:
+#define POLL_EVENT 0
+#define POLL_LISTEN 1
+#define POLL_CLIENTS 2
+
+struct client {
+    int fd; // -1 = slot free
+    int length;
+    char line[PCA9685D_LINE_LENGTH];
+};
+
+static struct pca9685_recovery recovery;
+static struct pca9685_multi multi;
+static struct pca9685_config config;
+
+static struct pca9685d_ring *ring;
+static int ring_fd = -1;
+static int event_fd = -1;
+static int listen_fd = -1;
+
+static struct client clients[MAX_CLIENTS];
+
+// Newest setpoint of every channel and the channels not sent yet:
+static int setpoints[MAX_CHANNELS];
+static int dirty[MAX_BOARDS];
+
+static uint64_t num_setpoints;
+static uint64_t num_batches;
+
+// When the slot at the tail was first seen claimed but empty (0 = not):
+static uint64_t stuck_since_ns;
+
+static volatile sig_atomic_t running = 1;
+
+static void stop_running(int signal_number) {
+    running = 0;
+}
+
+static int stage_setpoint(int channel, int duty_cycle) {
+    if ((channel < 0) || (channel >= multi.num_boards * NUM_LED_CHANNELS)) {
+        return -1;
+    }
+
+    setpoints[channel] = pca9685d_clamp(duty_cycle);
+    dirty[channel / NUM_LED_CHANNELS] |= 1 << (channel % NUM_LED_CHANNELS);
+
+    num_setpoints++;
+
+    return 0;
+}
+
+// A slot claimed but still empty after PCA9685D_STUCK_MS belongs to a
+// producer that died; hand it back so the setpoints behind it get through:
+static int skip_stuck_slot(struct pca9685d_slot *slot,
+                           unsigned int position) {
+    uint64_t expected = position;
+
+    uint64_t now_ns;
+
+    // Nobody has claimed it; the ring is just empty:
+    if (atomic_load_explicit(&ring->head, memory_order_relaxed) == position) {
+        stuck_since_ns = 0;
+        return 0;
+    }
+
+    now_ns = metrics_now();
+
+    if (stuck_since_ns == 0) {
+        stuck_since_ns = now_ns;
+        return 0;
+    }
+
+    if (now_ns - stuck_since_ns < (uint64_t) PCA9685D_STUCK_MS * NS_PER_MS) {
+        return 0;
+    }
+
+    stuck_since_ns = 0;
+
+    // Loses to a producer filling it just now:
+    if (!atomic_compare_exchange_strong(&slot->word, &expected,
+        (uint64_t) (position + PCA9685D_RING_SIZE))) {
+        return 0;
+    }
+
+    atomic_fetch_add(&ring->dropped, 1);
+
+    return 1;
+}
+
+// Take everything in the ring (one lap at most so clients get served):
+static int drain_ring(void) {
+    struct pca9685d_slot *slot;
+
+    uint64_t word;
+
+    unsigned int position;
+
+    int count;
+
+    position = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+
+    for (count = 0; count < PCA9685D_RING_SIZE; count++) {
+        slot = &ring->slots[position & PCA9685D_RING_MASK];
+        word = atomic_load_explicit(&slot->word, memory_order_acquire);
+
+        if (PCA9685D_SEQUENCE(word) != position + 1) {
+            if (!skip_stuck_slot(slot, position)) {
+                break;
+            }
+
+            position++;
+            continue;
+        }
+
+        stuck_since_ns = 0;
+
+        // Clients can scribble anything in the ring; stage_setpoint()
+        // checks the channel:
+        stage_setpoint(PCA9685D_CHANNEL(word), PCA9685D_DUTY_CYCLE(word));
+
+        // Hand the slot back for the next lap:
+        atomic_store_explicit(&slot->word,
+                              (uint64_t) (position + PCA9685D_RING_SIZE),
+                              memory_order_release);
+        position++;
+    }
+
+    atomic_store_explicit(&ring->tail, position, memory_order_release);
+
+    return count;
+}
+
+static int ring_empty(void) {
+    unsigned int position;
+
+    position = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+
+    return PCA9685D_SEQUENCE(atomic_load_explicit(
+        &ring->slots[position & PCA9685D_RING_MASK].word,
+        memory_order_acquire)) != position + 1;
+}
+
+// One batch per board holding every channel changed since the last one; a
+// board that refuses its batch keeps its channels dirty for the next try:
+static void flush_setpoints(void) {
+    int duty_cycles[NUM_LED_CHANNELS];
+
+    int num_leds;
+    int board;
+    int led_id;
+    int sent = 0;
+    int ret;
+
+    for (board = 0; board < multi.num_boards; board++) {
+        if (!dirty[board]) {
+            continue;
+        }
+
+        num_leds = 0;
+
+        for (led_id = 0; led_id < NUM_LED_CHANNELS; led_id++) {
+            if (dirty[board] & (1 << led_id)) {
+                duty_cycles[num_leds++] =
+                    setpoints[board * NUM_LED_CHANNELS + led_id];
+            }
+        }
+
+        if ((ret = set_pwm_duty_cycles_mask(multi.board_addr[board],
+             dirty[board], duty_cycles)) < 0) {
+            i2c_error_handler(ret);
+            continue;
+        }
+
+        dirty[board] = 0;
+        sent = 1;
+    }
+
+    num_batches += sent;
+}
+
+// Setpoints staged but not on a board yet:
+static int unsent(void) {
+    int board;
+
+    for (board = 0; board < multi.num_boards; board++) {
+        if (dirty[board]) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+static int create_ring(void) {
+    int i;
+
+    if ((ring_fd = memfd_create("pca9685d", MFD_CLOEXEC)) < 0) {
+        return -1;
+    }
+
+    if (ftruncate(ring_fd, sizeof(*ring)) < 0) {
+        return -1;
+    }
+
+    ring = mmap(NULL, sizeof(*ring), PROT_READ | PROT_WRITE, MAP_SHARED,
+                ring_fd, 0);
+
+    if (ring == MAP_FAILED) {
+        return -1;
+    }
+
+    ring->magic = PCA9685D_MAGIC;
+    ring->version = PCA9685D_VERSION;
+    ring->num_channels = multi.num_boards * NUM_LED_CHANNELS;
+
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    atomic_init(&ring->waiting, 0);
+    atomic_init(&ring->dropped, 0);
+
+    for (i = 0; i < PCA9685D_RING_SIZE; i++) {
+        atomic_init(&ring->slots[i].word, (uint64_t) i);
+    }
+
+    return 0;
+}
+
+static int open_socket(const char *path) {
+    struct sockaddr_un address;
+
+    mode_t old_umask;
+
+    int ret;
+
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        return -1;
+    }
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, path);
+
+    if ((listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0) {
+        return -1;
+    }
+
+    // A daemon that died earlier leaves its socket behind:
+    unlink(path);
+
+    // Created 0660 rather than chmod()ed after, so it is never open wider:
+    old_umask = umask(SOCKET_UMASK);
+    ret = bind(listen_fd, (struct sockaddr *) &address, sizeof(address));
+    umask(old_umask);
+
+    if (ret < 0) {
+        return -1;
+    }
+
+    return listen(listen_fd, MAX_CLIENTS);
+}
+
+static void accept_client(void) {
+    int fd;
+    int i;
+
+    if ((fd = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC)) < 0) {
+        return;
+    }
+
+    for (i = 0; i < MAX_CLIENTS; i++) {
+        if (clients[i].fd < 0) {
+            clients[i].fd = fd;
+            clients[i].length = 0;
+            return;
+        }
+    }
+
+    dprintf(fd, "ERR too many clients\n");
+    close(fd);
+}
+
+static void close_client(struct client *client) {
+    close(client->fd);
+    client->fd = -1;
+}
+
+// Send one reply line in a single write so a client never sees half:
+static void reply(struct client *client, const char *format, ...) {
+    char line[PCA9685D_REPLY_LENGTH];
+
+    va_list args;
+
+    int length;
+
+    va_start(args, format);
+    length = vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+
+    if ((length < 0) || (length >= (int) sizeof(line))) {
+        length = snprintf(line, sizeof(line), "ERR reply too long\n");
+    }
+
+    if (send(client->fd, line, length, MSG_NOSIGNAL) != length) {
+        close_client(client);
+    }
+}
+
+// Reply to MAP with the ring and the eventfd attached:
+static void send_ring(struct client *client) {
+    char reply[PCA9685D_LINE_LENGTH];
+    char control[CMSG_SPACE(2 * sizeof(int))];
+
+    struct iovec iov;
+    struct msghdr message;
+    struct cmsghdr *header;
+
+    int fds[2] = {ring_fd, event_fd};
+
+    iov.iov_base = reply;
+    iov.iov_len = snprintf(reply, sizeof(reply), "OK %u %d\n",
+                           ring->num_channels, PCA9685D_RING_SIZE);
+
+    memset(&message, 0, sizeof(message));
+    memset(control, 0, sizeof(control));
+
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    header = CMSG_FIRSTHDR(&message);
+    header->cmsg_level = SOL_SOCKET;
+    header->cmsg_type = SCM_RIGHTS;
+    header->cmsg_len = CMSG_LEN(sizeof(fds));
+
+    memcpy(CMSG_DATA(header), fds, sizeof(fds));
+
+    if (sendmsg(client->fd, &message, MSG_NOSIGNAL) < 0) {
+        close_client(client);
+    }
+}
+
+static void run_command(struct client *client, char *line) {
+    char boards[PCA9685D_REPLY_LENGTH];
+
+    int length = 0;
+    int channel;
+    int duty_cycle;
+    int frequency;
+    int board;
+    int ret;
+
+    if (!strcmp(line, "MAP")) {
+        send_ring(client);
+    } else if (sscanf(line, "SET %d %d", &channel, &duty_cycle) == 2) {
+        if (stage_setpoint(channel, duty_cycle) < 0) {
+            reply(client, "ERR no channel %d\n", channel);
+        } else {
+            reply(client, "OK\n");
+        }
+    } else if (sscanf(line, "FREQ %d", &frequency) == 1) {
+        if ((ret = retune_boards(&multi, frequency)) < 0) {
+            reply(client, "ERR %d\n", ret);
+        } else {
+            reply(client, "OK\n");
+        }
+    } else if (!strcmp(line, "STOP")) {
+        ret = emergency_stop(&multi);
+
+        // Nothing queued before the stop may turn an output back on:
+        drain_ring();
+        memset(dirty, 0, sizeof(dirty));
+
+        if (ret < 0) {
+            reply(client, "ERR %d\n", ret);
+        } else {
+            reply(client, "OK\n");
+        }
+    } else if (!strcmp(line, "BOARDS")) {
+        boards[0] = '\0';
+
+        // " 0x1FF" at most per board, so MAX_BOARDS always fit:
+        for (board = 0; board < multi.num_boards; board++) {
+            length += snprintf(boards + length, sizeof(boards) - length,
+                               " 0x%X", multi.board_addr[board]);
+        }
+
+        reply(client, "OK %d%s\n", multi.num_boards, boards);
+    } else if (!strcmp(line, "STATS")) {
+        reply(client, "OK setpoints %llu batches %llu dropped %u\n",
+              (unsigned long long) num_setpoints,
+              (unsigned long long) num_batches,
+              atomic_load(&ring->dropped));
+    } else {
+        reply(client, "ERR unknown command\n");
+    }
+}
+
+static void read_client(struct client *client) {
+    char *newline;
+    char *line;
+
+    ssize_t received;
+
+    received = read(client->fd, client->line + client->length,
+                    sizeof(client->line) - client->length - 1);
+
+    if (received <= 0) {
+        close_client(client);
+        return;
+    }
+
+    client->length += received;
+    client->line[client->length] = '\0';
+
+    line = client->line;
+
+    while ((newline = strchr(line, '\n')) != NULL) {
+        *newline = '\0';
+
+        if ((newline > line) && (newline[-1] == '\r')) {
+            newline[-1] = '\0';
+        }
+
+        run_command(client, line);
+
+        if (client->fd < 0) {
+            return;
+        }
+
+        line = newline + 1;
+    }
+
+    client->length -= line - client->line;
+    memmove(client->line, line, client->length);
+
+    if (client->length == sizeof(client->line) - 1) {
+        reply(client, "ERR line too long\n");
+
+        if (client->fd >= 0) {
+            close_client(client);
+        }
+    }
+}
+
+// Service the eventfd and the sockets; sleeps only when the ring is empty,
+// and only until a stuck slot can be skipped or refused setpoints resent:
+static void poll_sockets(int idle) {
+    struct pollfd fds[POLL_CLIENTS + MAX_CLIENTS];
+
+    uint64_t wakeups;
+
+    int timeout_ms;
+    int i;
+
+    fds[POLL_EVENT].fd = event_fd;
+    fds[POLL_LISTEN].fd = listen_fd;
+
+    for (i = 0; i < MAX_CLIENTS; i++) {
+        fds[POLL_CLIENTS + i].fd = clients[i].fd;
+    }
+
+    for (i = 0; i < POLL_CLIENTS + MAX_CLIENTS; i++) {
+        fds[i].events = POLLIN;
+        fds[i].revents = 0;
+    }
+
+    if (idle) {
+        // Clients write the eventfd only while this is set; look at the
+        // ring once more after setting it so no push goes unnoticed:
+        atomic_store(&ring->waiting, 1);
+        atomic_thread_fence(memory_order_seq_cst);
+
+        idle = ring_empty();
+    }
+
+    if (!idle) {
+        timeout_ms = 0;
+    } else if (unsent()) {
+        timeout_ms = RETRY_MS;
+    } else {
+        timeout_ms = stuck_since_ns ? PCA9685D_STUCK_MS : -1;
+    }
+
+    if (poll(fds, POLL_CLIENTS + MAX_CLIENTS, timeout_ms) < 0) {
+        atomic_store(&ring->waiting, 0);
+        return;
+    }
+
+    atomic_store(&ring->waiting, 0);
+
+    // Clear the counter; being woken was all it was for:
+    if ((fds[POLL_EVENT].revents & POLLIN)
+        && (read(event_fd, &wakeups, sizeof(wakeups)) < 0)) {
+        wakeups = 0;
+    }
+
+    if (fds[POLL_LISTEN].revents & POLLIN) {
+        accept_client();
+    }
+
+    for (i = 0; i < MAX_CLIENTS; i++) {
+        if ((clients[i].fd >= 0)
+            && (fds[POLL_CLIENTS + i].revents & (POLLIN | POLLHUP))) {
+            read_client(&clients[i]);
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    struct sigaction action;
+
+    const char *config_path = NULL;
+    const char *socket_path = PCA9685D_SOCKET;
+
+    int board_addrs[MAX_BOARDS];
+
+    int option;
+    int i;
+    int ret;
+
+    while ((option = getopt(argc, argv, "c:s:")) != -1) {
+        switch (option) {
+            case 'c':
+                config_path = optarg;
+                break;
+            case 's':
+                socket_path = optarg;
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-c config_file] "
+                        "[-s socket_path]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    if ((ret = config_i2c(SDA_PIN, SCL_PIN, SPEED_GRADE)) < 0) {
+        printf("config_i2c() failed to configure and returned %d\n", ret);
+        return 1;
+    }
+
+    // Drive the boards through pi_i2c, recovering from bus errors:
+    init_recovery(&recovery, 0, &pi_i2c_bus);
+    set_bus(&recovery.bus);
+
+    // The config file says which boards there are and how ALLCALL is set;
+    // only scan without one:
+    if (config_path != NULL) {
+        if ((load_config(config_path, &config) < 0)
+            || (run_config(&config) < 0)) {
+            printf("Could not bring up the boards in %s\n", config_path);
+            return 1;
+        }
+
+        for (i = 0; i < config.num_boards; i++) {
+            board_addrs[i] = config.boards[i].device_addr;
+        }
+
+        if (init_boards(&multi, board_addrs, config.num_boards) < 0) {
+            return 1;
+        }
+    } else if (discover_boards(&multi) < 0) {
+        return 1;
+    }
+
+    for (i = 0; i < MAX_CLIENTS; i++) {
+        clients[i].fd = -1;
+    }
+
+    if ((create_ring() < 0)
+        || ((event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0)
+        || (open_socket(socket_path) < 0)) {
+        perror("pca9685d");
+        return 1;
+    }
+
+    // No SA_RESTART so poll() returns on a signal:
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = stop_running;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    signal(SIGPIPE, SIG_IGN);
+
+    printf("pca9685d: %d boards (%u channels) on %s\n", multi.num_boards,
+           ring->num_channels, socket_path);
+
+    while (running) {
+        int drained = drain_ring();
+
+        poll_sockets(drained == 0);
+
+        flush_setpoints();
+    }
+
+    for (i = 0; i < MAX_CLIENTS; i++) {
+        if (clients[i].fd >= 0) {
+            close_client(&clients[i]);
+        }
+    }
+
+    close(listen_fd);
+    unlink(socket_path);
+
+    printf("pca9685d: stopped\n");
+
+    return 0;
+}
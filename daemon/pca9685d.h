@@ -0,0 +1,194 @@
+// Raspberry Pi PCA9685 Example
+//
+// Copyright (c) 2022 Benjamin Spencer
+// ============================================================================
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+// ============================================================================
+
+// pca9685d shared memory protocol
+//
+// Clients connect to the daemon's UNIX socket and send one command per
+// line; the daemon answers each with a line starting "OK" or "ERR":
+//   MAP                 Reply carries the setpoint ring's memfd and the
+//                       daemon's eventfd (SCM_RIGHTS)
+//   SET <channel> <duty>
+//   FREQ <hz>           Retune every board
+//   STOP                Emergency stop: every output off, pending
+//                       setpoints dropped
+//   BOARDS              Device id of every board
+//   STATS               Setpoints, bus batches and ring overflows so far
+//
+// After MAP, setpoints go straight into the ring with pca9685d_push(): no
+// system call or copy through the daemon per update. Any number of
+// processes can push at once (bounded multi-producer ring, one sequence
+// number per slot). The daemon drains whatever is there, keeps the newest
+// value per channel and sends each board's changes as one batch. It only
+// needs waking through the eventfd when it has gone to sleep on an empty
+// ring, which pca9685d_wake() does for the first client to notice.
+//
+// A producer that dies between claiming a slot and filling it would hold
+// up everything behind it, so the daemon takes a slot back once it has
+// been claimed but empty for PCA9685D_STUCK_MS and counts it as dropped.
+// A slot's sequence number, channel and duty cycle are one atomic word
+// that a producer fills with a single compare-and-swap from the position
+// it claimed, so a producer that was only slow finds its slot gone, gets
+// -1 and leaves the slot untouched, whoever owns it by then.
+//
+// Channels are the flat channel space of pca9685_multi.h (board * 16 +
+// led), duty cycles 0 (off) to 4095 (fully on).
+
+#ifndef PCA9685D_H
+#define PCA9685D_H
+
+#include <stdint.h>    // C Standard integer types
+#include <stdatomic.h> // C Standard atomic operations
+#include <unistd.h>    // POSIX write()
+
+#define PCA9685D_SOCKET "/tmp/pca9685d.sock" // Default socket path
+
+#define PCA9685D_MAGIC 0x39363835 // "9685"
+#define PCA9685D_VERSION 2
+
+#define PCA9685D_RING_SIZE 4096 // Slots (power of 2)
+#define PCA9685D_RING_MASK (PCA9685D_RING_SIZE - 1)
+
+#define PCA9685D_LINE_LENGTH 128  // Longest command line
+#define PCA9685D_REPLY_LENGTH 512 // Longest reply line (BOARDS)
+#define PCA9685D_FULL_SCALE 4095  // Duty cycle treated as 100%
+#define PCA9685D_STUCK_MS 100     // Claimed slot left empty this long is
+                                  // skipped
+
+// Slot word: sequence number (position the slot is ready for) in bits 0
+// to 31, channel in 32 to 47, duty cycle in 48 to 63. A free slot holds
+// just its sequence number:
+#define PCA9685D_SEQUENCE(word) ((uint32_t) (word))
+#define PCA9685D_CHANNEL(word) ((int) (((word) >> 32) & 0xFFFF))
+#define PCA9685D_DUTY_CYCLE(word) ((int) ((word) >> 48))
+
+struct pca9685d_slot {
+    _Atomic uint64_t word;
+};
+
+struct pca9685d_ring {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t num_channels;
+
+    // Producers and the consumer on separate cache lines:
+    _Alignas(64) atomic_uint head;   // Next position to claim
+    _Alignas(64) atomic_uint tail;   // Next position the daemon reads
+    _Alignas(64) atomic_int waiting; // Daemon asleep on the eventfd
+    atomic_uint dropped;             // Pushes refused on a full ring
+
+    _Alignas(64) struct pca9685d_slot slots[PCA9685D_RING_SIZE];
+};
+
+// Duty cycle in range; every setpoint goes through here, from the socket
+// or the ring:
+static inline int pca9685d_clamp(int duty_cycle) {
+    if (duty_cycle < 0) {
+        return 0;
+    }
+
+    return (duty_cycle > PCA9685D_FULL_SCALE) ? PCA9685D_FULL_SCALE
+                                              : duty_cycle;
+}
+
+// Fill the slot claimed at position; -1 if the daemon took it back:
+static inline int pca9685d_publish(struct pca9685d_ring *ring,
+                                   unsigned int position, int channel,
+                                   int duty_cycle) {
+    struct pca9685d_slot *slot;
+
+    uint64_t expected = position;
+    uint64_t word;
+
+    slot = &ring->slots[position & PCA9685D_RING_MASK];
+    word = (uint64_t) (position + 1) | ((uint64_t) (uint16_t) channel << 32)
+           | ((uint64_t) pca9685d_clamp(duty_cycle) << 48);
+
+    if (!atomic_compare_exchange_strong_explicit(&slot->word, &expected,
+        word, memory_order_release, memory_order_relaxed)) {
+        return -1;
+    }
+
+    return 0;
+}
+
+// Queue a setpoint; -1 if the channel doesn't exist, the ring is full
+// (counted as dropped) or the daemon took the slot back:
+static inline int pca9685d_push(struct pca9685d_ring *ring, int channel,
+                                int duty_cycle) {
+    struct pca9685d_slot *slot;
+
+    unsigned int position;
+    unsigned int sequence;
+
+    if ((channel < 0) || ((unsigned int) channel >= ring->num_channels)) {
+        return -1;
+    }
+
+    position = atomic_load_explicit(&ring->head, memory_order_relaxed);
+
+    for (;;) {
+        slot = &ring->slots[position & PCA9685D_RING_MASK];
+        sequence = PCA9685D_SEQUENCE(
+            atomic_load_explicit(&slot->word, memory_order_acquire));
+
+        if (sequence == position) {
+            // Free slot; claim it unless another producer got there first:
+            if (atomic_compare_exchange_weak_explicit(&ring->head, &position,
+                position + 1, memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        } else if ((int) (sequence - position) < 0) {
+            // Still holding a setpoint from a lap ago:
+            atomic_fetch_add_explicit(&ring->dropped, 1,
+                                      memory_order_relaxed);
+            return -1;
+        } else {
+            position = atomic_load_explicit(&ring->head,
+                                            memory_order_relaxed);
+        }
+    }
+
+    return pca9685d_publish(ring, position, channel, duty_cycle);
+}
+
+// Wake the daemon if it is asleep; call after a burst of pushes:
+static inline int pca9685d_wake(struct pca9685d_ring *ring, int event_fd) {
+    uint64_t one = 1;
+
+    // Pairs with the daemon's fence between setting waiting and checking
+    // the ring one last time:
+    atomic_thread_fence(memory_order_seq_cst);
+
+    if (!atomic_load_explicit(&ring->waiting, memory_order_relaxed)
+        || !atomic_exchange(&ring->waiting, 0)) {
+        return 0;
+    }
+
+    if (write(event_fd, &one, sizeof(one)) < 0) {
+        return -1;
+    }
+
+    return 0;
+}
+
+#endif
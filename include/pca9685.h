@@ -0,0 +1,72 @@
+// Raspberry Pi PCA9685 Example
+//
+// Copyright (c) 2022 Benjamin Spencer
+// ============================================================================
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+// ============================================================================
+
+// PCA9685 driver
+//
+// Device setup and output functions used by test_pca9685.c. Everything
+// goes through the selected bus backend (see pca9685_bus.h).
+
+#ifndef PCA9685_H
+#define PCA9685_H
+
+#include <stdint.h> // C Standard integer types
+
+#define MAX_RETUNE_DEVICES 128 // Devices retuned together at most
+
+// Oscillator start-up time after clearing SLEEP (page 14):
+#define OSCILLATOR_SETTLE_US 500
+
+// Power cycle the devices on one bus through its backend and restore
+// their registers from the cache:
+void reboot_device(int bus_id);
+
+// Report a pi_i2c error code that recovery could not fix:
+int i2c_error_handler(int errno);
+
+// Check that a device answers at device_addr:
+int scan_for_device(uint8_t device_addr);
+
+// Set device configuration by writing to a register address:
+int configure_device(int device_addr, int reg_addr, int *configs,
+                     int num_configs);
+
+// Set LED PWM duty cycle (12 bit resolution: 0 = 0%; 4095 = 100%):
+int set_pwm_duty_cycle(int device_addr, int led_id, int duty_cycle);
+
+// Set frequency (can only occur when device in low power mode):
+int set_frequency(int device_addr, int frequency);
+
+// Change frequency on a running device in one go: sleep, write PRE_SCALE,
+// wake, wait for the oscillator and RESTART the outputs. Leaves the device
+// awake; a running device already at that PRE_SCALE is left alone:
+int retune_device(int device_addr, int frequency);
+
+// Retune several devices with one oscillator wait; steps that are the same
+// for every device go out once per bus to the 7-bit ALLCALL address
+// allcall_addr (-1 to address each device). ALLCALL is only used when
+// every listed device answers it and no other device the register cache
+// knows of on those buses does:
+int retune_devices(int num_devices, const int *device_addrs,
+                   int allcall_addr, int frequency);
+
+#endif
@@ -0,0 +1,115 @@
+// Raspberry Pi PCA9685 Example
+//
+// Copyright (c) 2022 Benjamin Spencer
+// ============================================================================
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+// ============================================================================
+
+// PCA9685 bus backend
+//
+// Every driver module reaches the devices through the backend set here
+// rather than calling pi_i2c directly, so the same code can run against
+// the real bit-banged bus (pi_i2c_bus) or a simulated one (pca9685_sim.h).
+//
+// Up to MAX_BUSES backends can be attached at once. Devices are named by
+// a device id holding the bus number above the 7-bit address, so on bus 0
+// the id is just the I2C address.
+
+#ifndef PCA9685_BUS_H
+#define PCA9685_BUS_H
+
+#define MAX_BUSES 4     // Buses attached at once
+#define BUS_ADDR_BITS 7 // Bits of the device id holding the I2C address
+
+#define DEVICE_ID(bus_id, addr) (((bus_id) << BUS_ADDR_BITS) | (addr))
+#define DEVICE_BUS(device_id) ((device_id) >> BUS_ADDR_BITS)
+#define DEVICE_ADDR(device_id) ((device_id) & ((1 << BUS_ADDR_BITS) - 1))
+
+struct pca9685_bus {
+    // Same arguments and error codes as the pi_i2c functions:
+    int (*read)(void *context, int device_addr, int reg_addr, int *data,
+                int bytes);
+    int (*write)(void *context, int device_addr, int reg_addr, int *data,
+                 int bytes);
+    int (*scan)(void *context, int *address_book);
+
+    // Cut and restore power to the devices (NULL if not possible):
+    int (*power_cycle)(void *context);
+
+    // Clock SCL until a device holding SDA low lets go, then send a STOP
+    // (NULL if not possible):
+    int (*bus_clear)(void *context);
+
+    // Wait at least usec microseconds (NULL to use nanosleep()):
+    int (*delay)(void *context, int usec);
+
+    void *context; // Passed to every function above
+};
+
+// Pins and speed of one pi_i2c bus:
+struct pi_i2c_config {
+    int sda_pin;
+    int scl_pin;
+    int speed_grade;
+};
+
+// pi_i2c backed bus on the pins given to config_i2c() (don't combine with
+// buses from init_pi_i2c_bus()):
+extern const struct pca9685_bus pi_i2c_bus;
+
+// pi_i2c backed bus on its own pins. pi_i2c keeps its pins and timing in
+// globals and drives one pin pair at a time, so every bus set up this way
+// shares one lock and each switch between them costs a config_i2c(). They
+// work side by side but never transfer at the same time: for throughput
+// that scales with buses, attach backends that don't share pi_i2c:
+void init_pi_i2c_bus(struct pca9685_bus *bus, struct pi_i2c_config *config);
+
+// Select the backend for bus 0:
+void set_bus(const struct pca9685_bus *bus);
+
+// Backend for bus 0 (NULL if none):
+const struct pca9685_bus *get_bus(void);
+
+// Attach a backend as bus bus_id (NULL to detach):
+int attach_bus(int bus_id, const struct pca9685_bus *bus);
+
+// Backend attached as bus_id (NULL if none):
+const struct pca9685_bus *get_attached_bus(int bus_id);
+
+// Transfers go to the bus named in the device id:
+int bus_read(int device_id, int reg_addr, int *data, int bytes);
+int bus_write(int device_id, int reg_addr, int *data, int bytes);
+
+// Scan bus 0, or a given bus (address book indexed by 7-bit address):
+int bus_scan(int *address_book);
+int bus_scan_on(int bus_id, int *address_book);
+
+// Recovery hooks of one bus (-1 if it has none):
+int bus_power_cycle(int bus_id);
+int bus_clear(int bus_id);
+
+// Wait at least usec microseconds for the devices on one bus, through its
+// delay hook (nanosleep() without one):
+int bus_delay(int bus_id, int usec);
+
+// Same for every bus in bus_mask (bit n = bus n) at once: each delay hook
+// is called and one nanosleep() covers the buses without one:
+int bus_delay_buses(int bus_mask, int usec);
+
+#endif
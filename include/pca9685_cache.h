@@ -0,0 +1,76 @@
+// Raspberry Pi PCA9685 Example
+//
+// Copyright (c) 2022 Benjamin Spencer
+// ============================================================================
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+// ============================================================================
+
+// PCA9685 shadow register cache
+//
+// Keeps a copy of every device register in memory so read-modify-write
+// cycles never have to go to the bus and only bytes that actually changed
+// get written out.
+
+#ifndef PCA9685_CACHE_H
+#define PCA9685_CACHE_H
+
+#include "pca9685_bus.h" // PCA9685 bus backend (device ids)
+
+#define NUM_REGISTERS 256   // Size of the PCA9685 register address space
+#define NUM_DEVICE_ADDR 128 // Number of 7-bit I2C addresses
+#define NUM_DEVICE_IDS (MAX_BUSES * NUM_DEVICE_ADDR) // Across every bus
+
+#define ALL_DEVICES -1 // Pass to invalidate_register_cache() to drop all
+
+// Load register defaults and then read the device to fill the cache:
+int init_register_cache(int device_addr);
+
+// Read registers from the cache (resyncs first if the cache is invalid):
+int read_register_cache(int device_addr, int reg_addr, int *data, int bytes);
+
+// Write registers through the cache (only changed bytes hit the bus):
+int write_register_cache(int device_addr, int reg_addr, int *data, int bytes);
+
+// Record registers that reached the device some other way (e.g. a write to
+// an ALLCALL or SUBADR group address) without touching the bus:
+int update_register_cache(int device_addr, int reg_addr, int *data,
+                          int bytes);
+
+// Start the cache from registers written without reading the device first
+// (e.g. a startup register program); the rest keep their power-on values:
+int assume_register_cache(int device_addr, int reg_addr, int *data,
+                          int bytes);
+
+// Whether a device's cache was ever filled, i.e. the driver knows it:
+int is_register_cache_loaded(int device_addr);
+
+// Mark the cache stale (e.g. after reboot_device()):
+int invalidate_register_cache(int device_addr);
+
+// Reload the cache from the device:
+int resync_register_cache(int device_addr);
+
+// Write the last known registers back to a device that was reset (or to
+// every device ever loaded with ALL_DEVICES):
+int restore_register_cache(int device_addr);
+
+// Same for every device ever loaded on one bus:
+int restore_bus_registers(int bus_id);
+
+#endif
@@ -0,0 +1,94 @@
+// Raspberry Pi PCA9685 Example
+//
+// Copyright (c) 2022 Benjamin Spencer
+// ============================================================================
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+// ============================================================================
+
+// PCA9685 write coalescing
+//
+// Sits in front of one device and collects LED register writes for a time
+// window before sending anything. Writes to a channel that already has one
+// pending replace it, and bytes equal to what was last transmitted (the
+// register cache) are dropped, so a control loop repeating the same
+// setpoints costs no bus time at all.
+//
+// When the window closes the changed bytes are sent as the cheapest set of
+// auto-increment bursts for the bus cost model: a run of unchanged bytes
+// between two changed ones is resent whenever that costs less than another
+// transaction, which ends in a single full burst when most bytes changed.
+
+#ifndef PCA9685_COALESCE_H
+#define PCA9685_COALESCE_H
+
+#include <stdint.h> // C Standard integer types
+
+#include "pca9685_encode.h" // PCA9685 duty cycle encoder
+
+struct bus_cost_model {
+    int byte_ns;        // One byte and its ACK on the wire
+    int transaction_ns; // Start, address, register pointer, stop and any
+                        // per-call software overhead
+};
+
+struct coalesce_stats {
+    uint64_t requests;     // Channel writes asked for
+    uint64_t merged;       // Replaced a write still pending
+    uint64_t suppressed;   // Same as what the device already has
+    uint64_t flushes;
+    uint64_t transactions; // Bus writes sent
+    uint64_t bytes;        // Register bytes sent (including resent gaps)
+};
+
+struct pca9685_coalesce {
+    int device_addr;
+    uint64_t window_ns;
+    struct bus_cost_model cost;
+
+    int led_bank[LED_BANK_BYTES]; // Newest requested image
+    int pending;                  // Bit n set if channel n has a write
+    uint64_t opened_ns;           // When the oldest pending write came in
+
+    struct coalesce_stats stats;
+};
+
+// Cost of I2C at speed_hz with no software overhead:
+void bus_cost_for_speed(struct bus_cost_model *cost, int speed_hz);
+
+// Set up for a device (window_us = 0 sends on every call); uses the cost
+// model for I2C_FULL_SPEED until changed:
+int init_coalesce(struct pca9685_coalesce *coalesce, int device_addr,
+                  int window_us);
+
+// Request LED registers (within LED0_ON_L to LED15_OFF_H):
+int coalesce_write(struct pca9685_coalesce *coalesce, int reg_addr,
+                   int *data, int bytes);
+
+// Request a duty cycle for one channel:
+int coalesce_duty_cycle(struct pca9685_coalesce *coalesce, int led_id,
+                        int duty_cycle);
+
+// Send pending writes if the window has closed; call from the control
+// loop:
+int poll_coalesce(struct pca9685_coalesce *coalesce);
+
+// Send pending writes now:
+int flush_coalesce(struct pca9685_coalesce *coalesce);
+
+#endif
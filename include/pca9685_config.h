@@ -0,0 +1,91 @@
+// Raspberry Pi PCA9685 Example
+//
+// Copyright (c) 2022 Benjamin Spencer
+// ============================================================================
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+// ============================================================================
+
+// PCA9685 configuration file
+//
+// Describes every board in one file and compiles it ahead of time into a
+// register program: the MODE1, MODE2, PRE_SCALE and LED bank bytes each
+// board should end up with. Running the program brings the whole rack up
+// with a few writes per board and a single oscillator wait instead of a
+// read-modify-write per setting. Example:
+//
+//   # Applies to the boards that follow
+//   [defaults]
+//   frequency = 200       ; Hz
+//   clock = internal      ; or EXTCLK frequency in Hz
+//   invert = no
+//   output = totem_pole   ; or open_drain
+//   output_disabled = low ; outputs while OE is high: low, high or high_z
+//   allcall = yes
+//   phase = fixed         ; fixed, round_robin or an ON delay in counts
+//   duty = 0
+//
+//   [board 0x40]
+//   bus = 0
+//   frequency = 1526
+//   led15.duty = 2048
+//   led15.phase = 0
+//
+// Anything not given is safe: outputs off, totem pole, not inverted, low
+// while OE is high, at the 200 Hz power-on frequency.
+
+#ifndef PCA9685_CONFIG_H
+#define PCA9685_CONFIG_H
+
+#include <stdio.h> // C Standard I/O libary
+
+#include "pca9685_registers.h" // PCA9685 register definitions
+#include "pca9685_encode.h"    // PCA9685 duty cycle encoder
+#include "pca9685_multi.h"     // PCA9685 multi-board (MAX_BOARDS)
+
+#define CONFIG_PROGRAM_BYTES (LED15_OFF_H + 1) // MODE1 to LED15_OFF_H
+
+struct config_board {
+    int device_addr; // Device id
+    int frequency;
+    int clock_hz;    // EXTCLK frequency (0 = internal oscillator)
+    int led_delay_times[NUM_LED_CHANNELS];
+
+    // Compiled program:
+    int reg_values[CONFIG_PROGRAM_BYTES]; // MODE1 (awake) to LED15_OFF_H
+    int prescale;
+};
+
+struct pca9685_config {
+    int num_boards;
+    struct config_board boards[MAX_BOARDS];
+};
+
+// Parse, validate and compile a configuration file; errors are reported
+// with their line number:
+int load_config(const char *path, struct pca9685_config *config);
+
+// Same for an open stream:
+int read_config(FILE *file, struct pca9685_config *config);
+
+// Write the program to every board: asleep, PRE_SCALE, one burst of MODE2
+// through the LED banks, one oscillator wait, then awake. The register
+// cache and channel phases are set from the program:
+int run_config(struct pca9685_config *config);
+
+#endif
@@ -0,0 +1,74 @@
+// Raspberry Pi PCA9685 Example
+//
+// Copyright (c) 2022 Benjamin Spencer
+// ============================================================================
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+// ============================================================================
+
+// PCA9685 bus dispatcher
+//
+// One command queue and worker thread per attached bus so boards on
+// different buses are written in parallel. Updates are routed by the bus
+// number in their device id; each worker is the only thread touching its
+// bus while the dispatcher runs. Buses only run in parallel if their
+// backends are independent: pi_i2c drives one bus at a time, so workers
+// on several init_pi_i2c_bus() buses queue up behind its lock.
+
+#ifndef PCA9685_DISPATCH_H
+#define PCA9685_DISPATCH_H
+
+#include "pca9685_bus.h"   // PCA9685 bus backend
+#include "pca9685_queue.h" // PCA9685 asynchronous command queue
+#include "pca9685_multi.h" // PCA9685 multi-board manager
+
+struct pca9685_dispatch {
+    struct pca9685_queue queues[MAX_BUSES]; // Queue of each bus
+    int running[MAX_BUSES];                 // Worker started for bus
+};
+
+// Start a worker for every attached bus; with pin_workers set worker n
+// runs only on CPU n (modulo the number of CPUs):
+int start_dispatch(struct pca9685_dispatch *dispatch, int pin_workers);
+
+// Send everything still queued and stop every worker:
+int stop_dispatch(struct pca9685_dispatch *dispatch);
+
+// Queue a register write on the device's bus (-1 if that queue is full):
+int dispatch_write(struct pca9685_dispatch *dispatch, int device_id,
+                   int reg_addr, int *data, int bytes,
+                   queue_callback callback, void *context);
+
+// Queue a duty cycle write for one channel on the device's bus:
+int dispatch_duty_cycle(struct pca9685_dispatch *dispatch, int device_id,
+                        int led_id, int duty_cycle, queue_callback callback,
+                        void *context);
+
+// Queue an encoded LED bank for every channel of the device (see
+// queue_led_bank()):
+int dispatch_led_bank(struct pca9685_dispatch *dispatch, int device_id,
+                      int *led_bank, queue_callback callback,
+                      void *context);
+
+// Queue every channel of the flat channel space, one LED bank write per
+// board superseding anything older queued for it; returns -1 if any queue
+// was full (boards before it were queued):
+int dispatch_duty_cycles(struct pca9685_dispatch *dispatch,
+                         struct pca9685_multi *multi, int *duty_cycles);
+
+#endif
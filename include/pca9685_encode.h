@@ -0,0 +1,104 @@
+// Raspberry Pi PCA9685 Example
+//
+// Copyright (c) 2022 Benjamin Spencer
+// ============================================================================
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+// ============================================================================
+
+// PCA9685 duty cycle encoder
+//
+// Integer-only mapping from a 12-bit duty cycle and ON delay (phase) to the
+// LEDn_ON_L, LEDn_ON_H, LEDn_OFF_L, LEDn_OFF_H register image. Nothing here
+// touches the bus so it can be used from tight control loops.
+
+#ifndef PCA9685_ENCODE_H
+#define PCA9685_ENCODE_H
+
+#include <stdint.h> // C Standard integer types
+
+#define NUM_LED_CHANNELS 16 // LED0 to LED15
+#define LED_REG_BYTES 4     // ON_L, ON_H, OFF_L, OFF_H per channel
+#define LED_BANK_BYTES (NUM_LED_CHANNELS * LED_REG_BYTES) // LED0 to LED15
+
+#define PWM_COUNTS 4096      // Counts in one PWM frame (12 bit)
+#define PWM_FULL_SCALE 4095  // Duty cycle treated as 100%
+#define PWM_FULL_BIT 0x10    // Full on/off bit in LEDn_ON_H/LEDn_OFF_H
+
+// Same 10% ON delay set_pwm_duty_cycle() always used, without the floating
+// point ROUND(0.10 * 4096) - 1:
+#define PWM_DEFAULT_DELAY (((PWM_COUNTS + 5) / 10) - 1)
+
+// Packed register image: byte 0 = ON_L, 1 = ON_H, 2 = OFF_L, 3 = OFF_H
+#define PWM_FULL_ON (PWM_FULL_BIT << 8)
+#define PWM_FULL_OFF ((uint32_t) PWM_FULL_BIT << 24)
+
+// See page 16 for example on how to calculate LEDn_ON & LEDn_OFF. Written
+// with selects instead of branches so encode_pwm_bank() vectorizes:
+static inline uint32_t encode_pwm(int duty_cycle, int led_delay_time) {
+    uint32_t led_on_time = (uint32_t) led_delay_time & (PWM_COUNTS - 1);
+
+    // Masking deals with frame count wrapping:
+    uint32_t led_off_time = (led_on_time + (uint32_t) duty_cycle)
+                            & (PWM_COUNTS - 1);
+
+    uint32_t full_on = -(uint32_t) (duty_cycle >= PWM_FULL_SCALE);
+    uint32_t full_off = -(uint32_t) (duty_cycle <= 0);
+
+    uint32_t image = led_on_time | (led_off_time << 16);
+
+    return (image & ~(full_on | full_off))
+           | (full_on & (led_on_time | PWM_FULL_ON))
+           | (full_off & PWM_FULL_OFF);
+}
+
+// Unpack a register image into the byte array write_i2c() takes:
+static inline void unpack_pwm(uint32_t image, int *led_register_values) {
+    led_register_values[0] = image & 0xFF;
+    led_register_values[1] = (image >> 8) & 0xFF;
+    led_register_values[2] = (image >> 16) & 0xFF;
+    led_register_values[3] = image >> 24;
+}
+
+// Calculate the 4 LEDn register values for a duty cycle and ON delay
+// (inline so per-channel callers don't pay for a call):
+static inline void encode_pwm_registers(int duty_cycle, int led_delay_time,
+                                        int *led_register_values) {
+    unpack_pwm(encode_pwm(duty_cycle, led_delay_time), led_register_values);
+}
+
+// Same, but starting from the channel's current register values: fully on
+// and fully off only flip the full bits (page 16) so one or two bytes
+// change instead of four:
+void encode_pwm_update(int duty_cycle, int led_delay_time,
+                       int *led_register_values);
+
+// Duty cycle a channel's 4 LEDn register values produce (0 when fully off,
+// PWM_FULL_SCALE when fully on):
+int decode_pwm_registers(const int *led_register_values);
+
+// Encode all 16 channels at once into packed register images:
+void encode_pwm_images(const int *restrict duty_cycles,
+                       const int *restrict led_delay_times,
+                       uint32_t *restrict images);
+
+// Encode all 16 channels at once into an LED0_ON_L to LED15_OFF_H image:
+void encode_pwm_bank(const int *duty_cycles, const int *led_delay_times,
+                     int *led_bank);
+
+#endif
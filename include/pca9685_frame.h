@@ -0,0 +1,71 @@
+// Raspberry Pi PCA9685 Example
+//
+// Copyright (c) 2022 Benjamin Spencer
+// ============================================================================
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+// ============================================================================
+
+// PCA9685 double-buffered frames
+//
+// Channel values are staged in a back buffer and committed together. A
+// commit goes out as a single auto-increment write with MODE2 OCH set to
+// change on STOP, so every output switches on the same PWM cycle instead
+// of tearing across several. The register cache is the front buffer:
+// channels not staged keep their committed value.
+//
+// Commits are paced to the PWM period; one that comes early waits for the
+// next period rather than overwriting a frame the chip never showed. The
+// period is worked out from the cached PRE_SCALE and the oscillator the
+// device runs on at every commit, so it follows retunes and calibration.
+
+#ifndef PCA9685_FRAME_H
+#define PCA9685_FRAME_H
+
+#include <stdint.h> // C Standard integer types
+
+#include "pca9685_encode.h" // PCA9685 duty cycle encoder
+
+struct pca9685_frame {
+    int device_addr;
+    int duty_cycles[NUM_LED_CHANNELS]; // Back buffer
+    int staged;                        // Bit n set if channel n is staged
+
+    uint64_t period_ns;      // One PWM period, as of the last commit
+    uint64_t next_commit_ns; // Earliest time for the next commit
+};
+
+// Set up a frame for a device (register cache loaded); turns on
+// auto-increment and OCH change on STOP:
+int init_frame(struct pca9685_frame *frame, int device_addr);
+
+// Stage one channel:
+int stage_duty_cycle(struct pca9685_frame *frame, int led_id,
+                     int duty_cycle);
+
+// Stage all 16 channels:
+int stage_duty_cycles(struct pca9685_frame *frame, int *duty_cycles);
+
+// Drop everything staged since the last commit:
+void discard_frame(struct pca9685_frame *frame);
+
+// Wait for the next PWM period if needed and send the staged channels in
+// one transaction:
+int commit_frame(struct pca9685_frame *frame);
+
+#endif
@@ -0,0 +1,67 @@
+// Raspberry Pi PCA9685 Example
+//
+// Copyright (c) 2022 Benjamin Spencer
+// ============================================================================
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+// ============================================================================
+
+// PCA9685 frequency planner
+//
+// Works out PRE_SCALE for a target PWM frequency from the oscillator that
+// actually drives each board: the 25 MHz internal oscillator, a clock on
+// the EXTCLK pin, or a calibrated figure for a board whose oscillator has
+// drifted. Output frequency is clock / (4096 * (PRE_SCALE + 1)) (page 25).
+
+#ifndef PCA9685_FREQ_H
+#define PCA9685_FREQ_H
+
+#define INT_CLOCK_HZ 25000000 // Internal oscillator (page 1)
+#define EXT_CLOCK_MAX_HZ 50000000 // Fastest EXTCLK input (page 25)
+
+#define PRESCALE_MIN 0x03 // Device refuses anything lower
+#define PRESCALE_MAX 0xFF
+
+#define FREQ_TABLES 8 // Clock sources with a cached prescale table
+
+struct freq_plan {
+    int prescale;
+    int achieved_mhz; // Output frequency in millihertz
+    int error_ppm;    // (achieved - target) / target in parts per million
+};
+
+// Pick the PRE_SCALE giving the frequency (Hz) closest to the target for a
+// given oscillator; targets out of range get the nearest end:
+int plan_frequency(int clock_hz, int frequency, struct freq_plan *plan);
+
+// Oscillator frequency driving a device right now (INT_CLOCK_HZ unless
+// calibrated or switched to EXTCLK):
+int get_clock_frequency(int device_addr);
+
+// Record a measured frequency for the clock the device is on now:
+int set_clock_frequency(int device_addr, int clock_hz);
+
+// Work out and record a device's oscillator frequency from its output
+// frequency measured at the current PRE_SCALE (in millihertz):
+int calibrate_oscillator(int device_addr, int measured_mhz);
+
+// Switch a device to the clock on its EXTCLK pin. The device is left
+// asleep and stays on EXTCLK until it is reset (page 14):
+int use_external_clock(int device_addr, int clock_hz);
+
+#endif
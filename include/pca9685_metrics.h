@@ -0,0 +1,102 @@
+// Raspberry Pi PCA9685 Example
+//
+// Copyright (c) 2022 Benjamin Spencer
+// ============================================================================
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+// ============================================================================
+
+// PCA9685 bus metrics
+//
+// Per-operation latency histograms and per-error counters for every bus
+// transaction. Recording is lock-free (relaxed atomic adds into fixed
+// buckets) and never allocates, so it stays on in the hot path.
+//
+// Histogram buckets follow the HDR layout: values below 8 ns get a bucket
+// each, above that every power of two is split into 8 sub-buckets (12.5%
+// resolution).
+
+#ifndef PCA9685_METRICS_H
+#define PCA9685_METRICS_H
+
+#include <stdint.h> // C Standard integer types
+
+#define METRICS_SUB_BUCKETS 8 // Sub-buckets per power of two
+#define METRICS_BUCKETS 304   // Covers up to 2^40 ns (about 18 minutes)
+
+// Operations timed:
+#define METRICS_READ 0
+#define METRICS_WRITE 1
+#define METRICS_SCAN 2
+#define METRICS_OPS 3
+
+// Error counters (pi_i2c error codes and anything else):
+#define METRICS_OTHER 0
+#define METRICS_ENACK 1
+#define METRICS_EBADXFR 2
+#define METRICS_EBADREGADDR 3
+#define METRICS_ECLKTIMEOUT 4
+#define METRICS_ENACKRST 5
+#define METRICS_EBUSLOCKUP 6
+#define METRICS_EBUSUNKERR 7
+#define METRICS_EFAILSTCOND 8
+#define METRICS_EDEVICEHUNG 9
+#define METRICS_ERRORS 10
+
+struct latency_histogram {
+    uint64_t count;
+    uint64_t total_ns;
+    uint64_t max_ns;
+    uint64_t buckets[METRICS_BUCKETS];
+};
+
+struct pca9685_metrics {
+    struct latency_histogram ops[METRICS_OPS];
+    uint64_t errors[METRICS_ERRORS];
+};
+
+// Monotonic time stamp for record_bus_operation():
+uint64_t metrics_now(void);
+
+// Record one bus operation that started at start_ns and returned ret:
+void record_bus_operation(int op, uint64_t start_ns, int ret);
+
+// Copy the current counters:
+void get_metrics(struct pca9685_metrics *snapshot);
+
+// Zero every counter:
+void reset_metrics(void);
+
+// Smallest latency in a bucket:
+uint64_t metrics_bucket_floor(int bucket);
+
+// Latency below which the fraction q (0 to 1) of operations fell:
+uint64_t metrics_percentile(const struct latency_histogram *histogram,
+                            double q);
+
+// Name of an error counter:
+const char *metrics_error_name(int error);
+
+// Write a snapshot as one line of JSON to path every period_ms; a path of
+// the form "unix:/some/socket" sends datagrams to a UNIX socket instead:
+int start_metrics_dump(const char *path, int period_ms);
+
+// Stop the periodic dump:
+int stop_metrics_dump(void);
+
+#endif
@@ -0,0 +1,100 @@
+// Raspberry Pi PCA9685 Example
+//
+// Copyright (c) 2022 Benjamin Spencer
+// ============================================================================
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+// ============================================================================
+
+// PCA9685 motion engine
+//
+// Channels of a pca9685_multi follow keyframed trajectories instead of
+// step changes. Every PWM period the engine interpolates all channels in
+// fixed point and sends one batched update per board with only the
+// channels that changed. Keyframes can be streamed in while the channel
+// is moving.
+
+#ifndef PCA9685_MOTION_H
+#define PCA9685_MOTION_H
+
+#include <stdint.h> // C Standard integer types
+
+#include "pca9685_multi.h" // PCA9685 multi-board manager
+
+#define MOTION_MAX_KEYFRAMES 8 // Keyframes queued per channel
+#define MOTION_MAX_CHANNELS (MAX_BOARDS * NUM_LED_CHANNELS)
+
+// How a channel moves from the previous keyframe to this one:
+#define MOTION_STEP 0     // Jump at the keyframe time
+#define MOTION_LINEAR 1   // Constant speed
+#define MOTION_S_CURVE 2  // Ease in and out (smoothstep)
+#define MOTION_SPLINE 3   // Catmull-Rom spline through the keyframes
+
+struct motion_keyframe {
+    uint64_t time_us;
+    int duty_cycle;
+    int mode;
+};
+
+struct motion_channel {
+    // Keyframes[0] is where the current segment started:
+    struct motion_keyframe keyframes[MOTION_MAX_KEYFRAMES];
+    int num_keyframes;
+    int previous_duty_cycle; // Keyframe before the segment (spline)
+};
+
+struct pca9685_motion {
+    struct pca9685_multi *multi;
+    int num_channels;
+    uint32_t period_us; // One PWM period
+    uint64_t last_tick_us;
+
+    struct motion_channel channels[MOTION_MAX_CHANNELS];
+    int duty_cycles[MOTION_MAX_CHANNELS]; // Last value sent
+};
+
+// Microseconds on the monotonic clock:
+uint64_t motion_now_us(void);
+
+// Set up for the boards in multi running at the frequency given to
+// set_frequency(); every channel starts at rest where the register cache
+// says it is:
+int init_motion(struct pca9685_motion *motion, struct pca9685_multi *multi,
+                int frequency);
+
+// Declare where a channel is now (drops its keyframes):
+int set_motion_duty_cycle(struct pca9685_motion *motion, int channel,
+                          int duty_cycle);
+
+// Queue a keyframe; times must increase along a channel. Returns -1 if
+// the channel already has MOTION_MAX_KEYFRAMES queued:
+int push_keyframe(struct pca9685_motion *motion, int channel,
+                  uint64_t time_us, int duty_cycle, int mode);
+
+// Number of channels still moving:
+int motion_active(struct pca9685_motion *motion);
+
+// Interpolate every channel for now_us and send what changed. A board
+// that fails doesn't hold up the others and is sent its changes again on
+// the next tick; returns the first error:
+int motion_tick(struct pca9685_motion *motion, uint64_t now_us);
+
+// Tick on PWM period boundaries until every channel has arrived:
+int run_motion(struct pca9685_motion *motion);
+
+#endif
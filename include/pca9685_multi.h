@@ -0,0 +1,89 @@
+// Raspberry Pi PCA9685 Example
+//
+// Copyright (c) 2022 Benjamin Spencer
+// ============================================================================
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+// ============================================================================
+
+// PCA9685 multi-board manager
+//
+// Finds every PCA9685 on every attached bus and presents their outputs as
+// one flat channel space (board * 16 + led). Channels that get the same
+// value on several boards are written once per bus to the ALLCALL or a
+// SUBADR group address instead of once per board.
+
+#ifndef PCA9685_MULTI_H
+#define PCA9685_MULTI_H
+
+#include <stdint.h> // C Standard integer types
+
+#include "pca9685_pwm.h" // PCA9685 PWM output helpers
+
+#define MAX_BOARDS 64  // Boards managed at once
+#define NUM_GROUPS 3   // SUBADR1 to SUBADR3
+
+#define FIRST_BOARD_ADDR 0x40 // Lowest PCA9685 hardware address (page 8)
+#define LAST_BOARD_ADDR 0x7E  // Highest address in the scan address book
+
+struct pca9685_multi {
+    int num_boards;
+    int board_addr[MAX_BOARDS];        // Device id of each board
+    int allcall_addr;                  // 7-bit ALLCALL address (-1 none)
+    int group_addr[NUM_GROUPS];        // 7-bit SUBADR1..3 addresses
+    uint64_t group_boards[NUM_GROUPS]; // Boards responding to each group
+
+    // Scratch space for building register images:
+    int led_bank[MAX_BOARDS][LED_BANK_BYTES];
+};
+
+// Scan the buses for boards and enable ALLCALL and auto-increment on them.
+// An address is only taken for a group address (and skipped) when another
+// board found on that bus has it enabled as ALLCALL or SUBADRn. If a board
+// sits at the ALLCALL address itself, ALLCALL is left alone and
+// allcall_addr is set to -1 (group writes then go per board):
+int discover_boards(struct pca9685_multi *multi);
+
+// Manage known boards (device ids) without scanning, e.g. the boards of a
+// config file. Only auto-increment is turned on; ALLCALL stays as the
+// boards have it, and allcall_addr is -1 unless every board already
+// answers the default ALLCALL address:
+int init_boards(struct pca9685_multi *multi, const int *board_addrs,
+                int num_boards);
+
+// Make the boards in board_mask (bit n = board n) respond to group 0 to 2
+// (SUBADR1 to SUBADR3); all other boards stop responding to it. Fails if
+// a board in board_mask shares a bus with a board at the group address:
+int set_board_group(struct pca9685_multi *multi, int group,
+                    uint64_t board_mask);
+
+// Set one channel of the flat channel space:
+int set_multi_duty_cycle(struct pca9685_multi *multi, int channel,
+                         int duty_cycle);
+
+// Set every channel of the flat channel space (num_boards * 16 values):
+int set_multi_duty_cycles(struct pca9685_multi *multi, int *duty_cycles);
+
+// Change the frequency of every board at once (see retune_devices()):
+int retune_boards(struct pca9685_multi *multi, int frequency);
+
+// Turn every output of every board fully off with one single byte ALL_LED
+// write per bus to the ALLCALL address (per board without ALLCALL):
+int emergency_stop(struct pca9685_multi *multi);
+
+#endif
@@ -0,0 +1,59 @@
+// Raspberry Pi PCA9685 Example
+//
+// Copyright (c) 2022 Benjamin Spencer
+// ============================================================================
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+// ============================================================================
+
+// PCA9685 phase scheduler
+//
+// Each channel gets its own ON delay (phase) inside the 4096 count frame so
+// outputs don't all switch on the same tick. Phases are kept per device and
+// are picked up by every duty cycle write.
+
+#ifndef PCA9685_PHASE_H
+#define PCA9685_PHASE_H
+
+#define PHASE_FIXED 0         // Every channel at the 10% default delay
+#define PHASE_ROUND_ROBIN 1   // Channels spread evenly across the frame
+#define PHASE_LOAD_BALANCED 2 // Placed by duty cycle to keep overlap low
+
+struct phase_stats {
+    int peak_on;    // Most channels on at the same time during a frame
+    int peak_edges; // Most channels switching on the same tick
+};
+
+// Set the ON delay of one channel:
+int set_channel_phase(int device_addr, int led_id, int led_delay_time);
+
+// Get the ON delay of one channel:
+int get_channel_phase(int device_addr, int led_id);
+
+// Get the ON delays of all 16 channels:
+int get_channel_phases(int device_addr, int *led_delay_times);
+
+// Assign the ON delays of all 16 channels for the given duty cycles (only
+// used by PHASE_LOAD_BALANCED); takes effect on the next duty cycle write:
+int schedule_phases(int device_addr, int *duty_cycles, int strategy);
+
+// Work out concurrency for 16 duty cycles at the given ON delays:
+int get_phase_stats(int *duty_cycles, int *led_delay_times,
+                    struct phase_stats *stats);
+
+#endif
@@ -0,0 +1,65 @@
+// Raspberry Pi PCA9685 Example
+//
+// Copyright (c) 2022 Benjamin Spencer
+// ============================================================================
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+// ============================================================================
+
+// PCA9685 PWM output helpers
+//
+// Updates many channels at once using register auto-increment.
+
+#ifndef PCA9685_PWM_H
+#define PCA9685_PWM_H
+
+#include "pca9685_registers.h" // PCA9685 register definitions
+#include "pca9685_encode.h"    // PCA9685 duty cycle encoder
+
+// First register of an LED channel:
+#define LED_REG(led_id) (LED0_ON_L + LED_REG_BYTES * (led_id))
+
+// Send the bytes of an LED0_ON_L to LED15_OFF_H image marked in dirty as
+// auto-increment bursts through the register cache. Up to max_gap clean
+// bytes between two dirty ones are resent rather than starting another
+// transaction. Returns the number of transactions and adds the bytes sent
+// to *bytes_sent (unless NULL):
+int write_led_runs(int device_addr, int *led_bank, const int *dirty,
+                   int max_gap, int *bytes_sent);
+
+// Write an LED0_ON_L to LED15_OFF_H image; only the parts that differ from
+// the register cache are sent, as contiguous auto-increment bursts:
+int write_led_bank(int device_addr, int *led_bank);
+
+// Update channels 0 to num_leds - 1 with as few bus transactions as
+// possible:
+int set_pwm_duty_cycles(int device_addr, int *duty_cycles, int num_leds);
+
+// Update the channels set in channel_mask; duty_cycles holds one value per
+// set bit, lowest channel first:
+int set_pwm_duty_cycles_mask(int device_addr, int channel_mask,
+                             int *duty_cycles);
+
+// Set every channel to one duty cycle with a single write to the ALL_LED
+// registers (every channel gets the default ON delay):
+int set_all_duty_cycle(int device_addr, int duty_cycle);
+
+// Turn every channel fully off with a one byte write to ALL_LED_OFF_H:
+int blackout(int device_addr);
+
+#endif
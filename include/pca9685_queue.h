@@ -0,0 +1,117 @@
+// Raspberry Pi PCA9685 Example
+//
+// Copyright (c) 2022 Benjamin Spencer
+// ============================================================================
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+// ============================================================================
+
+// PCA9685 asynchronous command queue
+//
+// The control thread queues register writes into a lock-free single
+// producer/single consumer ring and carries on; a worker thread drains the
+// ring onto the bus. A channel write that has been superseded by a newer
+// one for the same channel is dropped without being sent, so under
+// overload only the latest setpoint goes out. A whole LED bank write
+// counts as a write to every channel: it supersedes older channel and
+// bank writes, and is dropped once every channel has a newer one.
+//
+// While a queue is running its worker is the only thread that may talk to
+// the devices it writes to (the register cache is not shared).
+
+#ifndef PCA9685_QUEUE_H
+#define PCA9685_QUEUE_H
+
+#include <stdint.h>    // C Standard integer types
+#include <stdatomic.h> // C Standard atomic operations
+#include <pthread.h>   // POSIX threads
+#include <semaphore.h> // POSIX semaphores
+
+#include "pca9685_cache.h"  // PCA9685 shadow register cache
+#include "pca9685_encode.h" // PCA9685 duty cycle encoder
+#include "pca9685_verify.h" // PCA9685 readback verification
+
+#define QUEUE_SIZE 256                 // Commands in the ring (power of 2)
+#define QUEUE_MAX_BYTES LED_BANK_BYTES // Largest single write
+
+#define QUEUE_DONE 0  // Callback status: written to the device
+#define QUEUE_STALE 1 // Callback status: dropped, a newer write replaced it
+
+#define QUEUE_ALL_LEDS NUM_LED_CHANNELS // led_id of a whole bank write
+
+// Called from the worker thread once a command is finished; status is
+// QUEUE_DONE, QUEUE_STALE or a negative pi_i2c error:
+typedef void (*queue_callback)(int status, void *context);
+
+struct queue_command {
+    int device_addr;
+    int reg_addr;
+    int bytes;
+    int data[QUEUE_MAX_BYTES];
+    int led_id;        // Channel written, QUEUE_ALL_LEDS, or -1 if it
+                       // never goes stale
+    uint32_t sequence; // Order the command was queued in
+    queue_callback callback;
+    void *context;
+};
+
+struct pca9685_queue {
+    struct queue_command commands[QUEUE_SIZE];
+
+    atomic_uint head; // Next slot to fill (producer only)
+    atomic_uint tail; // Next slot to drain (worker only)
+
+    uint32_t next_sequence;
+
+    // Newest sequence queued for every channel of every device:
+    atomic_uint latest[NUM_DEVICE_IDS][NUM_LED_CHANNELS];
+
+    atomic_int running;
+    sem_t pending; // Counts queued commands so an idle worker sleeps
+    pthread_t worker;
+
+    struct pca9685_verify *verify; // Readback run while idle (or NULL)
+};
+
+// Start the worker thread:
+int start_queue(struct pca9685_queue *queue);
+
+// Same, with the worker stepping verify whenever the ring is empty (see
+// pca9685_verify.h); verify belongs to the worker until the queue stops:
+int start_verified_queue(struct pca9685_queue *queue,
+                         struct pca9685_verify *verify);
+
+// Send everything still queued and stop the worker thread:
+int stop_queue(struct pca9685_queue *queue);
+
+// Queue a register write; returns -1 without blocking if the ring is full:
+int queue_write(struct pca9685_queue *queue, int device_addr, int reg_addr,
+                int *data, int bytes, queue_callback callback,
+                void *context);
+
+// Queue a duty cycle write for one channel (supersedes any older one):
+int queue_duty_cycle(struct pca9685_queue *queue, int device_addr,
+                     int led_id, int duty_cycle, queue_callback callback,
+                     void *context);
+
+// Queue an encoded LED bank (LED_BANK_BYTES from LED0_ON_L) for every
+// channel of a device (supersedes any older channel or bank write):
+int queue_led_bank(struct pca9685_queue *queue, int device_addr,
+                   int *led_bank, queue_callback callback, void *context);
+
+#endif
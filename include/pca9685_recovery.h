@@ -0,0 +1,120 @@
+// Raspberry Pi PCA9685 Example
+//
+// Copyright (c) 2022 Benjamin Spencer
+// ============================================================================
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+// ============================================================================
+
+// PCA9685 bus recovery
+//
+// Bus backend that wraps another one and recovers from failed transfers
+// instead of power cycling on the first error. Each failure escalates
+// through the tiers below, retrying the transfer after every step, until
+// one works or the policy's max_tier is reached:
+// 1. Retry with exponential backoff (a NACK or glitch)
+// 2. Bus clear: 9 SCL pulses and a STOP (a device holding SDA low)
+// 3. Software reset of every device through the general call address
+// 4. Power cycle
+// Tiers 3 and 4 reset every board on the bus, healthy ones included, so
+// they are opt-in: the default max_tier is RECOVERY_BUS_CLEAR. After a
+// reset the registers of every device on the bus are restored from the
+// shadow register cache. Bus faults start at tier 2 and hung devices at
+// tier 3. A device that cannot be recovered trips its circuit breaker:
+// transfers to it fail straight away for a while so the other boards on
+// the bus keep running, then a single retry decides whether it is back.
+// Backoff, bus clear and power cycle act on the wrapped bus, whichever
+// bus id it is attached as.
+//
+// Not thread safe; give each bus one recovery layer and one user.
+
+#ifndef PCA9685_RECOVERY_H
+#define PCA9685_RECOVERY_H
+
+#include <stdint.h> // C Standard integer types
+
+#include "pca9685_bus.h"   // PCA9685 bus backend
+#include "pca9685_cache.h" // PCA9685 shadow register cache
+
+// Recovery tiers:
+#define RECOVERY_RETRY 0
+#define RECOVERY_BUS_CLEAR 1
+#define RECOVERY_SOFT_RESET 2
+#define RECOVERY_POWER_CYCLE 3
+#define RECOVERY_TIERS 4
+
+// Error classes:
+#define RECOVERY_TRANSIENT 0   // ENACK, EBADXFR and anything unexpected
+#define RECOVERY_BUS_FAULT 1   // ECLKTIMEOUT, EBUSLOCKUP, EFAILSTCOND
+#define RECOVERY_DEVICE_HUNG 2 // EDEVICEHUNG, ENACKRST
+#define RECOVERY_CLASSES 3
+
+struct recovery_policy {
+    int max_retries;       // Retries at tier 1
+    int backoff_us;        // First retry delay; doubles every retry
+    int max_tier;          // Highest tier to escalate to
+    int breaker_threshold; // Unrecovered failures that trip the breaker
+    int breaker_ms;        // How long a tripped breaker stays open
+};
+
+struct recovery_stats {
+    uint64_t errors[RECOVERY_CLASSES];   // Failures by class
+    uint64_t attempts[RECOVERY_TIERS];   // Times each tier was tried
+    uint64_t recovered[RECOVERY_TIERS];  // Times each tier fixed it
+    uint64_t unrecovered;                // Failures no tier could fix
+    uint64_t breaker_trips;
+    uint64_t rejected; // Transfers refused by an open breaker
+};
+
+struct recovery_device {
+    int failures;           // Unrecovered failures in a row
+    uint64_t open_until_ns; // Breaker open until then (0 = closed)
+};
+
+struct pca9685_recovery {
+    const struct pca9685_bus *target; // Bus doing the actual work
+    int bus_id;                       // Bus number it is attached as
+    struct recovery_policy policy;
+    struct recovery_stats stats;
+    struct recovery_device devices[NUM_DEVICE_ADDR];
+    int recovering; // Transfers made while recovering pass straight through
+
+    struct pca9685_bus bus; // Backend to pass to set_bus()
+};
+
+// Wrap target, to be attached as bus_id, with the default policy (3
+// retries from 100 us, then a bus clear; the breaker trips on the first
+// unrecovered failure for one second). Raise policy.max_tier to
+// RECOVERY_SOFT_RESET or RECOVERY_POWER_CYCLE to allow resets:
+void init_recovery(struct pca9685_recovery *recovery, int bus_id,
+                   const struct pca9685_bus *target);
+
+// Class of a pi_i2c error code:
+int recovery_error_class(int error);
+
+// Whether transfers to a device are currently refused:
+int breaker_open(struct pca9685_recovery *recovery, int device_addr);
+
+// Close a device's breaker (e.g. after replacing the board):
+int reset_breaker(struct pca9685_recovery *recovery, int device_addr);
+
+// Copy the counters:
+void get_recovery_stats(struct pca9685_recovery *recovery,
+                        struct recovery_stats *stats);
+
+#endif
@@ -23,6 +23,9 @@
 
 // PCA9685 register address, defaults, and masks from data sheet 
 
+#ifndef PCA9685_REGISTERS_H
+#define PCA9685_REGISTERS_H
+
 // Register addresses (page 10 to 13):
 #define MODE1 0x00      // Mode register 1
 #define MODE2 0x01      // Mode register 1
@@ -113,11 +116,11 @@
 #define LEDN_ON_L_DEFAULT 0x00     // (= 00000000)
 #define LEDN_ON_H_DEFAULT 0x00     // (= 00000000)
 #define LEDN_OFF_L_DEFAULT 0x00    // (= 00000000)
-#define LEDN_OFF_H_DEFAULT 0x08    // (= 00010000)
+#define LEDN_OFF_H_DEFAULT 0x10    // (= 00010000)
 #define ALL_LED_ON_L_DEFAULT 0x00  // (= 00000000)
-#define ALL_LED_ON_H_DEFAULT 0x08  // (= 00010000)
+#define ALL_LED_ON_H_DEFAULT 0x10  // (= 00010000)
 #define ALL_LED_OFF_L_DEFAULT 0x00 // (= 00000000)
-#define ALL_LED_OFF_H_DEFAULT 0x08 // (= 00010000)
+#define ALL_LED_OFF_H_DEFAULT 0x10 // (= 00010000)
 #define PRE_SCALE_DEFAULT 0x1E     // (= 00011110)
 
 // Register setting masks (page 24-30):
@@ -142,5 +145,27 @@
 #define SUB3 0x01 | (0x01 << 8)    // Responds to I2C sub addr 3
 #define NO_SUB3 0x00 | (0x01 << 8) // Does not respond to I2C sub addr 3
 
-#define LED_OUTPUT_ENABLE 0x00 | (0x04 << 4)  // Use LED ON and OFF counts
-#define LED_OUTPUT_DISABLE 0x01 | (0x04 << 4) // LED always OFF
\ No newline at end of file
+// LEDn_OFF_H full OFF bit (page 29). These used to pack the bit position
+// with << 4, which apply_setting() reads as bit 0; << 8 like every other
+// mask puts them on bit 4 (0x400/0x401, was 0x40/0x41):
+#define LED_OUTPUT_ENABLE 0x00 | (0x04 << 8)  // Use LED ON and OFF counts
+#define LED_OUTPUT_DISABLE 0x01 | (0x04 << 8) // LED always OFF
+
+// MODE2 settings (page 16). INVRT is bit 4 of MODE2 and so has the same
+// value as LED_OUTPUT_DISABLE; only pass each for its own register:
+#define INVRT 0x01 | (0x04 << 8)      // MODE2: output logic inverted
+#define NO_INVRT 0x00 | (0x04 << 8)   // MODE2: output logic not inverted
+#define TOTEM_POLE 0x01 | (0x02 << 8) // MODE2: totem pole outputs
+#define OPEN_DRAIN 0x00 | (0x02 << 8) // MODE2: open-drain outputs
+
+// MODE2 OUTNE[1:0], outputs while OE is high (apply both):
+#define OUTNE_LOW 0x00 | (0x00 << 8)     // LEDn = 0 (bit 0)
+#define OUTNE_HIGH 0x01 | (0x00 << 8)    // LEDn = 1, or high-impedance
+                                         // when open-drain (bit 0)
+#define OUTNE_DRIVEN 0x00 | (0x01 << 8)  // Per bit 0 (bit 1)
+#define OUTNE_HIGH_Z 0x01 | (0x01 << 8)  // LEDn high-impedance (bit 1)
+
+#define OCH_STOP 0x00 | (0x03 << 8) // MODE2: outputs change on STOP
+#define OCH_ACK 0x01 | (0x03 << 8)  // MODE2: outputs change on ACK
+
+#endif
@@ -0,0 +1,75 @@
+// Raspberry Pi PCA9685 Example
+//
+// Copyright (c) 2022 Benjamin Spencer
+// ============================================================================
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+// ============================================================================
+
+// Simulated PCA9685 bus
+//
+// Software model of PCA9685 devices behind a pca9685_bus so the driver can
+// be run, tested and benchmarked on any Linux machine. Modelled behaviour:
+// - Full register file with auto-increment (MODE1 AI)
+// - MODE1 SLEEP, RESTART and sticky EXTCLK
+// - PRE_SCALE only accepting writes while asleep (minimum value 3)
+// - ALL_LED registers loading every LEDn register and reading back 0
+// - ALLCALL and SUBADR1..3 group addresses (write only)
+// - Software reset through the general call address (0x00, data 0x06)
+// Faults can be injected as per-byte bus latency, random NACKs, a hung
+// device (cleared by a software reset) and a stuck bus (cleared by a bus
+// clear).
+
+#ifndef PCA9685_SIM_H
+#define PCA9685_SIM_H
+
+#include <stdint.h> // C Standard integer types
+
+#include "pca9685_bus.h" // PCA9685 bus backend
+
+#define SIM_MAX_DEVICES 64 // Devices on one simulated bus
+#define SIM_ADDRESS_BOOK 127 // Entries filled in by a scan
+
+struct sim_device {
+    int device_addr;
+    uint8_t reg[256];
+    int hung; // Answer -EDEVICEHUNG until reset
+};
+
+struct pca9685_sim {
+    int num_devices;
+    struct sim_device devices[SIM_MAX_DEVICES];
+
+    int byte_latency_ns; // Time each byte (address and data) holds the bus
+    int nack_one_in;     // Fail 1 in this many transactions (0 = never)
+    unsigned int seed;   // Random state for NACK injection
+    int bus_stuck;       // Fail with -EBUSLOCKUP until a bus clear
+
+    struct pca9685_bus bus; // Backend to pass to set_bus()
+};
+
+// Set up an empty simulated bus (no latency, no faults):
+void init_sim(struct pca9685_sim *sim);
+
+// Attach a device at its power-on register state:
+int add_sim_device(struct pca9685_sim *sim, int device_addr);
+
+// Get the register file of an attached device (NULL if not attached):
+uint8_t *get_sim_registers(struct pca9685_sim *sim, int device_addr);
+
+#endif
@@ -0,0 +1,113 @@
+// Raspberry Pi PCA9685 Example
+//
+// Copyright (c) 2022 Benjamin Spencer
+// ============================================================================
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+// ============================================================================
+
+// PCA9685 readback verification
+//
+// Reads the registers of each device back a few bytes at a time and
+// compares them with the register cache (what the driver believes it
+// sent). MODE1 and MODE2 are checked first on every pass: a device showing
+// MODE1 at its power-on default (asleep, auto-increment off) when the
+// cache says otherwise has been reset, most likely by a brown-out; its
+// whole register file is restored. Other divergence is counted, reported
+// through a callback and, with repair on, written back from the cache.
+//
+// Reads only happen while a budget of bus time per period lasts. A queue
+// started with start_verified_queue() runs them in the worker's idle
+// gaps, checking the ring between reads, so a setpoint write waits behind
+// at most one short read. Not thread safe; step it from the one thread
+// talking to its devices.
+
+#ifndef PCA9685_VERIFY_H
+#define PCA9685_VERIFY_H
+
+#include <stdint.h> // C Standard integer types
+
+#include "pca9685_cache.h"    // PCA9685 shadow register cache
+#include "pca9685_encode.h"   // PCA9685 duty cycle encoder
+#include "pca9685_coalesce.h" // PCA9685 write coalescing (bus cost model)
+
+#define MAX_VERIFY_DEVICES 64
+#define VERIFY_CHUNK_BYTES 16 // LED register bytes per read (4 channels)
+
+#define VERIFY_MISMATCH 0 // LED registers differ from the cache
+#define VERIFY_MODE 1     // MODE1 or MODE2 differs from the cache
+#define VERIFY_BROWNOUT 2 // MODE1 back at its power-on default
+
+// Called when a device diverges, before any repair:
+typedef void (*verify_callback)(int event, int device_addr, int reg_addr,
+                                void *context);
+
+struct verify_stats {
+    uint64_t reads;      // Read transactions
+    uint64_t bytes;      // Register bytes read
+    uint64_t passes;     // Times every device was checked in full
+    uint64_t mismatches; // LED reads that differed
+    uint64_t mode_errors;
+    uint64_t brownouts;
+    uint64_t repairs;
+    uint64_t errors;     // Failed reads or repairs
+};
+
+struct pca9685_verify {
+    int num_devices;
+    int device_addrs[MAX_VERIFY_DEVICES];
+    int repair; // Write the cached state back on divergence
+
+    uint64_t budget_ns; // Bus time allowed per period
+    uint64_t period_ns;
+    struct bus_cost_model cost; // Least bus time a transfer can take
+
+    verify_callback callback;
+    void *context;
+
+    // Progress:
+    int device;         // Device being checked
+    int offset;         // Next LED byte to read (-1 = MODE1 and MODE2)
+    uint64_t period_start_ns;
+    uint64_t spent_ns;  // Bus time used this period
+
+    struct verify_stats stats;
+};
+
+// Allow budget_us of reads every period_ms; repair set writes divergent
+// registers back from the cache. A transfer is charged the time it took or
+// its time on the wire at I2C_FULL_SPEED (see bus_cost_for_speed()),
+// whichever is longer:
+int init_verify(struct pca9685_verify *verify, int budget_us, int period_ms,
+                int repair);
+
+// Check a device on every pass:
+int add_verify_device(struct pca9685_verify *verify, int device_addr);
+
+// Report divergence to callback (NULL to stop):
+void set_verify_callback(struct pca9685_verify *verify,
+                         verify_callback callback, void *context);
+
+// Do one read if the budget allows: 1 if the bus was used, 0 if the
+// budget for this period is spent, or a negative pi_i2c error:
+int verify_step(struct pca9685_verify *verify);
+
+// Time until the budget is topped up again:
+uint64_t verify_idle_ns(struct pca9685_verify *verify);
+
+#endif
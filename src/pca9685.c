@@ -0,0 +1,544 @@
+// Raspberry Pi PCA9685 Example
+//
+// Copyright (c) 2022 Benjamin Spencer
+// ============================================================================
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+// ============================================================================
+
+
+// Include C standard libraries:
+#include <stdlib.h> // C Standard library
+#include <stdio.h>  // C Standard I/O libary
+#include <stdint.h> // C Standard integer types
+
+#include <pi_i2c.h> // Pi I2C library! (error codes)
+
+#include "pca9685_registers.h" // PCA9685 register definitions
+#include "pca9685_log.h"       // PCA9685 driver logging
+#include "pca9685_bus.h"       // PCA9685 bus backend
+#include "pca9685_cache.h"     // PCA9685 shadow register cache
+#include "pca9685_encode.h"    // PCA9685 duty cycle encoder
+#include "pca9685_phase.h"     // PCA9685 phase scheduler
+#include "pca9685_freq.h"      // PCA9685 frequency planner
+#include "pca9685.h"           // PCA9685 driver
+
+// MODE1 bits used when retuning (page 14):
+#define MODE1_SLEEP_BIT (0x01 << 4)
+#define MODE1_RESTART_BIT (0x01 << 7)
+#define MODE1_ALLCALL_BIT 0x01
+
+void reboot_device(int bus_id) {
+    int addr;
+
+    PCA9685_LOG("Attempting to reboot the devices on bus %d!\n", bus_id);
+
+    // Let the bus backend cut and restore power to its devices:
+    if (bus_power_cycle(bus_id) < 0) {
+        PCA9685_LOG("Reboot not supported by the bus\n");
+        return;
+    }
+
+    // Registers are back to their defaults; put back the last known state
+    // (devices on other buses kept theirs):
+    if (restore_bus_registers(bus_id) < 0) {
+        for (addr = 0; addr < NUM_DEVICE_ADDR; addr++) {
+            invalidate_register_cache(DEVICE_ID(bus_id, addr));
+        }
+    }
+
+    PCA9685_LOG("Reboot done\n");
+}
+
+int i2c_error_handler(int errno) {
+    // Retries, bus clears and resets already happened in the recovery bus
+    // layer (pca9685_recovery.h) if one is in use; anything arriving here
+    // could not be recovered, so report it and let the caller decide:
+    switch (errno) {
+        case -ENACK:
+            PCA9685_LOG("I2C Error! Encountered ENACK\n");
+            break;
+        case -EBADXFR:
+            PCA9685_LOG("I2C Error! Encountered EBADXFR\n");
+            break;
+        case -EBADREGADDR:
+            PCA9685_LOG("I2C Error! Encountered EBADREGADDR\n");
+            break;
+        case -ECLKTIMEOUT:
+            PCA9685_LOG("I2C Error! Encountered ECLKTIMEOUT\n");
+            break;
+        case -ENACKRST:
+            PCA9685_LOG("I2C Error! Encountered ENACKRST\n");
+            break;
+        case -EBUSLOCKUP:
+            PCA9685_LOG("I2C Error! Encountered EBUSLOCKUP\n");
+            break;
+        case -EBUSUNKERR:
+            PCA9685_LOG("I2C Error! Encountered EBUSUNKERR\n");
+            break;
+        case -EFAILSTCOND:
+            PCA9685_LOG("I2C Error! Encountered EFAILSTCOND\n");
+            break;
+        case -EDEVICEHUNG:
+            PCA9685_LOG("I2C Error! Encountered EDEVICEHUNG\n");
+            break;
+        default:
+            break;
+    }
+
+    return 0;
+}
+
+int scan_for_device(uint8_t device_addr) {
+    // Address book passed to returned by the function:
+    int address_book[127];
+
+    int ret;
+
+    if ((ret = bus_scan(address_book)) < 0) {
+        i2c_error_handler(ret);
+    }
+
+    // Check and see if PCA9685 was detected on the bus (if not then we can't
+    // really continue with the test):
+    if (address_book[device_addr] != 1) {
+        PCA9685_LOG("Device was not detected at 0x%X\n", device_addr);
+        return -1;
+    }
+
+    PCA9685_LOG("Device was detected at 0x%X\n", device_addr);
+
+    return 0;
+}
+
+// Set device configuration by writing to a register address
+int configure_device(int device_addr, int reg_addr, int *configs,
+                     int num_configs) {
+    int reg_value[1] = {0};
+
+    int i;
+    int ret;
+
+    PCA9685_LOG("Configuring device 0x%X\n", device_addr);
+
+    // Get current register value to apply the options to (served from the
+    // shadow register cache so no bus read is needed):
+    if ((ret = read_register_cache(device_addr, reg_addr, reg_value,
+         0x01)) < 0) {
+        i2c_error_handler(ret);
+        return ret;
+    }
+
+    PCA9685_LOG("Register 0x%X currently reads 0x%X\n", reg_addr,
+                reg_value[0]);
+
+    // Go through all input options to come up with the final register value:
+    for (i = 0; i < num_configs; i++) {
+        // AND the current value of the register with a mask to clear the
+        // bit of the option being sent then OR it with the option to arrive
+        // to the final value of the register:
+        reg_value[0] = (reg_value[0] & ~(0x01 << (configs[i] >> 8)))
+                        | (configs[i] << (configs[i] >> 8));
+    }
+
+    PCA9685_LOG("Setting register 0x%X to 0x%X\n", reg_addr, reg_value[0]);
+
+    // Only goes out on the bus if the value changed:
+    if ((ret = write_register_cache(device_addr, reg_addr, reg_value,
+         0x01)) < 0) {
+        i2c_error_handler(ret);
+        return ret;
+    }
+
+    PCA9685_LOG("Device configured\n");
+
+    return 0;
+}
+
+// Set LED PWM duty cycle (12 bit resolution: 0 = 0%; 4095 = 100%):
+int set_pwm_duty_cycle(int device_addr, int led_id, int duty_cycle) {
+    int led_register_values[4];
+
+    int ret;
+
+    PCA9685_LOG("Setting duty cycle on PCA9685 device 0x%X to %d\n",
+                 device_addr, duty_cycle);
+
+    // Fully on and off only flip a full bit of what the channel has now:
+    if ((duty_cycle <= 0) || (duty_cycle >= PWM_FULL_SCALE)) {
+        if ((ret = read_register_cache(device_addr, (6 + led_id * 4),
+             led_register_values, 4)) < 0) {
+            i2c_error_handler(ret);
+            return ret;
+        }
+    }
+
+    // Integer encoding with the channel's delay time (10% unless a phase
+    // was scheduled; wrapping handled by the encoder):
+    encode_pwm_update(duty_cycle, get_channel_phase(device_addr, led_id),
+                      led_register_values);
+
+    PCA9685_LOG("Setting register 0x%X to 0x%X\n", (6 + led_id * 4),
+                (6 + led_id * 4 + 3));
+
+    if ((ret = write_register_cache(device_addr, (6 + led_id * 4),
+         led_register_values, 4)) < 0) {
+        i2c_error_handler(ret);
+        return ret;
+    }
+
+    PCA9685_LOG("Duty cycle set\n");
+
+    return 0;
+}
+
+// Set frequency (can only occur when device in low power mode):
+int set_frequency(int device_addr, int frequency) {
+    struct freq_plan plan;
+
+    int prescale_value[1] = {0};
+
+    int ret;
+
+    PCA9685_LOG("Setting frequency on device 0x%X\n", device_addr);
+
+    // Closest prescale for the oscillator driving this device (equation (1)
+    // on page 25), kept within 0x03 to 0xFF:
+    if (plan_frequency(get_clock_frequency(device_addr), frequency,
+        &plan) < 0) {
+        PCA9685_LOG("Cannot plan a frequency of %d Hz\n", frequency);
+        return -1;
+    }
+
+    prescale_value[0] = plan.prescale;
+
+    PCA9685_LOG("Calculated prescale value for desired frequency = %d\n",
+                frequency);
+    PCA9685_LOG("prescale_value = 0x%X\n", prescale_value[0]);
+    PCA9685_LOG("Achieved frequency = %d.%03d Hz (%d ppm)\n",
+                plan.achieved_mhz / 1000, plan.achieved_mhz % 1000,
+                plan.error_ppm);
+
+    if ((ret = write_register_cache(device_addr, PRE_SCALE,
+         prescale_value, 1)) < 0) {
+        i2c_error_handler(ret);
+        return ret;
+    }
+
+    PCA9685_LOG("Frequency set\n");
+
+    return 0;
+}
+
+// Send one byte to the ALLCALL address of every bus the devices are on:
+static int broadcast(int num_devices, const int *device_addrs,
+                     int allcall_addr, int reg_addr, int *value) {
+    int done = 0; // Bit n set once bus n has been sent to
+
+    int bus_id;
+    int i;
+    int ret;
+
+    for (i = 0; i < num_devices; i++) {
+        bus_id = DEVICE_BUS(device_addrs[i]);
+
+        if (done & (1 << bus_id)) {
+            continue;
+        }
+
+        if ((ret = bus_write(DEVICE_ID(bus_id, allcall_addr), reg_addr, value,
+             1)) < 0) {
+            return ret;
+        }
+
+        done |= 1 << bus_id;
+    }
+
+    return 0;
+}
+
+// Whether a device answers the 7-bit ALLCALL address, going by its cache:
+static int answers_allcall(int device_addr, int allcall_addr) {
+    int regs[ALLCALLADR + 1];
+
+    // Unreadable: assume the power-on default, which answers:
+    if (read_register_cache(device_addr, MODE1, regs, ALLCALLADR + 1) < 0) {
+        return 1;
+    }
+
+    return (regs[MODE1] & MODE1_ALLCALL_BIT)
+           && ((regs[ALLCALLADR] >> 1) == allcall_addr);
+}
+
+// An ALLCALL write reaches every device on the bus that answers it, so it
+// can only stand in for the listed devices if they all answer it and no
+// other device the cache knows of on their buses does:
+static int allcall_covers(int num_devices, const int *device_addrs,
+                          int allcall_addr) {
+    int buses = 0; // Bit n set if a device is on bus n
+
+    int listed;
+    int bus_id;
+    int addr;
+    int i;
+
+    for (i = 0; i < num_devices; i++) {
+        if (!answers_allcall(device_addrs[i], allcall_addr)) {
+            return 0;
+        }
+
+        buses |= 1 << DEVICE_BUS(device_addrs[i]);
+    }
+
+    for (bus_id = 0; bus_id < MAX_BUSES; bus_id++) {
+        if (!(buses & (1 << bus_id))) {
+            continue;
+        }
+
+        for (addr = 0; addr < NUM_DEVICE_ADDR; addr++) {
+            if (!is_register_cache_loaded(DEVICE_ID(bus_id, addr))) {
+                continue;
+            }
+
+            listed = 0;
+
+            for (i = 0; i < num_devices; i++) {
+                listed |= device_addrs[i] == DEVICE_ID(bus_id, addr);
+            }
+
+            if (!listed
+                && answers_allcall(DEVICE_ID(bus_id, addr), allcall_addr)) {
+                return 0;
+            }
+        }
+    }
+
+    return 1;
+}
+
+// Write one register on every device; when they all take the same value
+// it goes out once to the ALLCALL address (allcall_addr < 0 to never):
+static int write_devices(int num_devices, const int *device_addrs,
+                         int allcall_addr, int reg_addr, int *values) {
+    int cached[1];
+
+    int uniform = (num_devices > 1) && (allcall_addr >= 0);
+    int changed = 0;
+
+    int i;
+    int ret;
+
+    for (i = 0; i < num_devices; i++) {
+        if ((ret = read_register_cache(device_addrs[i], reg_addr, cached,
+             1)) < 0) {
+            return ret;
+        }
+
+        changed |= cached[0] != values[i];
+        uniform &= values[i] == values[0];
+    }
+
+    if (!changed) {
+        return 0;
+    }
+
+    if (uniform) {
+        if ((ret = broadcast(num_devices, device_addrs, allcall_addr,
+             reg_addr, values)) < 0) {
+            return ret;
+        }
+
+        for (i = 0; i < num_devices; i++) {
+            update_register_cache(device_addrs[i], reg_addr, values, 1);
+        }
+
+        return 0;
+    }
+
+    for (i = 0; i < num_devices; i++) {
+        if ((ret = write_register_cache(device_addrs[i], reg_addr, &values[i],
+             1)) < 0) {
+            return ret;
+        }
+    }
+
+    return 0;
+}
+
+static int retune(int num_devices, const int *device_addrs, int allcall_addr,
+                  int frequency) {
+    struct freq_plan plan;
+
+    int mode1_asleep[MAX_RETUNE_DEVICES];
+    int mode1_awake[MAX_RETUNE_DEVICES];
+    int mode1_restart[MAX_RETUNE_DEVICES];
+    int prescale_values[MAX_RETUNE_DEVICES];
+    int restart_addrs[MAX_RETUNE_DEVICES];
+
+    int num_restart = 0;
+    int changed = 0;
+    int asleep = 0;
+    int uniform = 1;
+    int bus_mask = 0;
+    int reg_value[1];
+
+    int i;
+    int ret;
+
+    if ((num_devices < 1) || (num_devices > MAX_RETUNE_DEVICES)) {
+        return -1;
+    }
+
+    // Other devices on the bus would be retuned behind their caches' back:
+    if ((allcall_addr >= 0)
+        && !allcall_covers(num_devices, device_addrs, allcall_addr)) {
+        PCA9685_LOG("ALLCALL 0x%X reaches other devices; not used\n",
+                    allcall_addr);
+        allcall_addr = -1;
+    }
+
+    for (i = 0; i < num_devices; i++) {
+        if (plan_frequency(get_clock_frequency(device_addrs[i]), frequency,
+            &plan) < 0) {
+            PCA9685_LOG("Cannot plan a frequency of %d Hz\n", frequency);
+            return -1;
+        }
+
+        prescale_values[i] = plan.prescale;
+        bus_mask |= 1 << DEVICE_BUS(device_addrs[i]);
+
+        if ((ret = read_register_cache(device_addrs[i], PRE_SCALE, reg_value,
+             1)) < 0) {
+            return ret;
+        }
+
+        changed |= reg_value[0] != plan.prescale;
+
+        // MODE1 comes from the cache so no read goes on the bus; writing 0
+        // to RESTART does nothing:
+        if ((ret = read_register_cache(device_addrs[i], MODE1, reg_value,
+             1)) < 0) {
+            return ret;
+        }
+
+        reg_value[0] &= ~MODE1_RESTART_BIT;
+
+        mode1_asleep[i] = reg_value[0] | MODE1_SLEEP_BIT;
+        mode1_awake[i] = reg_value[0] & ~MODE1_SLEEP_BIT;
+
+        // Only outputs that were running have anything to restart:
+        if (!(reg_value[0] & MODE1_SLEEP_BIT)) {
+            mode1_restart[num_restart] = mode1_awake[i] | MODE1_RESTART_BIT;
+            restart_addrs[num_restart++] = device_addrs[i];
+        } else {
+            asleep = 1;
+        }
+    }
+
+    // PRE_SCALE can only be written while the oscillator is off:
+    if (changed) {
+        if ((ret = write_devices(num_devices, device_addrs, allcall_addr,
+             MODE1, mode1_asleep)) < 0) {
+            return ret;
+        }
+
+        if ((ret = write_devices(num_devices, device_addrs, allcall_addr,
+             PRE_SCALE, prescale_values)) < 0) {
+            return ret;
+        }
+    }
+
+    if ((ret = write_devices(num_devices, device_addrs, allcall_addr, MODE1,
+         mode1_awake)) < 0) {
+        return ret;
+    }
+
+    // Devices that were running and kept their PRE_SCALE never slept:
+    if (!changed && !asleep) {
+        return 0;
+    }
+
+    // Every oscillator just started needs this before RESTART or PWM
+    // output can be relied on; one wait covers every device on every bus:
+    if ((ret = bus_delay_buses(bus_mask, OSCILLATOR_SETTLE_US)) < 0) {
+        return ret;
+    }
+
+    if (!changed || (num_restart == 0)) {
+        return 0;
+    }
+
+    for (i = 1; i < num_restart; i++) {
+        uniform &= mode1_restart[i] == mode1_restart[0];
+    }
+
+    // RESTART picks the outputs up where they were before the sleep:
+    if (uniform && (num_restart > 1) && (num_restart == num_devices)
+        && (allcall_addr >= 0)) {
+        ret = broadcast(num_devices, device_addrs, allcall_addr, MODE1,
+                        mode1_restart);
+    } else {
+        for (i = 0; (i < num_restart) && (ret >= 0); i++) {
+            ret = bus_write(restart_addrs[i], MODE1, &mode1_restart[i], 1);
+        }
+    }
+
+    if (ret < 0) {
+        return ret;
+    }
+
+    // The device clears RESTART once it is done:
+    for (i = 0; i < num_restart; i++) {
+        reg_value[0] = mode1_restart[i] & ~MODE1_RESTART_BIT;
+        update_register_cache(restart_addrs[i], MODE1, reg_value, 1);
+    }
+
+    return 0;
+}
+
+int retune_device(int device_addr, int frequency) {
+    int ret;
+
+    PCA9685_LOG("Retuning device 0x%X to %d Hz\n", device_addr, frequency);
+
+    if ((ret = retune(1, &device_addr, -1, frequency)) < 0) {
+        i2c_error_handler(ret);
+        return ret;
+    }
+
+    PCA9685_LOG("Device retuned\n");
+
+    return 0;
+}
+
+int retune_devices(int num_devices, const int *device_addrs,
+                   int allcall_addr, int frequency) {
+    int ret;
+
+    PCA9685_LOG("Retuning %d devices to %d Hz\n", num_devices, frequency);
+
+    if ((ret = retune(num_devices, device_addrs, allcall_addr,
+         frequency)) < 0) {
+        i2c_error_handler(ret);
+        return ret;
+    }
+
+    PCA9685_LOG("Devices retuned\n");
+
+    return 0;
+}
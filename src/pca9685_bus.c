@@ -0,0 +1,195 @@
+// Raspberry Pi PCA9685 Example
+//
+// Copyright (c) 2022 Benjamin Spencer
+// ============================================================================
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+// ============================================================================
+
+// Include C standard libraries:
+#include <stdlib.h> // C Standard library
+#include <stdint.h> // C Standard integer types
+#include <time.h>   // C Standard date and time manipulation
+
+#include "pca9685_bus.h"     // PCA9685 bus backend
+#include "pca9685_metrics.h" // PCA9685 bus metrics
+
+// Attached before any worker threads start, read-only afterwards:
+static const struct pca9685_bus *buses[MAX_BUSES];
+
+static const struct pca9685_bus *route(int device_id) {
+    if ((device_id < 0) || (DEVICE_BUS(device_id) >= MAX_BUSES)) {
+        return NULL;
+    }
+
+    return buses[DEVICE_BUS(device_id)];
+}
+
+void set_bus(const struct pca9685_bus *bus) {
+    buses[0] = bus;
+}
+
+const struct pca9685_bus *get_bus(void) {
+    return buses[0];
+}
+
+int attach_bus(int bus_id, const struct pca9685_bus *bus) {
+    if ((bus_id < 0) || (bus_id >= MAX_BUSES)) {
+        return -1;
+    }
+
+    buses[bus_id] = bus;
+
+    return 0;
+}
+
+const struct pca9685_bus *get_attached_bus(int bus_id) {
+    if ((bus_id < 0) || (bus_id >= MAX_BUSES)) {
+        return NULL;
+    }
+
+    return buses[bus_id];
+}
+
+int bus_read(int device_id, int reg_addr, int *data, int bytes) {
+    const struct pca9685_bus *bus = route(device_id);
+
+    uint64_t start_ns;
+
+    int ret;
+
+    if (bus == NULL) {
+        return -1;
+    }
+
+    start_ns = metrics_now();
+
+    ret = bus->read(bus->context, DEVICE_ADDR(device_id), reg_addr, data,
+                    bytes);
+
+    record_bus_operation(METRICS_READ, start_ns, ret);
+
+    return ret;
+}
+
+int bus_write(int device_id, int reg_addr, int *data, int bytes) {
+    const struct pca9685_bus *bus = route(device_id);
+
+    uint64_t start_ns;
+
+    int ret;
+
+    if (bus == NULL) {
+        return -1;
+    }
+
+    start_ns = metrics_now();
+
+    ret = bus->write(bus->context, DEVICE_ADDR(device_id), reg_addr, data,
+                     bytes);
+
+    record_bus_operation(METRICS_WRITE, start_ns, ret);
+
+    return ret;
+}
+
+int bus_scan(int *address_book) {
+    return bus_scan_on(0, address_book);
+}
+
+int bus_scan_on(int bus_id, int *address_book) {
+    const struct pca9685_bus *bus = get_attached_bus(bus_id);
+
+    uint64_t start_ns;
+
+    int ret;
+
+    if (bus == NULL) {
+        return -1;
+    }
+
+    start_ns = metrics_now();
+
+    ret = bus->scan(bus->context, address_book);
+
+    record_bus_operation(METRICS_SCAN, start_ns, ret);
+
+    return ret;
+}
+
+int bus_power_cycle(int bus_id) {
+    const struct pca9685_bus *bus = get_attached_bus(bus_id);
+
+    if ((bus == NULL) || (bus->power_cycle == NULL)) {
+        return -1;
+    }
+
+    return bus->power_cycle(bus->context);
+}
+
+int bus_clear(int bus_id) {
+    const struct pca9685_bus *bus = get_attached_bus(bus_id);
+
+    if ((bus == NULL) || (bus->bus_clear == NULL)) {
+        return -1;
+    }
+
+    return bus->bus_clear(bus->context);
+}
+
+int bus_delay(int bus_id, int usec) {
+    if ((bus_id < 0) || (bus_id >= MAX_BUSES)) {
+        return -1;
+    }
+
+    return bus_delay_buses(1 << bus_id, usec);
+}
+
+int bus_delay_buses(int bus_mask, int usec) {
+    struct timespec wait;
+
+    int sleep = 0;
+    int bus_id;
+    int ret;
+
+    for (bus_id = 0; bus_id < MAX_BUSES; bus_id++) {
+        if (!(bus_mask & (1 << bus_id))) {
+            continue;
+        }
+
+        if ((buses[bus_id] == NULL) || (buses[bus_id]->delay == NULL)) {
+            sleep = 1;
+        } else if ((ret = buses[bus_id]->delay(buses[bus_id]->context,
+                    usec)) < 0) {
+            return ret;
+        }
+    }
+
+    if (!sleep) {
+        return 0;
+    }
+
+    wait.tv_sec = usec / 1000000;
+    wait.tv_nsec = (usec % 1000000) * 1000;
+
+    while (nanosleep(&wait, &wait) < 0) {
+        // Interrupted; sleep for what is left
+    }
+
+    return 0;
+}
@@ -0,0 +1,214 @@
+// Raspberry Pi PCA9685 Example
+//
+// Copyright (c) 2022 Benjamin Spencer
+// ============================================================================
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+// ============================================================================
+
+// Include C standard libraries:
+#include <stdlib.h>  // C Standard library
+#include <unistd.h>  // POSIX sleep()
+#include <pthread.h> // POSIX threads
+
+#include <pi_i2c.h>             // Pi I2C library!
+#include <pi_lw_gpio.h>         // Pi GPIO library!
+#include <pi_microsleep_hard.h> // Pi hard microsleep library!
+
+#include "pca9685_bus.h" // PCA9685 bus backend
+
+// Turn the device on and off
+#define DEVICE_POWER_GPIO 4 // UPDATE
+
+// Pins passed to config_i2c() (used to clear a stuck pi_i2c_bus):
+#define I2C_SDA_GPIO 2 // UPDATE
+#define I2C_SCL_GPIO 3 // UPDATE
+
+#define BUS_CLEAR_PULSES 9   // Enough for a device to finish any byte
+#define BUS_CLEAR_HALF_US 5  // Half an SCL period at 100 kHz
+
+// pi_i2c keeps its pins in globals, so only one transfer at a time across
+// every pi_i2c bus (a lock per bus would let two workers move the same
+// pins):
+static pthread_mutex_t pi_i2c_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Pins pi_i2c was last configured for (NULL = whatever main() set up):
+static struct pi_i2c_config *active_config = NULL;
+
+static pthread_once_t microsleep_once = PTHREAD_ONCE_INIT;
+static int microsleep_ret;
+
+// Take the pi_i2c lock and point pi_i2c at this bus's pins:
+static int claim_pins(struct pi_i2c_config *config) {
+    int ret;
+
+    pthread_mutex_lock(&pi_i2c_lock);
+
+    if ((config == NULL) || (config == active_config)) {
+        return 0;
+    }
+
+    if ((ret = config_i2c(config->sda_pin, config->scl_pin,
+         config->speed_grade)) < 0) {
+        active_config = NULL;
+        pthread_mutex_unlock(&pi_i2c_lock);
+        return ret;
+    }
+
+    active_config = config;
+
+    return 0;
+}
+
+static void release_pins(void) {
+    pthread_mutex_unlock(&pi_i2c_lock);
+}
+
+static int pi_i2c_read(void *context, int device_addr, int reg_addr,
+                       int *data, int bytes) {
+    int ret;
+
+    if ((ret = claim_pins(context)) < 0) {
+        return ret;
+    }
+
+    ret = read_i2c(device_addr, reg_addr, data, bytes);
+
+    release_pins();
+
+    return ret;
+}
+
+static int pi_i2c_write(void *context, int device_addr, int reg_addr,
+                        int *data, int bytes) {
+    int ret;
+
+    if ((ret = claim_pins(context)) < 0) {
+        return ret;
+    }
+
+    ret = write_i2c(device_addr, reg_addr, data, bytes);
+
+    release_pins();
+
+    return ret;
+}
+
+static int pi_i2c_scan(void *context, int *address_book) {
+    int ret;
+
+    if ((ret = claim_pins(context)) < 0) {
+        return ret;
+    }
+
+    ret = scan_bus_i2c(address_book);
+
+    release_pins();
+
+    return ret;
+}
+
+static int pi_i2c_power_cycle(void *context) {
+    // Toggle GPIO off and on to reboot device:
+    gpio_clear(DEVICE_POWER_GPIO);
+    sleep(1);
+    gpio_set(DEVICE_POWER_GPIO);
+
+    return 0;
+}
+
+static void setup_microsleep(void) {
+    microsleep_ret = setup_microsleep_hard();
+}
+
+static int pi_i2c_delay(void *context, int usec) {
+    // Map the system timer the first time round:
+    pthread_once(&microsleep_once, setup_microsleep);
+
+    if (microsleep_ret < 0) {
+        return microsleep_ret;
+    }
+
+    return microsleep_hard(usec);
+}
+
+// Open drain: drive low, or let the pull-up take the line high:
+static void release_line(int gpio) {
+    gpio_set_mode(gpio, GPIO_INPUT);
+}
+
+static void pull_line_low(int gpio) {
+    gpio_clear(gpio);
+    gpio_set_mode(gpio, GPIO_OUTPUT);
+}
+
+static int pi_i2c_bus_clear(void *context) {
+    struct pi_i2c_config *config = context;
+
+    int sda_pin = config ? config->sda_pin : I2C_SDA_GPIO;
+    int scl_pin = config ? config->scl_pin : I2C_SCL_GPIO;
+    int ret = 0;
+
+    int i;
+
+    pthread_mutex_lock(&pi_i2c_lock);
+
+    release_line(sda_pin);
+
+    // A device stuck mid-byte lets go of SDA once it has clocked the rest
+    // of the byte out (UM10204 section 3.1.16):
+    for (i = 0; (i < BUS_CLEAR_PULSES) && !gpio_read_level(sda_pin); i++) {
+        pull_line_low(scl_pin);
+        pi_i2c_delay(context, BUS_CLEAR_HALF_US);
+        release_line(scl_pin);
+        pi_i2c_delay(context, BUS_CLEAR_HALF_US);
+    }
+
+    // STOP condition (SDA rising while SCL is high) resets every device's
+    // bus interface:
+    pull_line_low(scl_pin);
+    pull_line_low(sda_pin);
+    pi_i2c_delay(context, BUS_CLEAR_HALF_US);
+    release_line(scl_pin);
+    pi_i2c_delay(context, BUS_CLEAR_HALF_US);
+    release_line(sda_pin);
+    pi_i2c_delay(context, BUS_CLEAR_HALF_US);
+
+    if (!gpio_read_level(sda_pin)) {
+        ret = -EBUSLOCKUP;
+    }
+
+    pthread_mutex_unlock(&pi_i2c_lock);
+
+    return ret;
+}
+
+const struct pca9685_bus pi_i2c_bus = {
+    .read = pi_i2c_read,
+    .write = pi_i2c_write,
+    .scan = pi_i2c_scan,
+    .power_cycle = pi_i2c_power_cycle,
+    .bus_clear = pi_i2c_bus_clear,
+    .delay = pi_i2c_delay,
+    .context = NULL,
+};
+
+void init_pi_i2c_bus(struct pca9685_bus *bus, struct pi_i2c_config *config) {
+    *bus = pi_i2c_bus;
+    bus->context = config;
+}
@@ -0,0 +1,401 @@
+// Raspberry Pi PCA9685 Example
+//
+// Copyright (c) 2022 Benjamin Spencer
+// ============================================================================
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+// ============================================================================
+
+// Include C standard libraries:
+#include <stdio.h>  // C Standard I/O libary
+#include <stdint.h> // C Standard integer types
+#include <string.h> // C Standard string manipulation
+
+#include "pca9685_registers.h" // PCA9685 register definitions
+#include "pca9685_log.h"       // PCA9685 driver logging
+#include "pca9685_bus.h"       // PCA9685 bus backend
+#include "pca9685_cache.h"     // PCA9685 shadow register cache
+
+// MODE1 bits (page 14):
+#define MODE1_AI_BIT (0x01 << 5)
+#define MODE1_SLEEP_BIT (0x01 << 4)
+#define MODE1_RESTART_BIT (0x01 << 7)
+
+struct register_cache {
+    uint8_t reg[NUM_REGISTERS]; // Last known value of every register
+    int valid;                  // Cache matches the device
+    int loaded;                 // Cache was filled from the device once
+};
+
+// One cache per device id so lookups are just an index:
+static struct register_cache caches[NUM_DEVICE_IDS];
+
+static int check_range(int device_addr, int reg_addr, int bytes) {
+    if ((device_addr < 0) || (device_addr >= NUM_DEVICE_IDS)) {
+        return -1;
+    }
+
+    if ((reg_addr < 0) || (bytes < 1) || (reg_addr + bytes > NUM_REGISTERS)) {
+        return -1;
+    }
+
+    return 0;
+}
+
+// Fill in the power-on reset values from the data sheet (page 10 to 13):
+static void load_register_defaults(struct register_cache *cache) {
+    int led_reg;
+
+    memset(cache->reg, 0x00, sizeof(cache->reg));
+
+    cache->reg[MODE1] = MODE1_DEFAULT;
+    cache->reg[MODE2] = MODE2_DEFAULT;
+    cache->reg[SUBADR1] = SUBADR1_DEFAULT;
+    cache->reg[SUBADR2] = SUBADR2_DEFAULT;
+    cache->reg[SUBADR3] = SUBADR3_DEFAULT;
+    cache->reg[ALLCALLADR] = ALLCALLADR_DEFAULT;
+
+    for (led_reg = LED0_ON_L; led_reg <= LED15_OFF_H; led_reg += 4) {
+        cache->reg[led_reg] = LEDN_ON_L_DEFAULT;
+        cache->reg[led_reg + 1] = LEDN_ON_H_DEFAULT;
+        cache->reg[led_reg + 2] = LEDN_OFF_L_DEFAULT;
+        cache->reg[led_reg + 3] = LEDN_OFF_H_DEFAULT;
+    }
+
+    cache->reg[ALL_LED_ON_L] = ALL_LED_ON_L_DEFAULT;
+    cache->reg[ALL_LED_ON_H] = ALL_LED_ON_H_DEFAULT;
+    cache->reg[ALL_LED_OFF_L] = ALL_LED_OFF_L_DEFAULT;
+    cache->reg[ALL_LED_OFF_H] = ALL_LED_OFF_H_DEFAULT;
+    cache->reg[PRE_SCALE] = PRE_SCALE_DEFAULT;
+}
+
+// Record written values; ALL_LED writes land in every LEDn register too:
+static void store_registers(struct register_cache *cache, int reg_addr,
+                            int *data, int bytes) {
+    int i;
+    int led_reg;
+
+    for (i = 0; i < bytes; i++) {
+        cache->reg[reg_addr + i] = (uint8_t) data[i];
+
+        if ((reg_addr + i >= ALL_LED_ON_L) && (reg_addr + i <= ALL_LED_OFF_H)) {
+            for (led_reg = LED0_ON_L; led_reg <= LED15_OFF_H; led_reg += 4) {
+                cache->reg[led_reg + (reg_addr + i - ALL_LED_ON_L)] =
+                    (uint8_t) data[i];
+            }
+        }
+    }
+}
+
+int init_register_cache(int device_addr) {
+    struct register_cache *cache;
+
+    int reg_values[LED15_OFF_H + 1];
+    int prescale_value[1] = {0};
+
+    int i;
+    int ret;
+
+    if (check_range(device_addr, MODE1, 1) < 0) {
+        return -1;
+    }
+
+    cache = &caches[device_addr];
+    cache->valid = 0;
+
+    load_register_defaults(cache);
+
+    // One burst covers MODE1 through LED15_OFF_H:
+    if ((ret = bus_read(device_addr, MODE1, reg_values, LED15_OFF_H + 1)) < 0) {
+        return ret;
+    }
+
+    // Without auto-increment every byte after the first is MODE1 again, so
+    // keep the defaults for the rest of the register file:
+    if (reg_values[0] & MODE1_AI_BIT) {
+        for (i = 0; i <= LED15_OFF_H; i++) {
+            cache->reg[i] = (uint8_t) reg_values[i];
+        }
+    } else {
+        cache->reg[MODE1] = (uint8_t) reg_values[0];
+    }
+
+    // PRE_SCALE sits at the far end of the register file:
+    if ((ret = bus_read(device_addr, PRE_SCALE, prescale_value, 1)) < 0) {
+        return ret;
+    }
+
+    cache->reg[PRE_SCALE] = (uint8_t) prescale_value[0];
+    cache->valid = 1;
+    cache->loaded = 1;
+
+    PCA9685_LOG("Register cache loaded for device 0x%X\n", device_addr);
+
+    return 0;
+}
+
+int read_register_cache(int device_addr, int reg_addr, int *data, int bytes) {
+    struct register_cache *cache;
+
+    int i;
+    int ret;
+
+    if (check_range(device_addr, reg_addr, bytes) < 0) {
+        return -1;
+    }
+
+    cache = &caches[device_addr];
+
+    if (!cache->valid) {
+        if ((ret = init_register_cache(device_addr)) < 0) {
+            return ret;
+        }
+    }
+
+    for (i = 0; i < bytes; i++) {
+        data[i] = cache->reg[reg_addr + i];
+    }
+
+    return 0;
+}
+
+int write_register_cache(int device_addr, int reg_addr, int *data, int bytes) {
+    struct register_cache *cache;
+
+    int first = -1;
+    int last = -1;
+
+    int i;
+    int ret;
+
+    if (check_range(device_addr, reg_addr, bytes) < 0) {
+        return -1;
+    }
+
+    // Writing to the test mode register can leave the device unusable:
+    if (reg_addr + bytes > TestMode) {
+        return -1;
+    }
+
+    cache = &caches[device_addr];
+
+    // Unknown device state; write everything through:
+    if (!cache->valid) {
+        if ((ret = bus_write(device_addr, reg_addr, data, bytes)) < 0) {
+            return ret;
+        }
+
+        store_registers(cache, reg_addr, data, bytes);
+
+        return 0;
+    }
+
+    // Find the span of bytes that differ from the device:
+    for (i = 0; i < bytes; i++) {
+        if (cache->reg[reg_addr + i] != (uint8_t) data[i]) {
+            if (first < 0) {
+                first = i;
+            }
+
+            last = i;
+        }
+    }
+
+    // Nothing changed so nothing to send:
+    if (first < 0) {
+        return 0;
+    }
+
+    if ((first == last) || (cache->reg[MODE1] & MODE1_AI_BIT)) {
+        // Single transaction for the changed span:
+        if ((ret = bus_write(device_addr, reg_addr + first, &data[first],
+             last - first + 1)) < 0) {
+            return ret;
+        }
+    } else {
+        // No auto-increment so each changed byte goes on its own:
+        for (i = first; i <= last; i++) {
+            if (cache->reg[reg_addr + i] == (uint8_t) data[i]) {
+                continue;
+            }
+
+            if ((ret = bus_write(device_addr, reg_addr + i, &data[i], 1)) < 0) {
+                return ret;
+            }
+        }
+    }
+
+    store_registers(cache, reg_addr + first, &data[first], last - first + 1);
+
+    return 0;
+}
+
+int update_register_cache(int device_addr, int reg_addr, int *data,
+                          int bytes) {
+    if (check_range(device_addr, reg_addr, bytes) < 0) {
+        return -1;
+    }
+
+    store_registers(&caches[device_addr], reg_addr, data, bytes);
+
+    return 0;
+}
+
+int assume_register_cache(int device_addr, int reg_addr, int *data,
+                          int bytes) {
+    struct register_cache *cache;
+
+    if (check_range(device_addr, reg_addr, bytes) < 0) {
+        return -1;
+    }
+
+    cache = &caches[device_addr];
+
+    load_register_defaults(cache);
+    store_registers(cache, reg_addr, data, bytes);
+
+    cache->valid = 1;
+    cache->loaded = 1;
+
+    return 0;
+}
+
+int is_register_cache_loaded(int device_addr) {
+    if (check_range(device_addr, MODE1, 1) < 0) {
+        return 0;
+    }
+
+    return caches[device_addr].loaded;
+}
+
+int invalidate_register_cache(int device_addr) {
+    int i;
+
+    if (device_addr == ALL_DEVICES) {
+        for (i = 0; i < NUM_DEVICE_IDS; i++) {
+            caches[i].valid = 0;
+        }
+
+        return 0;
+    }
+
+    if (check_range(device_addr, MODE1, 1) < 0) {
+        return -1;
+    }
+
+    caches[device_addr].valid = 0;
+
+    return 0;
+}
+
+int resync_register_cache(int device_addr) {
+    return init_register_cache(device_addr);
+}
+
+static int restore_device(int device_addr) {
+    struct register_cache *cache = &caches[device_addr];
+
+    int reg_values[LED15_OFF_H + 1];
+    int mode1;
+
+    int i;
+    int ret;
+
+    if (!cache->loaded) {
+        return -1;
+    }
+
+    mode1 = cache->reg[MODE1] & ~MODE1_RESTART_BIT;
+
+    // Hold the outputs off with auto-increment on while the rest goes back
+    // (EXTCLK can be set here too as the device is already asleep):
+    reg_values[0] = mode1 | MODE1_SLEEP_BIT | MODE1_AI_BIT;
+
+    if ((ret = bus_write(device_addr, MODE1, reg_values, 1)) < 0) {
+        return ret;
+    }
+
+    for (i = MODE2; i <= LED15_OFF_H; i++) {
+        reg_values[i] = cache->reg[i];
+    }
+
+    if ((ret = bus_write(device_addr, MODE2, &reg_values[MODE2],
+         LED15_OFF_H - MODE2 + 1)) < 0) {
+        return ret;
+    }
+
+    reg_values[0] = cache->reg[PRE_SCALE];
+
+    if ((ret = bus_write(device_addr, PRE_SCALE, reg_values, 1)) < 0) {
+        return ret;
+    }
+
+    reg_values[0] = mode1;
+
+    if ((ret = bus_write(device_addr, MODE1, reg_values, 1)) < 0) {
+        return ret;
+    }
+
+    cache->reg[MODE1] = (uint8_t) mode1;
+    cache->valid = 1;
+
+    PCA9685_LOG("Registers restored on device 0x%X\n", device_addr);
+
+    return 0;
+}
+
+int restore_register_cache(int device_addr) {
+    int ret = 0;
+
+    int i;
+
+    if (device_addr != ALL_DEVICES) {
+        if (check_range(device_addr, MODE1, 1) < 0) {
+            return -1;
+        }
+
+        return restore_device(device_addr);
+    }
+
+    // Keep going past a device that fails so the others come back:
+    for (i = 0; i < NUM_DEVICE_IDS; i++) {
+        if (caches[i].loaded) {
+            ret = (restore_device(i) < 0) ? -1 : ret;
+        }
+    }
+
+    return ret;
+}
+
+int restore_bus_registers(int bus_id) {
+    int ret = 0;
+
+    int i;
+
+    if ((bus_id < 0) || (bus_id >= MAX_BUSES)) {
+        return -1;
+    }
+
+    for (i = DEVICE_ID(bus_id, 0); i < DEVICE_ID(bus_id + 1, 0); i++) {
+        if (caches[i].loaded) {
+            ret = (restore_device(i) < 0) ? -1 : ret;
+        }
+    }
+
+    return ret;
+}
@@ -0,0 +1,232 @@
+// Raspberry Pi PCA9685 Example
+//
+// Copyright (c) 2022 Benjamin Spencer
+// ============================================================================
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+// ============================================================================
+
+// Include C standard libraries:
+#include <stdio.h>  // C Standard I/O libary
+#include <stdint.h> // C Standard integer types
+
+#include <pi_i2c.h> // Pi I2C library! (speed grades)
+
+#include "pca9685_registers.h" // PCA9685 register definitions
+#include "pca9685_cache.h"     // PCA9685 shadow register cache
+#include "pca9685_pwm.h"       // PCA9685 PWM output helpers
+#include "pca9685_phase.h"     // PCA9685 phase scheduler
+#include "pca9685_metrics.h"   // PCA9685 bus metrics (clock)
+#include "pca9685_coalesce.h"  // PCA9685 write coalescing
+
+// Bit times: 8 data bits and an ACK per byte; a transaction adds the
+// address and register bytes plus start and stop conditions:
+#define BYTE_BITS 9
+#define TRANSACTION_BITS (2 * BYTE_BITS + 2)
+
+// Turn on auto-increment so a run can go in one burst:
+static int enable_auto_increment(int device_addr) {
+    const int setting = AI;
+
+    int reg_value[1] = {0};
+
+    int ret;
+
+    if ((ret = read_register_cache(device_addr, MODE1, reg_value, 1)) < 0) {
+        return ret;
+    }
+
+    reg_value[0] = (reg_value[0] & ~(0x01 << (setting >> 8)))
+                    | ((setting & 0x01) << (setting >> 8));
+
+    return write_register_cache(device_addr, MODE1, reg_value, 1);
+}
+
+void bus_cost_for_speed(struct bus_cost_model *cost, int speed_hz) {
+    cost->byte_ns = (int) ((int64_t) BYTE_BITS * 1000000000 / speed_hz);
+    cost->transaction_ns = (int) ((int64_t) TRANSACTION_BITS * 1000000000
+                                  / speed_hz);
+}
+
+int init_coalesce(struct pca9685_coalesce *coalesce, int device_addr,
+                  int window_us) {
+    int ret;
+
+    if (window_us < 0) {
+        return -1;
+    }
+
+    if ((ret = enable_auto_increment(device_addr)) < 0) {
+        return ret;
+    }
+
+    coalesce->device_addr = device_addr;
+    coalesce->window_ns = (uint64_t) window_us * 1000;
+    coalesce->pending = 0;
+    coalesce->opened_ns = 0;
+
+    bus_cost_for_speed(&coalesce->cost, I2C_FULL_SPEED);
+
+    coalesce->stats = (struct coalesce_stats) {0};
+
+    return 0;
+}
+
+int coalesce_write(struct pca9685_coalesce *coalesce, int reg_addr,
+                   int *data, int bytes) {
+    int current[LED_REG_BYTES];
+
+    int first_led;
+    int last_led;
+    int offset = reg_addr - LED0_ON_L;
+
+    int led_id;
+    int i;
+    int ret;
+
+    if ((offset < 0) || (bytes < 1) || (offset + bytes > LED_BANK_BYTES)) {
+        return -1;
+    }
+
+    if (!coalesce->pending) {
+        coalesce->opened_ns = metrics_now();
+    }
+
+    for (i = 0; i < bytes; i++) {
+        coalesce->led_bank[offset + i] = data[i];
+    }
+
+    first_led = offset / LED_REG_BYTES;
+    last_led = (offset + bytes - 1) / LED_REG_BYTES;
+
+    for (led_id = first_led; led_id <= last_led; led_id++) {
+        coalesce->stats.requests++;
+
+        if (coalesce->pending & (1 << led_id)) {
+            coalesce->stats.merged++;
+        } else {
+            // Start from the transmitted value for the bytes not given:
+            if ((ret = read_register_cache(coalesce->device_addr,
+                 LED_REG(led_id), current, LED_REG_BYTES)) < 0) {
+                return ret;
+            }
+
+            for (i = 0; i < LED_REG_BYTES; i++) {
+                if ((led_id * LED_REG_BYTES + i < offset)
+                    || (led_id * LED_REG_BYTES + i >= offset + bytes)) {
+                    coalesce->led_bank[led_id * LED_REG_BYTES + i] =
+                        current[i];
+                }
+            }
+        }
+
+        coalesce->pending |= 1 << led_id;
+    }
+
+    if (coalesce->window_ns == 0) {
+        return flush_coalesce(coalesce);
+    }
+
+    return poll_coalesce(coalesce);
+}
+
+int coalesce_duty_cycle(struct pca9685_coalesce *coalesce, int led_id,
+                        int duty_cycle) {
+    int led_register_values[LED_REG_BYTES];
+
+    int led_delay_time;
+
+    if ((led_delay_time = get_channel_phase(coalesce->device_addr,
+         led_id)) < 0) {
+        return -1;
+    }
+
+    encode_pwm_registers(duty_cycle, led_delay_time, led_register_values);
+
+    return coalesce_write(coalesce, LED_REG(led_id), led_register_values,
+                          LED_REG_BYTES);
+}
+
+int poll_coalesce(struct pca9685_coalesce *coalesce) {
+    if (!coalesce->pending
+        || (metrics_now() - coalesce->opened_ns < coalesce->window_ns)) {
+        return 0;
+    }
+
+    return flush_coalesce(coalesce);
+}
+
+// Longest run of unchanged bytes that is cheaper to resend than opening
+// another transaction:
+static int merge_gap(const struct bus_cost_model *cost) {
+    if (cost->byte_ns <= 0) {
+        return LED_BANK_BYTES;
+    }
+
+    return (cost->transaction_ns - 1) / cost->byte_ns;
+}
+
+int flush_coalesce(struct pca9685_coalesce *coalesce) {
+    int current_bank[LED_BANK_BYTES];
+    int dirty[LED_BANK_BYTES];
+
+    int bytes_sent = 0;
+    int changed;
+
+    int led_id;
+    int i;
+    int ret;
+
+    if (!coalesce->pending) {
+        return 0;
+    }
+
+    if ((ret = read_register_cache(coalesce->device_addr, LED0_ON_L,
+         current_bank, LED_BANK_BYTES)) < 0) {
+        return ret;
+    }
+
+    // Byte level diff against what was last transmitted:
+    for (led_id = 0; led_id < NUM_LED_CHANNELS; led_id++) {
+        changed = 0;
+
+        for (i = led_id * LED_REG_BYTES; i < (led_id + 1) * LED_REG_BYTES;
+             i++) {
+            dirty[i] = (coalesce->pending & (1 << led_id))
+                       && (coalesce->led_bank[i] != current_bank[i]);
+            changed |= dirty[i];
+        }
+
+        if ((coalesce->pending & (1 << led_id)) && !changed) {
+            coalesce->stats.suppressed++;
+        }
+    }
+
+    coalesce->pending = 0;
+    coalesce->stats.flushes++;
+
+    if ((ret = write_led_runs(coalesce->device_addr, coalesce->led_bank,
+         dirty, merge_gap(&coalesce->cost), &bytes_sent)) < 0) {
+        return ret;
+    }
+
+    coalesce->stats.transactions += ret;
+    coalesce->stats.bytes += bytes_sent;
+
+    return 0;
+}
@@ -0,0 +1,598 @@
+// Raspberry Pi PCA9685 Example
+//
+// Copyright (c) 2022 Benjamin Spencer
+// ============================================================================
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+// ============================================================================
+
+// Include C standard libraries:
+#include <stdio.h>  // C Standard I/O libary
+#include <stdlib.h> // C Standard library
+#include <stdint.h> // C Standard integer types
+#include <string.h> // C Standard string manipulation
+#include <ctype.h>  // C Standard character classes
+
+#include "pca9685_registers.h" // PCA9685 register definitions
+#include "pca9685_log.h"       // PCA9685 driver logging
+#include "pca9685_bus.h"       // PCA9685 bus backend
+#include "pca9685_cache.h"     // PCA9685 shadow register cache
+#include "pca9685_encode.h"    // PCA9685 duty cycle encoder
+#include "pca9685_pwm.h"       // PCA9685 PWM output helpers
+#include "pca9685_phase.h"     // PCA9685 phase scheduler
+#include "pca9685_freq.h"      // PCA9685 frequency planner
+#include "pca9685.h"           // PCA9685 driver
+#include "pca9685_config.h"    // PCA9685 configuration file
+
+// MODE1 bits (page 14):
+#define MODE1_AI_BIT (0x01 << 5)
+#define MODE1_SLEEP_BIT (0x01 << 4)
+#define MODE1_EXTCLK_BIT (0x01 << 6)
+#define MODE1_RESTART_BIT (0x01 << 7)
+
+#define CONFIG_LINE_LENGTH 256
+
+// Output states while OE is high:
+#define OUTNE_STATE_LOW 0
+#define OUTNE_STATE_HIGH 1
+#define OUTNE_STATE_HIGH_Z 2
+
+// Explicit ON delay alongside the PHASE_FIXED and PHASE_ROUND_ROBIN
+// strategies:
+#define PHASE_DELAY -1
+
+#define UNSET -1
+
+// Settings of a section as parsed:
+struct board_settings {
+    int line; // Where the section starts
+    int bus_id;
+    int device_addr; // 7-bit address
+    int frequency;
+    int clock_hz;
+    int invert;
+    int open_drain;
+    int outne;
+    int allcall;
+    int phase_strategy;
+    int led_delay_time; // With PHASE_DELAY
+    int duty_cycle;
+    int led_duty_cycles[NUM_LED_CHANNELS];   // UNSET = duty_cycle
+    int led_delay_times[NUM_LED_CHANNELS];   // UNSET = phase_strategy
+};
+
+// Power-on state with the outputs off:
+static const struct board_settings safe_defaults = {
+    .line = 0,
+    .bus_id = 0,
+    .device_addr = UNSET,
+    .frequency = 200,
+    .clock_hz = 0,
+    .invert = 0,
+    .open_drain = 0,
+    .outne = OUTNE_STATE_LOW,
+    .allcall = 1,
+    .phase_strategy = PHASE_FIXED,
+    .led_delay_time = 0,
+    .duty_cycle = 0,
+    .led_duty_cycles = {UNSET, UNSET, UNSET, UNSET, UNSET, UNSET, UNSET,
+                        UNSET, UNSET, UNSET, UNSET, UNSET, UNSET, UNSET,
+                        UNSET, UNSET},
+    .led_delay_times = {UNSET, UNSET, UNSET, UNSET, UNSET, UNSET, UNSET,
+                        UNSET, UNSET, UNSET, UNSET, UNSET, UNSET, UNSET,
+                        UNSET, UNSET},
+};
+
+static int apply_setting(int value, int setting) {
+    return (value & ~(0x01 << (setting >> 8)))
+           | ((setting & 0x01) << (setting >> 8));
+}
+
+// Strip a comment and surrounding white space in place:
+static char *trim(char *text) {
+    char *end;
+
+    text[strcspn(text, "#;")] = '\0';
+
+    while (isspace((unsigned char) *text)) {
+        text++;
+    }
+
+    end = text + strlen(text);
+
+    while ((end > text) && isspace((unsigned char) end[-1])) {
+        end--;
+    }
+
+    *end = '\0';
+
+    return text;
+}
+
+// Decimal or 0x hex, nothing else on the line:
+static int parse_number(const char *value, int min, int max, int *number) {
+    char *end;
+    long parsed;
+
+    parsed = strtol(value, &end, 0);
+
+    if ((end == value) || (*end != '\0') || (parsed < min)
+        || (parsed > max)) {
+        return -1;
+    }
+
+    *number = (int) parsed;
+
+    return 0;
+}
+
+static int parse_yes_no(const char *value, int *flag) {
+    if (!strcmp(value, "yes")) {
+        *flag = 1;
+    } else if (!strcmp(value, "no")) {
+        *flag = 0;
+    } else {
+        return -1;
+    }
+
+    return 0;
+}
+
+static int parse_setting(struct board_settings *settings, const char *key,
+                         const char *value) {
+    char field[16];
+    int led_id;
+
+    if (!strcmp(key, "bus")) {
+        return parse_number(value, 0, MAX_BUSES - 1, &settings->bus_id);
+    }
+
+    if (!strcmp(key, "frequency")) {
+        return parse_number(value, 1, INT_CLOCK_HZ, &settings->frequency);
+    }
+
+    if (!strcmp(key, "clock")) {
+        if (!strcmp(value, "internal")) {
+            settings->clock_hz = 0;
+            return 0;
+        }
+
+        return parse_number(value, 1, EXT_CLOCK_MAX_HZ, &settings->clock_hz);
+    }
+
+    if (!strcmp(key, "invert")) {
+        return parse_yes_no(value, &settings->invert);
+    }
+
+    if (!strcmp(key, "allcall")) {
+        return parse_yes_no(value, &settings->allcall);
+    }
+
+    if (!strcmp(key, "output")) {
+        if (!strcmp(value, "totem_pole")) {
+            settings->open_drain = 0;
+        } else if (!strcmp(value, "open_drain")) {
+            settings->open_drain = 1;
+        } else {
+            return -1;
+        }
+
+        return 0;
+    }
+
+    if (!strcmp(key, "output_disabled")) {
+        if (!strcmp(value, "low")) {
+            settings->outne = OUTNE_STATE_LOW;
+        } else if (!strcmp(value, "high")) {
+            settings->outne = OUTNE_STATE_HIGH;
+        } else if (!strcmp(value, "high_z")) {
+            settings->outne = OUTNE_STATE_HIGH_Z;
+        } else {
+            return -1;
+        }
+
+        return 0;
+    }
+
+    if (!strcmp(key, "phase")) {
+        if (!strcmp(value, "fixed")) {
+            settings->phase_strategy = PHASE_FIXED;
+            return 0;
+        }
+
+        if (!strcmp(value, "round_robin")) {
+            settings->phase_strategy = PHASE_ROUND_ROBIN;
+            return 0;
+        }
+
+        settings->phase_strategy = PHASE_DELAY;
+
+        return parse_number(value, 0, PWM_COUNTS - 1,
+                            &settings->led_delay_time);
+    }
+
+    if (!strcmp(key, "duty")) {
+        return parse_number(value, 0, PWM_FULL_SCALE,
+                            &settings->duty_cycle);
+    }
+
+    // Per channel: ledN.duty and ledN.phase
+    if ((sscanf(key, "led%d.%15s", &led_id, field) != 2) || (led_id < 0)
+        || (led_id >= NUM_LED_CHANNELS)) {
+        return -1;
+    }
+
+    if (!strcmp(field, "duty")) {
+        return parse_number(value, 0, PWM_FULL_SCALE,
+                            &settings->led_duty_cycles[led_id]);
+    }
+
+    if (!strcmp(field, "phase")) {
+        return parse_number(value, 0, PWM_COUNTS - 1,
+                            &settings->led_delay_times[led_id]);
+    }
+
+    return -1;
+}
+
+// Output frequencies the board's clock can reach, with PRE_SCALE rounded
+// as on page 25:
+static int check_frequency(struct board_settings *settings) {
+    int64_t clock_hz = settings->clock_hz ? settings->clock_hz : INT_CLOCK_HZ;
+    int64_t counts = (int64_t) settings->frequency * PWM_COUNTS;
+    int64_t prescale = (clock_hz + counts / 2) / counts - 1;
+
+    if ((prescale < PRESCALE_MIN) || (prescale > PRESCALE_MAX)) {
+        return -1;
+    }
+
+    return 0;
+}
+
+// Checks across boards:
+static int check_boards(struct board_settings *settings, int num_boards) {
+    int allcall_addr = ALLCALLADR_DEFAULT >> 1;
+
+    int i;
+    int j;
+
+    for (i = 0; i < num_boards; i++) {
+        if (check_frequency(&settings[i]) < 0) {
+            PCA9685_LOG("Config line %d: %d Hz out of range for the clock\n",
+                        settings[i].line, settings[i].frequency);
+            return -1;
+        }
+
+        for (j = 0; j < num_boards; j++) {
+            if ((j == i) || (settings[j].bus_id != settings[i].bus_id)) {
+                continue;
+            }
+
+            if ((j < i) && (settings[j].device_addr
+                            == settings[i].device_addr)) {
+                PCA9685_LOG("Config line %d: board 0x%X on bus %d given "
+                            "twice\n", settings[i].line,
+                            settings[i].device_addr, settings[i].bus_id);
+                return -1;
+            }
+
+            // Another board answering ALLCALL would take these writes too:
+            if ((settings[i].device_addr == allcall_addr)
+                && settings[j].allcall) {
+                PCA9685_LOG("Config line %d: 0x%X is the ALLCALL address "
+                            "of the other boards on bus %d\n",
+                            settings[i].line, settings[i].device_addr,
+                            settings[i].bus_id);
+                return -1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+static int channel_delay_time(struct board_settings *settings, int led_id) {
+    if (settings->led_delay_times[led_id] != UNSET) {
+        return settings->led_delay_times[led_id];
+    }
+
+    switch (settings->phase_strategy) {
+        case PHASE_ROUND_ROBIN:
+            return led_id * (PWM_COUNTS / NUM_LED_CHANNELS);
+        case PHASE_DELAY:
+            return settings->led_delay_time;
+        default:
+            return PWM_DEFAULT_DELAY;
+    }
+}
+
+static int compile_board(struct board_settings *settings,
+                         struct config_board *board) {
+    struct freq_plan plan;
+
+    int *reg_values = board->reg_values;
+    int duty_cycle;
+    int led_id;
+    int ret;
+
+    board->device_addr = DEVICE_ID(settings->bus_id, settings->device_addr);
+    board->frequency = settings->frequency;
+    board->clock_hz = settings->clock_hz;
+
+    reg_values[MODE1] = MODE1_DEFAULT;
+    reg_values[MODE1] = apply_setting(reg_values[MODE1], NORMAL_MODE);
+    reg_values[MODE1] = apply_setting(reg_values[MODE1], AI);
+    reg_values[MODE1] = apply_setting(reg_values[MODE1], NO_SUB1);
+    reg_values[MODE1] = apply_setting(reg_values[MODE1], NO_SUB2);
+    reg_values[MODE1] = apply_setting(reg_values[MODE1], NO_SUB3);
+    reg_values[MODE1] = apply_setting(reg_values[MODE1],
+                                      settings->allcall ? ALLCALL
+                                                        : NO_ALLCALL);
+    reg_values[MODE1] = apply_setting(reg_values[MODE1],
+                                      settings->clock_hz ? EXT_CLOCK
+                                                         : INT_CLOCK);
+
+    reg_values[MODE2] = MODE2_DEFAULT;
+    reg_values[MODE2] = apply_setting(reg_values[MODE2], OCH_STOP);
+    reg_values[MODE2] = apply_setting(reg_values[MODE2],
+                                      settings->invert ? INVRT : NO_INVRT);
+    reg_values[MODE2] = apply_setting(reg_values[MODE2],
+                                      settings->open_drain ? OPEN_DRAIN
+                                                           : TOTEM_POLE);
+    reg_values[MODE2] = apply_setting(reg_values[MODE2],
+                                      (settings->outne == OUTNE_STATE_HIGH)
+                                      ? OUTNE_HIGH : OUTNE_LOW);
+    reg_values[MODE2] = apply_setting(reg_values[MODE2],
+                                      (settings->outne == OUTNE_STATE_HIGH_Z)
+                                      ? OUTNE_HIGH_Z : OUTNE_DRIVEN);
+
+    reg_values[SUBADR1] = SUBADR1_DEFAULT;
+    reg_values[SUBADR2] = SUBADR2_DEFAULT;
+    reg_values[SUBADR3] = SUBADR3_DEFAULT;
+    reg_values[ALLCALLADR] = ALLCALLADR_DEFAULT;
+
+    for (led_id = 0; led_id < NUM_LED_CHANNELS; led_id++) {
+        duty_cycle = settings->led_duty_cycles[led_id];
+
+        if (duty_cycle == UNSET) {
+            duty_cycle = settings->duty_cycle;
+        }
+
+        board->led_delay_times[led_id] = channel_delay_time(settings, led_id);
+
+        encode_pwm_registers(duty_cycle, board->led_delay_times[led_id],
+                             &reg_values[LED_REG(led_id)]);
+    }
+
+    if ((ret = plan_frequency(settings->clock_hz ? settings->clock_hz
+                                                 : INT_CLOCK_HZ,
+         settings->frequency, &plan)) < 0) {
+        PCA9685_LOG("Config line %d: no prescale for %d Hz\n",
+                    settings->line, settings->frequency);
+        return ret;
+    }
+
+    board->prescale = plan.prescale;
+
+    return 0;
+}
+
+int read_config(FILE *file, struct pca9685_config *config) {
+    struct board_settings settings[MAX_BOARDS];
+
+    struct board_settings defaults = safe_defaults;
+    struct board_settings *section = NULL;
+
+    char buffer[CONFIG_LINE_LENGTH];
+    char *line;
+    char *value;
+
+    int num_boards = 0;
+    int line_number = 0;
+    int device_addr;
+    int i;
+
+    while (fgets(buffer, sizeof(buffer), file) != NULL) {
+        line_number++;
+
+        line = trim(buffer);
+
+        if (*line == '\0') {
+            continue;
+        }
+
+        if (!strcmp(line, "[defaults]")) {
+            // Boards take the defaults in force when their section opens:
+            if (num_boards > 0) {
+                PCA9685_LOG("Config line %d: [defaults] after a board\n",
+                            line_number);
+                return -1;
+            }
+
+            section = &defaults;
+            continue;
+        }
+
+        if (!strncmp(line, "[board", 6) && (line[strlen(line) - 1] == ']')) {
+            line[strlen(line) - 1] = '\0';
+
+            if (parse_number(trim(line + 6), 0x01, NUM_DEVICE_ADDR - 1,
+                             &device_addr) < 0) {
+                PCA9685_LOG("Config line %d: bad board address\n",
+                            line_number);
+                return -1;
+            }
+
+            if (num_boards == MAX_BOARDS) {
+                PCA9685_LOG("Config line %d: more than %d boards\n",
+                            line_number, MAX_BOARDS);
+                return -1;
+            }
+
+            section = &settings[num_boards++];
+
+            *section = defaults;
+            section->line = line_number;
+            section->device_addr = device_addr;
+            continue;
+        }
+
+        if ((value = strchr(line, '=')) == NULL) {
+            PCA9685_LOG("Config line %d: expected key = value\n",
+                        line_number);
+            return -1;
+        }
+
+        *value++ = '\0';
+
+        if (section == NULL) {
+            PCA9685_LOG("Config line %d: setting outside a section\n",
+                        line_number);
+            return -1;
+        }
+
+        if (parse_setting(section, trim(line), trim(value)) < 0) {
+            PCA9685_LOG("Config line %d: bad setting %s\n", line_number,
+                        trim(line));
+            return -1;
+        }
+    }
+
+    if (ferror(file) || (check_boards(settings, num_boards) < 0)) {
+        return -1;
+    }
+
+    for (i = 0; i < num_boards; i++) {
+        if (compile_board(&settings[i], &config->boards[i]) < 0) {
+            return -1;
+        }
+    }
+
+    config->num_boards = num_boards;
+
+    return 0;
+}
+
+int load_config(const char *path, struct pca9685_config *config) {
+    FILE *file;
+
+    int ret;
+
+    if ((file = fopen(path, "r")) == NULL) {
+        PCA9685_LOG("Could not open config file %s\n", path);
+        return -1;
+    }
+
+    ret = read_config(file, config);
+
+    fclose(file);
+
+    return ret;
+}
+
+int run_config(struct pca9685_config *config) {
+    struct config_board *board;
+
+    int reg_value[1];
+
+    int bus_mask = 0;
+    int i;
+    int led_id;
+    int ret;
+
+    // Asleep so PRE_SCALE (and EXTCLK) can be written, auto-increment on
+    // for the burst (page 14):
+    for (i = 0; i < config->num_boards; i++) {
+        board = &config->boards[i];
+
+        reg_value[0] = (board->reg_values[MODE1]
+                        & ~(MODE1_EXTCLK_BIT | MODE1_RESTART_BIT))
+                       | MODE1_SLEEP_BIT | MODE1_AI_BIT;
+
+        if ((ret = bus_write(board->device_addr, MODE1, reg_value, 1)) < 0) {
+            return ret;
+        }
+
+        if (board->clock_hz) {
+            reg_value[0] |= MODE1_EXTCLK_BIT;
+
+            if ((ret = bus_write(board->device_addr, MODE1, reg_value,
+                 1)) < 0) {
+                return ret;
+            }
+        }
+
+        if ((ret = bus_write(board->device_addr, PRE_SCALE, &board->prescale,
+             1)) < 0) {
+            return ret;
+        }
+
+        if ((ret = bus_write(board->device_addr, MODE2,
+             &board->reg_values[MODE2], CONFIG_PROGRAM_BYTES - MODE2)) < 0) {
+            return ret;
+        }
+    }
+
+    // Wake every board; RESTART has to wait for the oscillator:
+    for (i = 0; i < config->num_boards; i++) {
+        board = &config->boards[i];
+
+        reg_value[0] = board->reg_values[MODE1] & ~MODE1_RESTART_BIT;
+        bus_mask |= 1 << DEVICE_BUS(board->device_addr);
+
+        if ((ret = bus_write(board->device_addr, MODE1, reg_value, 1)) < 0) {
+            return ret;
+        }
+
+        assume_register_cache(board->device_addr, MODE1, board->reg_values,
+                              CONFIG_PROGRAM_BYTES);
+        update_register_cache(board->device_addr, MODE1, reg_value, 1);
+        update_register_cache(board->device_addr, PRE_SCALE,
+                              &board->prescale, 1);
+
+        for (led_id = 0; led_id < NUM_LED_CHANNELS; led_id++) {
+            set_channel_phase(board->device_addr, led_id,
+                              board->led_delay_times[led_id]);
+        }
+
+        if (board->clock_hz) {
+            set_clock_frequency(board->device_addr, board->clock_hz);
+        }
+    }
+
+    // Every oscillator just started together, so one wait covers the rack
+    // (nothing to wait for without boards):
+    if ((ret = bus_delay_buses(bus_mask, OSCILLATOR_SETTLE_US)) < 0) {
+        return ret;
+    }
+
+    // The device clears RESTART itself, so the cache keeps it clear:
+    for (i = 0; i < config->num_boards; i++) {
+        board = &config->boards[i];
+
+        if ((board->reg_values[MODE1] & MODE1_RESTART_BIT)
+            && ((ret = bus_write(board->device_addr, MODE1,
+                 board->reg_values, 1)) < 0)) {
+            return ret;
+        }
+    }
+
+    PCA9685_LOG("Config program written to %d boards\n", config->num_boards);
+
+    return 0;
+}
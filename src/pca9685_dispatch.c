@@ -0,0 +1,178 @@
+// Raspberry Pi PCA9685 Example
+//
+// Copyright (c) 2022 Benjamin Spencer
+// ============================================================================
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+// ============================================================================
+
+#define _GNU_SOURCE // pthread_setaffinity_np()
+
+// Include C standard libraries:
+#include <stdio.h>   // C Standard I/O libary
+#include <unistd.h>  // POSIX sysconf()
+#include <pthread.h> // POSIX threads
+#include <sched.h>   // CPU sets
+
+#include "pca9685_registers.h" // PCA9685 register definitions
+#include "pca9685_log.h"       // PCA9685 driver logging
+#include "pca9685_bus.h"       // PCA9685 bus backend
+#include "pca9685_queue.h"     // PCA9685 asynchronous command queue
+#include "pca9685_multi.h"     // PCA9685 multi-board manager
+#include "pca9685_phase.h"     // PCA9685 phase scheduler
+#include "pca9685_dispatch.h"  // PCA9685 bus dispatcher
+
+static struct pca9685_queue *route(struct pca9685_dispatch *dispatch,
+                                   int device_id) {
+    int bus_id = DEVICE_BUS(device_id);
+
+    if ((device_id < 0) || (bus_id >= MAX_BUSES)
+        || !dispatch->running[bus_id]) {
+        return NULL;
+    }
+
+    return &dispatch->queues[bus_id];
+}
+
+static void pin_worker(pthread_t worker, int bus_id) {
+    cpu_set_t cpus;
+
+    long num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+    if (num_cpus < 1) {
+        return;
+    }
+
+    CPU_ZERO(&cpus);
+    CPU_SET(bus_id % num_cpus, &cpus);
+
+    // Unpinned is still correct, just less predictable:
+    if (pthread_setaffinity_np(worker, sizeof(cpus), &cpus) != 0) {
+        PCA9685_LOG("Could not pin bus %d worker to CPU %ld\n", bus_id,
+                    bus_id % num_cpus);
+    }
+}
+
+int start_dispatch(struct pca9685_dispatch *dispatch, int pin_workers) {
+    int bus_id;
+
+    for (bus_id = 0; bus_id < MAX_BUSES; bus_id++) {
+        dispatch->running[bus_id] = 0;
+
+        if (get_attached_bus(bus_id) == NULL) {
+            continue;
+        }
+
+        if (start_queue(&dispatch->queues[bus_id]) < 0) {
+            stop_dispatch(dispatch);
+            return -1;
+        }
+
+        dispatch->running[bus_id] = 1;
+
+        if (pin_workers) {
+            pin_worker(dispatch->queues[bus_id].worker, bus_id);
+        }
+    }
+
+    return 0;
+}
+
+int stop_dispatch(struct pca9685_dispatch *dispatch) {
+    int ret = 0;
+
+    int bus_id;
+
+    for (bus_id = 0; bus_id < MAX_BUSES; bus_id++) {
+        if (!dispatch->running[bus_id]) {
+            continue;
+        }
+
+        if (stop_queue(&dispatch->queues[bus_id]) < 0) {
+            ret = -1;
+        }
+
+        dispatch->running[bus_id] = 0;
+    }
+
+    return ret;
+}
+
+int dispatch_write(struct pca9685_dispatch *dispatch, int device_id,
+                   int reg_addr, int *data, int bytes,
+                   queue_callback callback, void *context) {
+    struct pca9685_queue *queue = route(dispatch, device_id);
+
+    if (queue == NULL) {
+        return -1;
+    }
+
+    return queue_write(queue, device_id, reg_addr, data, bytes, callback,
+                       context);
+}
+
+int dispatch_duty_cycle(struct pca9685_dispatch *dispatch, int device_id,
+                        int led_id, int duty_cycle, queue_callback callback,
+                        void *context) {
+    struct pca9685_queue *queue = route(dispatch, device_id);
+
+    if (queue == NULL) {
+        return -1;
+    }
+
+    return queue_duty_cycle(queue, device_id, led_id, duty_cycle, callback,
+                            context);
+}
+
+int dispatch_led_bank(struct pca9685_dispatch *dispatch, int device_id,
+                      int *led_bank, queue_callback callback,
+                      void *context) {
+    struct pca9685_queue *queue = route(dispatch, device_id);
+
+    if (queue == NULL) {
+        return -1;
+    }
+
+    return queue_led_bank(queue, device_id, led_bank, callback, context);
+}
+
+int dispatch_duty_cycles(struct pca9685_dispatch *dispatch,
+                         struct pca9685_multi *multi, int *duty_cycles) {
+    int led_delay_times[NUM_LED_CHANNELS];
+
+    int board;
+    int ret;
+
+    for (board = 0; board < multi->num_boards; board++) {
+        if ((ret = get_channel_phases(multi->board_addr[board],
+             led_delay_times)) < 0) {
+            return ret;
+        }
+
+        encode_pwm_bank(&duty_cycles[board * NUM_LED_CHANNELS],
+                        led_delay_times, multi->led_bank[board]);
+
+        // The worker trims the bank to what changed against the cache:
+        if ((ret = dispatch_led_bank(dispatch, multi->board_addr[board],
+             multi->led_bank[board], NULL, NULL)) < 0) {
+            return ret;
+        }
+    }
+
+    return 0;
+}
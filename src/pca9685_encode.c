@@ -0,0 +1,84 @@
+// Raspberry Pi PCA9685 Example
+//
+// Copyright (c) 2022 Benjamin Spencer
+// ============================================================================
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+// ============================================================================
+
+#include "pca9685_encode.h" // PCA9685 duty cycle encoder
+
+void encode_pwm_update(int duty_cycle, int led_delay_time,
+                       int *led_register_values) {
+    // Full OFF wins over everything else:
+    if (duty_cycle <= 0) {
+        led_register_values[3] |= PWM_FULL_BIT;
+        return;
+    }
+
+    if (duty_cycle >= PWM_FULL_SCALE) {
+        led_register_values[1] |= PWM_FULL_BIT;
+        led_register_values[3] &= ~PWM_FULL_BIT;
+        return;
+    }
+
+    encode_pwm_registers(duty_cycle, led_delay_time, led_register_values);
+}
+
+int decode_pwm_registers(const int *led_register_values) {
+    int led_on_time = led_register_values[0]
+                      | ((led_register_values[1] & 0x0F) << 8);
+    int led_off_time = led_register_values[2]
+                       | ((led_register_values[3] & 0x0F) << 8);
+
+    // Full OFF wins over full ON (page 16):
+    if (led_register_values[3] & PWM_FULL_BIT) {
+        return 0;
+    }
+
+    if (led_register_values[1] & PWM_FULL_BIT) {
+        return PWM_FULL_SCALE;
+    }
+
+    return (led_off_time - led_on_time) & (PWM_COUNTS - 1);
+}
+
+void encode_pwm_images(const int *restrict duty_cycles,
+                       const int *restrict led_delay_times,
+                       uint32_t *restrict images) {
+    int led_id;
+
+    // Fixed trip count and no branches; the compiler turns this into SIMD:
+    for (led_id = 0; led_id < NUM_LED_CHANNELS; led_id++) {
+        images[led_id] = encode_pwm(duty_cycles[led_id],
+                                    led_delay_times[led_id]);
+    }
+}
+
+void encode_pwm_bank(const int *duty_cycles, const int *led_delay_times,
+                     int *led_bank) {
+    uint32_t images[NUM_LED_CHANNELS];
+
+    int led_id;
+
+    encode_pwm_images(duty_cycles, led_delay_times, images);
+
+    for (led_id = 0; led_id < NUM_LED_CHANNELS; led_id++) {
+        unpack_pwm(images[led_id], &led_bank[led_id * LED_REG_BYTES]);
+    }
+}
@@ -0,0 +1,198 @@
+// Raspberry Pi PCA9685 Example
+//
+// Copyright (c) 2022 Benjamin Spencer
+// ============================================================================
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+// ============================================================================
+
+// Include C standard libraries:
+#include <stdio.h>  // C Standard I/O libary
+#include <stdint.h> // C Standard integer types
+#include <time.h>   // C Standard date and time manipulation
+
+#include "pca9685_registers.h" // PCA9685 register definitions
+#include "pca9685_cache.h"     // PCA9685 shadow register cache
+#include "pca9685_encode.h"    // PCA9685 duty cycle encoder
+#include "pca9685_phase.h"     // PCA9685 phase scheduler
+#include "pca9685_freq.h"      // PCA9685 frequency planner
+#include "pca9685_metrics.h"   // PCA9685 bus metrics (clock)
+#include "pca9685_frame.h"     // PCA9685 double-buffered frames
+
+#define ALL_CHANNELS ((1 << NUM_LED_CHANNELS) - 1)
+
+#define PWM_STEPS 4096 // Oscillator cycles per prescaled PWM count
+#define NS_PER_S 1000000000ULL
+
+// Apply one register setting mask the same way configure_device() does:
+static int apply_setting(int device_addr, int reg_addr, int setting) {
+    int reg_value[1] = {0};
+
+    int ret;
+
+    if ((ret = read_register_cache(device_addr, reg_addr, reg_value,
+         1)) < 0) {
+        return ret;
+    }
+
+    reg_value[0] = (reg_value[0] & ~(0x01 << (setting >> 8)))
+                    | ((setting & 0x01) << (setting >> 8));
+
+    return write_register_cache(device_addr, reg_addr, reg_value, 1);
+}
+
+// One PWM period at the cached PRE_SCALE (page 25):
+static int get_period_ns(int device_addr, uint64_t *period_ns) {
+    int prescale_value[1] = {0};
+
+    int clock_hz;
+    int ret;
+
+    if ((ret = read_register_cache(device_addr, PRE_SCALE, prescale_value,
+         1)) < 0) {
+        return ret;
+    }
+
+    if ((clock_hz = get_clock_frequency(device_addr)) <= 0) {
+        return -1;
+    }
+
+    *period_ns = (uint64_t) PWM_STEPS * (prescale_value[0] + 1) * NS_PER_S
+                 / clock_hz;
+
+    return 0;
+}
+
+static void wait_until(uint64_t time_ns) {
+    struct timespec wake;
+
+    wake.tv_sec = time_ns / 1000000000;
+    wake.tv_nsec = time_ns % 1000000000;
+
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake, NULL)) {
+        // Interrupted; the wake time doesn't move
+    }
+}
+
+int init_frame(struct pca9685_frame *frame, int device_addr) {
+    int ret;
+
+    if ((ret = get_period_ns(device_addr, &frame->period_ns)) < 0) {
+        return ret;
+    }
+
+    // One burst has to reach every channel register:
+    if ((ret = apply_setting(device_addr, MODE1, AI)) < 0) {
+        return ret;
+    }
+
+    // Outputs take the new values together at the STOP (page 16):
+    if ((ret = apply_setting(device_addr, MODE2, OCH_STOP)) < 0) {
+        return ret;
+    }
+
+    frame->device_addr = device_addr;
+    frame->staged = 0;
+    frame->next_commit_ns = 0;
+
+    return 0;
+}
+
+int stage_duty_cycle(struct pca9685_frame *frame, int led_id,
+                     int duty_cycle) {
+    if ((led_id < 0) || (led_id >= NUM_LED_CHANNELS)) {
+        return -1;
+    }
+
+    frame->duty_cycles[led_id] = duty_cycle;
+    frame->staged |= 1 << led_id;
+
+    return 0;
+}
+
+int stage_duty_cycles(struct pca9685_frame *frame, int *duty_cycles) {
+    int led_id;
+
+    for (led_id = 0; led_id < NUM_LED_CHANNELS; led_id++) {
+        frame->duty_cycles[led_id] = duty_cycles[led_id];
+    }
+
+    frame->staged = ALL_CHANNELS;
+
+    return 0;
+}
+
+void discard_frame(struct pca9685_frame *frame) {
+    frame->staged = 0;
+}
+
+int commit_frame(struct pca9685_frame *frame) {
+    int led_bank[LED_BANK_BYTES];
+    int led_delay_times[NUM_LED_CHANNELS];
+
+    uint64_t now_ns;
+
+    int led_id;
+    int ret;
+
+    if (!frame->staged) {
+        return 0;
+    }
+
+    // Front buffer is what the device shows now:
+    if ((ret = read_register_cache(frame->device_addr, LED0_ON_L, led_bank,
+         LED_BANK_BYTES)) < 0) {
+        return ret;
+    }
+
+    if ((ret = get_channel_phases(frame->device_addr, led_delay_times)) < 0) {
+        return ret;
+    }
+
+    if ((ret = get_period_ns(frame->device_addr, &frame->period_ns)) < 0) {
+        return ret;
+    }
+
+    for (led_id = 0; led_id < NUM_LED_CHANNELS; led_id++) {
+        if (frame->staged & (1 << led_id)) {
+            encode_pwm_registers(frame->duty_cycles[led_id],
+                                 led_delay_times[led_id],
+                                 &led_bank[led_id * LED_REG_BYTES]);
+        }
+    }
+
+    // At most one frame per PWM period:
+    now_ns = metrics_now();
+
+    if (now_ns < frame->next_commit_ns) {
+        wait_until(frame->next_commit_ns);
+        now_ns = frame->next_commit_ns;
+    }
+
+    // With auto-increment on the cache sends the whole changed span as one
+    // transaction, so there is a single STOP:
+    if ((ret = write_register_cache(frame->device_addr, LED0_ON_L, led_bank,
+         LED_BANK_BYTES)) < 0) {
+        return ret;
+    }
+
+    frame->staged = 0;
+    frame->next_commit_ns = now_ns + frame->period_ns;
+
+    return 0;
+}
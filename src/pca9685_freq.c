@@ -0,0 +1,252 @@
+// Raspberry Pi PCA9685 Example
+//
+// Copyright (c) 2022 Benjamin Spencer
+// ============================================================================
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+// ============================================================================
+
+// Include C standard libraries:
+#include <stdio.h>   // C Standard I/O libary
+#include <stdint.h>  // C Standard integer types
+#include <pthread.h> // POSIX threads
+
+#include "pca9685_registers.h" // PCA9685 register definitions
+#include "pca9685_log.h"       // PCA9685 driver logging
+#include "pca9685_cache.h"     // PCA9685 shadow register cache
+#include "pca9685_freq.h"      // PCA9685 frequency planner
+
+// EXTCLK bit of MODE1 (page 14):
+#define MODE1_EXTCLK_BIT (0x01 << 6)
+
+#define PWM_STEPS 4096 // Oscillator cycles per prescaled PWM count
+
+#define NUM_PRESCALES (PRESCALE_MAX - PRESCALE_MIN + 1)
+
+// Output frequency (mHz) of every prescale for one clock; falls as the
+// prescale goes up:
+struct freq_table {
+    int clock_hz;
+    int achieved_mhz[NUM_PRESCALES];
+};
+
+static struct freq_table tables[FREQ_TABLES];
+static int num_tables;
+static int next_table; // Oldest table, replaced once all are used
+
+// Bus worker threads may plan at the same time:
+static pthread_mutex_t tables_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Measured clock of each device for the internal oscillator and the
+// EXTCLK pin (0 = not known):
+static int int_clock_hz[NUM_DEVICE_IDS];
+static int ext_clock_hz[NUM_DEVICE_IDS];
+
+static int check_device(int device_addr) {
+    if ((device_addr < 0) || (device_addr >= NUM_DEVICE_IDS)) {
+        return -1;
+    }
+
+    return 0;
+}
+
+static int output_mhz(int clock_hz, int prescale) {
+    uint64_t divider = (uint64_t) PWM_STEPS * (prescale + 1);
+
+    return (int) (((uint64_t) clock_hz * 1000 + divider / 2) / divider);
+}
+
+static struct freq_table *get_table(int clock_hz) {
+    struct freq_table *table;
+
+    int i;
+
+    for (i = 0; i < num_tables; i++) {
+        if (tables[i].clock_hz == clock_hz) {
+            return &tables[i];
+        }
+    }
+
+    if (num_tables < FREQ_TABLES) {
+        table = &tables[num_tables++];
+    } else {
+        table = &tables[next_table];
+        next_table = (next_table + 1) % FREQ_TABLES;
+    }
+
+    table->clock_hz = clock_hz;
+
+    for (i = 0; i < NUM_PRESCALES; i++) {
+        table->achieved_mhz[i] = output_mhz(clock_hz, PRESCALE_MIN + i);
+    }
+
+    return table;
+}
+
+int plan_frequency(int clock_hz, int frequency, struct freq_plan *plan) {
+    struct freq_table *table;
+
+    int64_t target_mhz;
+
+    int low;
+    int high;
+    int mid;
+
+    if ((clock_hz <= 0) || (clock_hz > EXT_CLOCK_MAX_HZ) || (frequency <= 0)) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&tables_lock);
+
+    table = get_table(clock_hz);
+    target_mhz = (int64_t) frequency * 1000;
+
+    // Find the first prescale at or below the target:
+    low = 0;
+    high = NUM_PRESCALES - 1;
+
+    while (low < high) {
+        mid = (low + high) / 2;
+
+        if (table->achieved_mhz[mid] > target_mhz) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+
+    // The one above the target may be closer:
+    if ((low > 0) && (table->achieved_mhz[low - 1] - target_mhz
+                      < target_mhz - table->achieved_mhz[low])) {
+        low--;
+    }
+
+    plan->prescale = PRESCALE_MIN + low;
+    plan->achieved_mhz = table->achieved_mhz[low];
+    plan->error_ppm = (int) ((plan->achieved_mhz - target_mhz) * 1000000
+                             / target_mhz);
+
+    pthread_mutex_unlock(&tables_lock);
+
+    return 0;
+}
+
+// Check MODE1 in the cache to find which clock the device is on; EXTCLK
+// drops back to the internal oscillator after a reset:
+static int on_external_clock(int device_addr) {
+    int reg_value[1] = {0};
+
+    if (read_register_cache(device_addr, MODE1, reg_value, 1) < 0) {
+        return 0;
+    }
+
+    return (reg_value[0] & MODE1_EXTCLK_BIT) != 0;
+}
+
+int get_clock_frequency(int device_addr) {
+    if (check_device(device_addr) < 0) {
+        return -1;
+    }
+
+    if (on_external_clock(device_addr) && ext_clock_hz[device_addr]) {
+        return ext_clock_hz[device_addr];
+    }
+
+    if (int_clock_hz[device_addr]) {
+        return int_clock_hz[device_addr];
+    }
+
+    return INT_CLOCK_HZ;
+}
+
+int set_clock_frequency(int device_addr, int clock_hz) {
+    if ((check_device(device_addr) < 0) || (clock_hz <= 0)
+        || (clock_hz > EXT_CLOCK_MAX_HZ)) {
+        return -1;
+    }
+
+    if (on_external_clock(device_addr)) {
+        ext_clock_hz[device_addr] = clock_hz;
+    } else {
+        int_clock_hz[device_addr] = clock_hz;
+    }
+
+    return 0;
+}
+
+int calibrate_oscillator(int device_addr, int measured_mhz) {
+    int prescale_value[1] = {0};
+
+    uint64_t clock_hz;
+
+    int ret;
+
+    if ((check_device(device_addr) < 0) || (measured_mhz <= 0)) {
+        return -1;
+    }
+
+    if ((ret = read_register_cache(device_addr, PRE_SCALE, prescale_value,
+         1)) < 0) {
+        return ret;
+    }
+
+    clock_hz = ((uint64_t) measured_mhz * PWM_STEPS * (prescale_value[0] + 1)
+                + 500) / 1000;
+
+    PCA9685_LOG("Device 0x%X oscillator calibrated to %llu Hz\n",
+                device_addr, (unsigned long long) clock_hz);
+
+    return set_clock_frequency(device_addr, (int) clock_hz);
+}
+
+int use_external_clock(int device_addr, int clock_hz) {
+    const int configs[2] = {LOW_POWER, EXT_CLOCK};
+
+    int reg_value[1] = {0};
+
+    int i;
+    int ret;
+
+    if ((check_device(device_addr) < 0) || (clock_hz <= 0)
+        || (clock_hz > EXT_CLOCK_MAX_HZ)) {
+        return -1;
+    }
+
+    if ((ret = read_register_cache(device_addr, MODE1, reg_value, 1)) < 0) {
+        return ret;
+    }
+
+    // EXTCLK only latches while the device is asleep, so sleep first and
+    // set it in a second write:
+    for (i = 0; i < 2; i++) {
+        reg_value[0] = (reg_value[0] & ~(0x01 << (configs[i] >> 8)))
+                        | ((configs[i] & 0x01) << (configs[i] >> 8));
+
+        if ((ret = write_register_cache(device_addr, MODE1, reg_value,
+             1)) < 0) {
+            return ret;
+        }
+    }
+
+    ext_clock_hz[device_addr] = clock_hz;
+
+    PCA9685_LOG("Device 0x%X switched to a %d Hz external clock\n",
+                device_addr, clock_hz);
+
+    return 0;
+}
@@ -0,0 +1,398 @@
+// Raspberry Pi PCA9685 Example
+//
+// Copyright (c) 2022 Benjamin Spencer
+// ============================================================================
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+// ============================================================================
+
+// Include C standard libraries:
+#include <stdlib.h>    // C Standard library
+#include <stdio.h>     // C Standard I/O libary
+#include <string.h>    // C Standard string manipulation
+#include <time.h>      // C Standard date and time manipulation
+#include <stdint.h>    // C Standard integer types
+#include <stdatomic.h> // C Standard atomic operations
+#include <pthread.h>   // POSIX threads
+#include <unistd.h>    // POSIX close()
+#include <sys/socket.h> // POSIX sockets
+#include <sys/un.h>     // UNIX domain sockets
+
+#include <pi_i2c.h> // Pi I2C library! (error codes)
+
+#include "pca9685_metrics.h" // PCA9685 bus metrics
+
+#define DUMP_LINE_SIZE 2048
+#define DUMP_UNIX_PREFIX "unix:"
+
+struct atomic_histogram {
+    _Atomic uint64_t count;
+    _Atomic uint64_t total_ns;
+    _Atomic uint64_t max_ns;
+    _Atomic uint64_t buckets[METRICS_BUCKETS];
+};
+
+static struct atomic_histogram histograms[METRICS_OPS];
+static _Atomic uint64_t error_counts[METRICS_ERRORS];
+
+static const char *op_names[METRICS_OPS] = {"read", "write", "scan"};
+
+static const char *error_names[METRICS_ERRORS] = {
+    "OTHER", "ENACK", "EBADXFR", "EBADREGADDR", "ECLKTIMEOUT", "ENACKRST",
+    "EBUSLOCKUP", "EBUSUNKERR", "EFAILSTCOND", "EDEVICEHUNG"
+};
+
+// Periodic dump state:
+static pthread_t dump_thread;
+static pthread_mutex_t dump_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t dump_stop;
+static int dump_running = 0;
+static int dump_period_ms;
+static char dump_path[sizeof(((struct sockaddr_un *) 0)->sun_path)];
+static int dump_socket = -1;
+
+static int bucket_index(uint64_t ns) {
+    int exponent;
+    int bucket;
+
+    if (ns < METRICS_SUB_BUCKETS) {
+        return (int) ns;
+    }
+
+    exponent = 63 - __builtin_clzll(ns);
+    bucket = (exponent - 2) * METRICS_SUB_BUCKETS
+             + (int) ((ns >> (exponent - 3)) & (METRICS_SUB_BUCKETS - 1));
+
+    return (bucket < METRICS_BUCKETS) ? bucket : METRICS_BUCKETS - 1;
+}
+
+static int error_index(int ret) {
+    switch (ret) {
+        case -ENACK:
+            return METRICS_ENACK;
+        case -EBADXFR:
+            return METRICS_EBADXFR;
+        case -EBADREGADDR:
+            return METRICS_EBADREGADDR;
+        case -ECLKTIMEOUT:
+            return METRICS_ECLKTIMEOUT;
+        case -ENACKRST:
+            return METRICS_ENACKRST;
+        case -EBUSLOCKUP:
+            return METRICS_EBUSLOCKUP;
+        case -EBUSUNKERR:
+            return METRICS_EBUSUNKERR;
+        case -EFAILSTCOND:
+            return METRICS_EFAILSTCOND;
+        case -EDEVICEHUNG:
+            return METRICS_EDEVICEHUNG;
+        default:
+            return METRICS_OTHER;
+    }
+}
+
+uint64_t metrics_now(void) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t) now.tv_sec * 1000000000u + (uint64_t) now.tv_nsec;
+}
+
+void record_bus_operation(int op, uint64_t start_ns, int ret) {
+    struct atomic_histogram *histogram = &histograms[op];
+
+    uint64_t elapsed_ns = metrics_now() - start_ns;
+    uint64_t max_ns;
+
+    atomic_fetch_add_explicit(&histogram->count, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&histogram->total_ns, elapsed_ns,
+                              memory_order_relaxed);
+    atomic_fetch_add_explicit(&histogram->buckets[bucket_index(elapsed_ns)],
+                              1, memory_order_relaxed);
+
+    max_ns = atomic_load_explicit(&histogram->max_ns, memory_order_relaxed);
+
+    while ((elapsed_ns > max_ns) && !atomic_compare_exchange_weak_explicit(
+           &histogram->max_ns, &max_ns, elapsed_ns, memory_order_relaxed,
+           memory_order_relaxed)) {
+    }
+
+    if (ret < 0) {
+        atomic_fetch_add_explicit(&error_counts[error_index(ret)], 1,
+                                  memory_order_relaxed);
+    }
+}
+
+void get_metrics(struct pca9685_metrics *snapshot) {
+    int op;
+    int i;
+
+    for (op = 0; op < METRICS_OPS; op++) {
+        snapshot->ops[op].count = atomic_load_explicit(
+            &histograms[op].count, memory_order_relaxed);
+        snapshot->ops[op].total_ns = atomic_load_explicit(
+            &histograms[op].total_ns, memory_order_relaxed);
+        snapshot->ops[op].max_ns = atomic_load_explicit(
+            &histograms[op].max_ns, memory_order_relaxed);
+
+        for (i = 0; i < METRICS_BUCKETS; i++) {
+            snapshot->ops[op].buckets[i] = atomic_load_explicit(
+                &histograms[op].buckets[i], memory_order_relaxed);
+        }
+    }
+
+    for (i = 0; i < METRICS_ERRORS; i++) {
+        snapshot->errors[i] = atomic_load_explicit(&error_counts[i],
+                                                   memory_order_relaxed);
+    }
+}
+
+void reset_metrics(void) {
+    int op;
+    int i;
+
+    for (op = 0; op < METRICS_OPS; op++) {
+        atomic_store(&histograms[op].count, 0);
+        atomic_store(&histograms[op].total_ns, 0);
+        atomic_store(&histograms[op].max_ns, 0);
+
+        for (i = 0; i < METRICS_BUCKETS; i++) {
+            atomic_store(&histograms[op].buckets[i], 0);
+        }
+    }
+
+    for (i = 0; i < METRICS_ERRORS; i++) {
+        atomic_store(&error_counts[i], 0);
+    }
+}
+
+uint64_t metrics_bucket_floor(int bucket) {
+    int exponent;
+
+    if (bucket < METRICS_SUB_BUCKETS) {
+        return (uint64_t) bucket;
+    }
+
+    exponent = bucket / METRICS_SUB_BUCKETS + 2;
+
+    return (uint64_t) (METRICS_SUB_BUCKETS + bucket % METRICS_SUB_BUCKETS)
+           << (exponent - 3);
+}
+
+uint64_t metrics_percentile(const struct latency_histogram *histogram,
+                            double q) {
+    uint64_t target;
+    uint64_t seen = 0;
+
+    int bucket;
+
+    if (histogram->count == 0) {
+        return 0;
+    }
+
+    target = (uint64_t) (q * histogram->count);
+
+    if (target < 1) {
+        target = 1;
+    }
+
+    for (bucket = 0; bucket < METRICS_BUCKETS; bucket++) {
+        seen += histogram->buckets[bucket];
+
+        if (seen >= target) {
+            return metrics_bucket_floor(bucket);
+        }
+    }
+
+    return histogram->max_ns;
+}
+
+const char *metrics_error_name(int error) {
+    if ((error < 0) || (error >= METRICS_ERRORS)) {
+        return NULL;
+    }
+
+    return error_names[error];
+}
+
+// One JSON object per snapshot:
+static int format_metrics(char *line, size_t size,
+                          const struct pca9685_metrics *snapshot) {
+    const struct latency_histogram *histogram;
+
+    size_t length;
+
+    int op;
+    int i;
+
+    length = snprintf(line, size, "{\"time_ns\":%llu",
+                      (unsigned long long) metrics_now());
+
+    for (op = 0; (op < METRICS_OPS) && (length < size); op++) {
+        histogram = &snapshot->ops[op];
+
+        length += snprintf(line + length, size - length,
+            ",\"%s\":{\"count\":%llu,\"total_ns\":%llu,\"max_ns\":%llu,"
+            "\"p50_ns\":%llu,\"p99_ns\":%llu,\"p999_ns\":%llu}",
+            op_names[op], (unsigned long long) histogram->count,
+            (unsigned long long) histogram->total_ns,
+            (unsigned long long) histogram->max_ns,
+            (unsigned long long) metrics_percentile(histogram, 0.50),
+            (unsigned long long) metrics_percentile(histogram, 0.99),
+            (unsigned long long) metrics_percentile(histogram, 0.999));
+    }
+
+    for (i = 0; (i < METRICS_ERRORS) && (length < size); i++) {
+        length += snprintf(line + length, size - length, "%s\"%s\":%llu",
+                           (i == 0) ? ",\"errors\":{" : ",", error_names[i],
+                           (unsigned long long) snapshot->errors[i]);
+    }
+
+    if (length < size) {
+        length += snprintf(line + length, size - length, "}}\n");
+    }
+
+    return (length < size) ? (int) length : -1;
+}
+
+static void write_dump(const char *line, int length) {
+    struct sockaddr_un addr;
+
+    FILE *dump_file;
+
+    if (dump_socket >= 0) {
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        memcpy(addr.sun_path, dump_path, sizeof(addr.sun_path));
+
+        // Nobody listening is not an error; the snapshot is just dropped:
+        sendto(dump_socket, line, length, MSG_DONTWAIT,
+               (struct sockaddr *) &addr, sizeof(addr));
+        return;
+    }
+
+    if ((dump_file = fopen(dump_path, "a")) != NULL) {
+        fwrite(line, 1, length, dump_file);
+        fclose(dump_file);
+    }
+}
+
+static void *dump_worker(void *arg) {
+    static struct pca9685_metrics snapshot;
+
+    char line[DUMP_LINE_SIZE];
+
+    struct timespec wake;
+
+    int length;
+
+    pthread_mutex_lock(&dump_lock);
+
+    while (dump_running) {
+        clock_gettime(CLOCK_MONOTONIC, &wake);
+        wake.tv_sec += dump_period_ms / 1000;
+        wake.tv_nsec += (dump_period_ms % 1000) * 1000000L;
+
+        if (wake.tv_nsec >= 1000000000L) {
+            wake.tv_sec++;
+            wake.tv_nsec -= 1000000000L;
+        }
+
+        // Sleep for a period unless stopped first:
+        pthread_cond_timedwait(&dump_stop, &dump_lock, &wake);
+
+        if (!dump_running) {
+            break;
+        }
+
+        get_metrics(&snapshot);
+
+        if ((length = format_metrics(line, sizeof(line), &snapshot)) > 0) {
+            write_dump(line, length);
+        }
+    }
+
+    pthread_mutex_unlock(&dump_lock);
+
+    return NULL;
+}
+
+int start_metrics_dump(const char *path, int period_ms) {
+    pthread_condattr_t attr;
+
+    size_t prefix_length = strlen(DUMP_UNIX_PREFIX);
+
+    if ((path == NULL) || (period_ms <= 0) || dump_running) {
+        return -1;
+    }
+
+    if (strncmp(path, DUMP_UNIX_PREFIX, prefix_length) == 0) {
+        path += prefix_length;
+
+        if ((dump_socket = socket(AF_UNIX, SOCK_DGRAM, 0)) < 0) {
+            return -1;
+        }
+    }
+
+    if (strlen(path) >= sizeof(dump_path)) {
+        stop_metrics_dump();
+        return -1;
+    }
+
+    strcpy(dump_path, path);
+    dump_period_ms = period_ms;
+
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&dump_stop, &attr);
+    pthread_condattr_destroy(&attr);
+
+    dump_running = 1;
+
+    if (pthread_create(&dump_thread, NULL, dump_worker, NULL) != 0) {
+        dump_running = 0;
+        pthread_cond_destroy(&dump_stop);
+        stop_metrics_dump();
+        return -1;
+    }
+
+    return 0;
+}
+
+int stop_metrics_dump(void) {
+    int was_running;
+
+    pthread_mutex_lock(&dump_lock);
+    was_running = dump_running;
+    dump_running = 0;
+    pthread_mutex_unlock(&dump_lock);
+
+    if (was_running) {
+        pthread_cond_signal(&dump_stop);
+        pthread_join(dump_thread, NULL);
+        pthread_cond_destroy(&dump_stop);
+    }
+
+    if (dump_socket >= 0) {
+        close(dump_socket);
+        dump_socket = -1;
+    }
+
+    return 0;
+}
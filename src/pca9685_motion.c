@@ -0,0 +1,329 @@
+// Raspberry Pi PCA9685 Example
+//
+// Copyright (c) 2022 Benjamin Spencer
+// ============================================================================
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+// ============================================================================
+
+// Include C standard libraries:
+#include <stdio.h>  // C Standard I/O libary
+#include <stdint.h> // C Standard integer types
+#include <string.h> // C Standard string manipulation
+#include <time.h>   // C Standard date and time manipulation
+
+#include "pca9685_log.h"    // PCA9685 driver logging
+#include "pca9685_cache.h"  // PCA9685 shadow register cache
+#include "pca9685_pwm.h"    // PCA9685 PWM output helpers
+#include "pca9685_multi.h"  // PCA9685 multi-board manager
+#include "pca9685_motion.h" // PCA9685 motion engine
+
+// Segment progress is a Q16 fraction (0 to 1 << 16):
+#define MOTION_FRAC_BITS 16
+#define MOTION_ONE (1 << MOTION_FRAC_BITS)
+
+static int clamp_duty_cycle(int64_t duty_cycle) {
+    if (duty_cycle < 0) {
+        return 0;
+    }
+
+    if (duty_cycle > PWM_FULL_SCALE) {
+        return PWM_FULL_SCALE;
+    }
+
+    return (int) duty_cycle;
+}
+
+// Smoothstep 3t^2 - 2t^3 (zero speed at both ends):
+static int64_t s_curve(int64_t t) {
+    int64_t t2 = (t * t) >> MOTION_FRAC_BITS;
+
+    return (t2 * (3 * MOTION_ONE - 2 * t)) >> MOTION_FRAC_BITS;
+}
+
+// Catmull-Rom through p1 and p2 with neighbours p0 and p3:
+static int catmull_rom(int64_t p0, int64_t p1, int64_t p2, int64_t p3,
+                       int64_t t) {
+    int64_t t2 = (t * t) >> MOTION_FRAC_BITS;
+    int64_t t3 = (t2 * t) >> MOTION_FRAC_BITS;
+
+    int64_t value = 2 * p1 * MOTION_ONE
+                    + (p2 - p0) * t
+                    + (2 * p0 - 5 * p1 + 4 * p2 - p3) * t2
+                    + (3 * p1 - p0 - 3 * p2 + p3) * t3;
+
+    // Round to nearest before dropping the fraction:
+    return clamp_duty_cycle((value + MOTION_ONE) >> (MOTION_FRAC_BITS + 1));
+}
+
+// Where a channel should be at now_us; retires finished segments:
+static int interpolate(struct motion_channel *channel, uint64_t now_us) {
+    struct motion_keyframe *from;
+    struct motion_keyframe *to;
+
+    int64_t t;
+    int next;
+
+    // Drop segments that have already ended:
+    while ((channel->num_keyframes > 1)
+           && (channel->keyframes[1].time_us <= now_us)) {
+        channel->previous_duty_cycle = channel->keyframes[0].duty_cycle;
+        channel->num_keyframes--;
+
+        memmove(&channel->keyframes[0], &channel->keyframes[1],
+                channel->num_keyframes * sizeof(struct motion_keyframe));
+    }
+
+    from = &channel->keyframes[0];
+
+    if (channel->num_keyframes == 1) {
+        return from->duty_cycle;
+    }
+
+    to = &channel->keyframes[1];
+
+    if (now_us <= from->time_us) {
+        return from->duty_cycle;
+    }
+
+    t = (int64_t) (((now_us - from->time_us) << MOTION_FRAC_BITS)
+                   / (to->time_us - from->time_us));
+
+    switch (to->mode) {
+        case MOTION_STEP:
+            return from->duty_cycle;
+        case MOTION_S_CURVE:
+            t = s_curve(t);
+            break;
+        case MOTION_SPLINE:
+            // Past the last keyframe the curve aims straight at it:
+            next = (channel->num_keyframes > 2) ? 2 : 1;
+
+            return catmull_rom(channel->previous_duty_cycle,
+                               from->duty_cycle, to->duty_cycle,
+                               channel->keyframes[next].duty_cycle, t);
+        default:
+            break;
+    }
+
+    return clamp_duty_cycle(from->duty_cycle
+        + (((int64_t) (to->duty_cycle - from->duty_cycle) * t)
+           >> MOTION_FRAC_BITS));
+}
+
+uint64_t motion_now_us(void) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t) now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+int init_motion(struct pca9685_motion *motion, struct pca9685_multi *multi,
+                int frequency) {
+    int led_bank[LED_BANK_BYTES];
+
+    int board;
+    int led_id;
+    int ret;
+
+    if ((frequency <= 0) || (multi->num_boards < 1)) {
+        return -1;
+    }
+
+    motion->multi = multi;
+    motion->num_channels = multi->num_boards * NUM_LED_CHANNELS;
+    motion->period_us = (1000000 + frequency / 2) / frequency;
+    motion->last_tick_us = motion_now_us();
+
+    // Channels nobody moves stay as they are, so start from the cache:
+    for (board = 0; board < multi->num_boards; board++) {
+        if ((ret = read_register_cache(multi->board_addr[board], LED0_ON_L,
+             led_bank, LED_BANK_BYTES)) < 0) {
+            return ret;
+        }
+
+        for (led_id = 0; led_id < NUM_LED_CHANNELS; led_id++) {
+            set_motion_duty_cycle(motion, board * NUM_LED_CHANNELS + led_id,
+                decode_pwm_registers(&led_bank[led_id * LED_REG_BYTES]));
+        }
+    }
+
+    return 0;
+}
+
+int set_motion_duty_cycle(struct pca9685_motion *motion, int channel,
+                          int duty_cycle) {
+    struct motion_channel *state;
+
+    if ((channel < 0) || (channel >= motion->num_channels)) {
+        return -1;
+    }
+
+    state = &motion->channels[channel];
+
+    state->keyframes[0].time_us = 0;
+    state->keyframes[0].duty_cycle = clamp_duty_cycle(duty_cycle);
+    state->keyframes[0].mode = MOTION_STEP;
+    state->num_keyframes = 1;
+    state->previous_duty_cycle = state->keyframes[0].duty_cycle;
+
+    motion->duty_cycles[channel] = state->keyframes[0].duty_cycle;
+
+    return 0;
+}
+
+int push_keyframe(struct pca9685_motion *motion, int channel,
+                  uint64_t time_us, int duty_cycle, int mode) {
+    struct motion_channel *state;
+    struct motion_keyframe *last;
+
+    if ((channel < 0) || (channel >= motion->num_channels)
+        || (mode < MOTION_STEP) || (mode > MOTION_SPLINE)) {
+        return -1;
+    }
+
+    state = &motion->channels[channel];
+    last = &state->keyframes[state->num_keyframes - 1];
+
+    if (state->num_keyframes == MOTION_MAX_KEYFRAMES) {
+        return -1;
+    }
+
+    // A channel at rest starts its next move from the last tick:
+    if (state->num_keyframes == 1) {
+        if (last->time_us < motion->last_tick_us) {
+            last->time_us = motion->last_tick_us;
+        }
+
+        state->previous_duty_cycle = last->duty_cycle;
+    }
+
+    if (time_us <= last->time_us) {
+        return -1;
+    }
+
+    last[1].time_us = time_us;
+    last[1].duty_cycle = clamp_duty_cycle(duty_cycle);
+    last[1].mode = mode;
+
+    state->num_keyframes++;
+
+    return 0;
+}
+
+int motion_active(struct pca9685_motion *motion) {
+    int active = 0;
+
+    int channel;
+
+    for (channel = 0; channel < motion->num_channels; channel++) {
+        if (motion->channels[channel].num_keyframes > 1) {
+            active++;
+        }
+    }
+
+    return active;
+}
+
+int motion_tick(struct pca9685_motion *motion, uint64_t now_us) {
+    int next_duty_cycles[NUM_LED_CHANNELS];
+    int duty_cycles[NUM_LED_CHANNELS];
+
+    int channel_mask;
+    int num_changed;
+
+    int board;
+    int led_id;
+    int channel;
+    int error = 0;
+    int ret;
+
+    motion->last_tick_us = now_us;
+
+    for (board = 0; board < motion->multi->num_boards; board++) {
+        channel = board * NUM_LED_CHANNELS;
+        channel_mask = 0;
+        num_changed = 0;
+
+        for (led_id = 0; led_id < NUM_LED_CHANNELS; led_id++) {
+            next_duty_cycles[led_id] = interpolate(
+                &motion->channels[channel + led_id], now_us);
+
+            if (next_duty_cycles[led_id]
+                != motion->duty_cycles[channel + led_id]) {
+                duty_cycles[num_changed++] = next_duty_cycles[led_id];
+                channel_mask |= 1 << led_id;
+            }
+        }
+
+        // Idle boards cost nothing on the bus, and channels that didn't
+        // move are never written:
+        if (!channel_mask) {
+            continue;
+        }
+
+        // A board that fails keeps its old values so the next tick sends
+        // them again; the other boards still get theirs:
+        if ((ret = set_pwm_duty_cycles_mask(motion->multi->board_addr[board],
+             channel_mask, duty_cycles)) < 0) {
+            PCA9685_LOG("Motion update failed with %d\n", ret);
+
+            if (!error) {
+                error = ret;
+            }
+
+            continue;
+        }
+
+        for (led_id = 0; led_id < NUM_LED_CHANNELS; led_id++) {
+            if (channel_mask & (1 << led_id)) {
+                motion->duty_cycles[channel + led_id] =
+                    next_duty_cycles[led_id];
+            }
+        }
+    }
+
+    return error;
+}
+
+int run_motion(struct pca9685_motion *motion) {
+    struct timespec wake;
+
+    uint64_t next_us;
+
+    int ret;
+
+    while (motion_active(motion)) {
+        // New values only show at the start of a PWM period so there is no
+        // point updating more often than that:
+        next_us = motion_now_us();
+        next_us += motion->period_us - (next_us % motion->period_us);
+
+        wake.tv_sec = next_us / 1000000;
+        wake.tv_nsec = (next_us % 1000000) * 1000;
+
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake, NULL);
+
+        if ((ret = motion_tick(motion, next_us)) < 0) {
+            return ret;
+        }
+    }
+
+    return 0;
+}
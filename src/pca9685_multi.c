@@ -0,0 +1,636 @@
+// Raspberry Pi PCA9685 Example
+//
+// Copyright (c) 2022 Benjamin Spencer
+// ============================================================================
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+// ============================================================================
+
+// Include C standard libraries:
+#include <stdio.h>  // C Standard I/O libary
+#include <stdint.h> // C Standard integer types
+
+#include "pca9685_registers.h" // PCA9685 register definitions
+#include "pca9685_log.h"       // PCA9685 driver logging
+#include "pca9685_bus.h"       // PCA9685 bus backend
+#include "pca9685_cache.h"     // PCA9685 shadow register cache
+#include "pca9685_pwm.h"       // PCA9685 PWM output helpers
+#include "pca9685_multi.h"     // PCA9685 multi-board manager
+#include "pca9685_phase.h"     // PCA9685 phase scheduler
+#include "pca9685.h"           // PCA9685 driver
+
+#define BOARD_BIT(board) ((uint64_t) 0x01 << (board))
+
+// MODE1 subaddress settings for each group:
+static const int sub_enable[NUM_GROUPS] = {SUB1, SUB2, SUB3};
+static const int sub_disable[NUM_GROUPS] = {NO_SUB1, NO_SUB2, NO_SUB3};
+static const int subadr_reg[NUM_GROUPS] = {SUBADR1, SUBADR2, SUBADR3};
+
+// Apply MODE1 settings the same way configure_device() does:
+static int apply_mode1(int device_addr, const int *configs, int num_configs) {
+    int reg_value[1] = {0};
+
+    int i;
+    int ret;
+
+    if ((ret = read_register_cache(device_addr, MODE1, reg_value, 1)) < 0) {
+        return ret;
+    }
+
+    for (i = 0; i < num_configs; i++) {
+        reg_value[0] = (reg_value[0] & ~(0x01 << (configs[i] >> 8)))
+                        | ((configs[i] & 0x01) << (configs[i] >> 8));
+    }
+
+    return write_register_cache(device_addr, MODE1, reg_value, 1);
+}
+
+static uint64_t all_boards(struct pca9685_multi *multi) {
+    if (multi->num_boards >= 64) {
+        return ~(uint64_t) 0;
+    }
+
+    return BOARD_BIT(multi->num_boards) - 1;
+}
+
+static uint64_t boards_on_bus(struct pca9685_multi *multi, int bus_id) {
+    uint64_t boards = 0;
+
+    int board;
+
+    for (board = 0; board < multi->num_boards; board++) {
+        if (DEVICE_BUS(multi->board_addr[board]) == bus_id) {
+            boards |= BOARD_BIT(board);
+        }
+    }
+
+    return boards;
+}
+
+// Collect the 7-bit group addresses a board has enabled in MODE1, as read
+// back into its register cache (at most 4: ALLCALL and SUBADR1..3):
+static int enabled_group_addrs(int device_id, int *group_addrs) {
+    int regs[ALLCALLADR + 1];
+
+    int num_addrs = 0;
+
+    int group;
+    int ret;
+
+    if ((ret = read_register_cache(device_id, MODE1, regs,
+         ALLCALLADR + 1)) < 0) {
+        return ret;
+    }
+
+    if (regs[MODE1] & (0x01 << (ALLCALL >> 8))) {
+        group_addrs[num_addrs++] = regs[ALLCALLADR] >> 1;
+    }
+
+    for (group = 0; group < NUM_GROUPS; group++) {
+        if (regs[MODE1] & (0x01 << (sub_enable[group] >> 8))) {
+            group_addrs[num_addrs++] = regs[subadr_reg[group]] >> 1;
+        }
+    }
+
+    return num_addrs;
+}
+
+// Whether a board already uses addr as its hardware address on a bus:
+static int board_at_addr(struct pca9685_multi *multi, int bus_id, int addr) {
+    int board;
+
+    for (board = 0; board < multi->num_boards; board++) {
+        if (multi->board_addr[board] == DEVICE_ID(bus_id, addr)) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+// Probe one bus and add the boards found on it:
+static int discover_bus(struct pca9685_multi *multi, int bus_id) {
+    // Address book passed to returned by the function:
+    int address_book[127];
+
+    // Result of reading each address, and addresses some board answers
+    // to as a group:
+    int load_ret[127];
+    int group_book[127] = {0};
+
+    int group_addrs[NUM_GROUPS + 1];
+    int num_addrs;
+
+    int addr;
+    int i;
+    int ret;
+
+    if ((ret = bus_scan_on(bus_id, address_book)) < 0) {
+        return ret;
+    }
+
+    // Group addresses ack writes but not reads, so read everything that
+    // answered and see which group addresses the real boards have enabled:
+    for (addr = FIRST_BOARD_ADDR; addr <= LAST_BOARD_ADDR; addr++) {
+        if (address_book[addr] != 1) {
+            continue;
+        }
+
+        load_ret[addr] = init_register_cache(DEVICE_ID(bus_id, addr));
+
+        if (load_ret[addr] < 0) {
+            continue;
+        }
+
+        if ((num_addrs = enabled_group_addrs(DEVICE_ID(bus_id, addr),
+             group_addrs)) < 0) {
+            return num_addrs;
+        }
+
+        for (i = 0; i < num_addrs; i++) {
+            if ((group_addrs[i] != addr) && (group_addrs[i] < 127)) {
+                group_book[group_addrs[i]] = 1;
+            }
+        }
+    }
+
+    for (addr = FIRST_BOARD_ADDR; addr <= LAST_BOARD_ADDR; addr++) {
+        if (address_book[addr] != 1) {
+            continue;
+        }
+
+        // Another board answers here as a group, so this address can't
+        // name a single board:
+        if (group_book[addr]) {
+            PCA9685_LOG("0x%X on bus %d is a group address; skipped\n",
+                        addr, bus_id);
+            continue;
+        }
+
+        if (load_ret[addr] < 0) {
+            return load_ret[addr];
+        }
+
+        if (multi->num_boards == MAX_BOARDS) {
+            PCA9685_LOG("More than %d boards found; ignoring 0x%X\n",
+                        MAX_BOARDS, addr);
+            continue;
+        }
+
+        PCA9685_LOG("Board %d detected at 0x%X on bus %d\n",
+                    multi->num_boards, addr, bus_id);
+
+        multi->board_addr[multi->num_boards++] = DEVICE_ID(bus_id, addr);
+    }
+
+    return 0;
+}
+
+// Check whether every board in boards has the same image for an LED:
+static int same_on_boards(struct pca9685_multi *multi, int led_id,
+                          uint64_t boards) {
+    int reference = -1;
+
+    int board;
+    int i;
+
+    for (board = 0; board < multi->num_boards; board++) {
+        if (!(boards & BOARD_BIT(board))) {
+            continue;
+        }
+
+        if (reference < 0) {
+            reference = board;
+            continue;
+        }
+
+        for (i = led_id * LED_REG_BYTES; i < (led_id + 1) * LED_REG_BYTES;
+             i++) {
+            if (multi->led_bank[board][i] != multi->led_bank[reference][i]) {
+                return 0;
+            }
+        }
+    }
+
+    return 1;
+}
+
+// Write LEDs in led_mask once to a group address on one bus and record the
+// result in the cache of every board that responds to it:
+static int write_bus_group(struct pca9685_multi *multi, int group_id,
+                           uint64_t boards, int led_mask) {
+    int reference = -1;
+    int run_start;
+    int run_bytes;
+
+    int board;
+    int led_id;
+    int ret;
+
+    for (board = 0; board < multi->num_boards; board++) {
+        if (boards & BOARD_BIT(board)) {
+            reference = board;
+            break;
+        }
+    }
+
+    if (reference < 0) {
+        return 0;
+    }
+
+    led_id = 0;
+
+    while (led_id < NUM_LED_CHANNELS) {
+        if (!(led_mask & (1 << led_id))) {
+            led_id++;
+            continue;
+        }
+
+        // Collect a run of neighbouring LEDs for one auto-increment burst:
+        run_start = led_id;
+
+        while ((led_id < NUM_LED_CHANNELS) && (led_mask & (1 << led_id))) {
+            led_id++;
+        }
+
+        run_bytes = (led_id - run_start) * LED_REG_BYTES;
+
+        if ((ret = bus_write(group_id, LED_REG(run_start),
+             &multi->led_bank[reference][run_start * LED_REG_BYTES],
+             run_bytes)) < 0) {
+            return ret;
+        }
+
+        for (board = 0; board < multi->num_boards; board++) {
+            if (boards & BOARD_BIT(board)) {
+                update_register_cache(multi->board_addr[board],
+                    LED_REG(run_start),
+                    &multi->led_bank[reference][run_start * LED_REG_BYTES],
+                    run_bytes);
+            }
+        }
+    }
+
+    return 0;
+}
+
+// Same on every bus that has boards in the group (group_addr is 7-bit):
+static int write_group(struct pca9685_multi *multi, int group_addr,
+                       uint64_t boards, int led_mask) {
+    int bus_id;
+    int ret;
+
+    if (!led_mask) {
+        return 0;
+    }
+
+    for (bus_id = 0; bus_id < MAX_BUSES; bus_id++) {
+        if ((ret = write_bus_group(multi, DEVICE_ID(bus_id, group_addr),
+             boards & boards_on_bus(multi, bus_id), led_mask)) < 0) {
+            return ret;
+        }
+    }
+
+    return 0;
+}
+
+// No boards, default group addresses:
+static void reset_boards(struct pca9685_multi *multi) {
+    int group;
+
+    multi->num_boards = 0;
+    multi->allcall_addr = ALLCALLADR_DEFAULT >> 1;
+    multi->group_addr[0] = SUBADR1_DEFAULT >> 1;
+    multi->group_addr[1] = SUBADR2_DEFAULT >> 1;
+    multi->group_addr[2] = SUBADR3_DEFAULT >> 1;
+
+    for (group = 0; group < NUM_GROUPS; group++) {
+        multi->group_boards[group] = 0;
+    }
+}
+
+// Whether a board answers ALLCALL at addr, as its register cache says:
+static int answers_allcall(int device_id, int addr) {
+    int regs[ALLCALLADR + 1];
+
+    if (read_register_cache(device_id, MODE1, regs, ALLCALLADR + 1) < 0) {
+        return 0;
+    }
+
+    return (regs[MODE1] & (0x01 << (ALLCALL >> 8)))
+           && ((regs[ALLCALLADR] >> 1) == addr);
+}
+
+int discover_boards(struct pca9685_multi *multi) {
+    const int configs[2] = {AI, ALLCALL};
+
+    int num_configs = 2;
+
+    int board;
+    int bus_id;
+    int ret;
+
+    reset_boards(multi);
+
+    for (bus_id = 0; bus_id < MAX_BUSES; bus_id++) {
+        if (get_attached_bus(bus_id) == NULL) {
+            continue;
+        }
+
+        if ((ret = discover_bus(multi, bus_id)) < 0) {
+            return ret;
+        }
+    }
+
+    if (multi->num_boards == 0) {
+        PCA9685_LOG("No boards were detected\n");
+        return -1;
+    }
+
+    // A board sitting at the ALLCALL address would take every ALLCALL
+    // write as its own, so group writes go without ALLCALL then:
+    for (board = 0; board < multi->num_boards; board++) {
+        if (DEVICE_ADDR(multi->board_addr[board]) == multi->allcall_addr) {
+            PCA9685_LOG("Board at ALLCALL address 0x%X; ALLCALL unused\n",
+                        multi->allcall_addr);
+            multi->allcall_addr = -1;
+            num_configs = 1;
+            break;
+        }
+    }
+
+    // Group writes rely on auto-increment and ALLCALL on every board:
+    for (board = 0; board < multi->num_boards; board++) {
+        if ((ret = apply_mode1(multi->board_addr[board], configs,
+             num_configs)) < 0) {
+            return ret;
+        }
+    }
+
+    return 0;
+}
+
+int init_boards(struct pca9685_multi *multi, const int *board_addrs,
+                int num_boards) {
+    const int configs[1] = {AI};
+
+    int board;
+    int ret;
+
+    if ((num_boards < 1) || (num_boards > MAX_BOARDS)) {
+        return -1;
+    }
+
+    reset_boards(multi);
+
+    for (board = 0; board < num_boards; board++) {
+        if ((board_addrs[board] < 0) || (board_addrs[board] >= NUM_DEVICE_IDS)
+            || board_at_addr(multi, DEVICE_BUS(board_addrs[board]),
+                             DEVICE_ADDR(board_addrs[board]))) {
+            return -1;
+        }
+
+        multi->board_addr[multi->num_boards++] = board_addrs[board];
+    }
+
+    // ALLCALL only if every board already answers it and none sits at it:
+    for (board = 0; board < multi->num_boards; board++) {
+        if ((DEVICE_ADDR(multi->board_addr[board]) == multi->allcall_addr)
+            || !answers_allcall(multi->board_addr[board],
+                                multi->allcall_addr)) {
+            multi->allcall_addr = -1;
+        }
+    }
+
+    for (board = 0; board < multi->num_boards; board++) {
+        if ((ret = apply_mode1(multi->board_addr[board], configs, 1)) < 0) {
+            return ret;
+        }
+    }
+
+    return 0;
+}
+
+int set_board_group(struct pca9685_multi *multi, int group,
+                    uint64_t board_mask) {
+    int subadr_value[1];
+
+    int board;
+    int ret;
+
+    if ((group < 0) || (group >= NUM_GROUPS)
+        || (board_mask & ~all_boards(multi))) {
+        return -1;
+    }
+
+    // The group address must not be a board's own address:
+    for (board = 0; board < multi->num_boards; board++) {
+        if ((board_mask & BOARD_BIT(board))
+            && board_at_addr(multi, DEVICE_BUS(multi->board_addr[board]),
+                             multi->group_addr[group])) {
+            return -1;
+        }
+    }
+
+    // Register holds the 8-bit form of the address:
+    subadr_value[0] = multi->group_addr[group] << 1;
+
+    for (board = 0; board < multi->num_boards; board++) {
+        if (board_mask & BOARD_BIT(board)) {
+            if ((ret = write_register_cache(multi->board_addr[board],
+                 subadr_reg[group], subadr_value, 1)) < 0) {
+                return ret;
+            }
+
+            ret = apply_mode1(multi->board_addr[board], &sub_enable[group], 1);
+        } else {
+            ret = apply_mode1(multi->board_addr[board], &sub_disable[group], 1);
+        }
+
+        if (ret < 0) {
+            return ret;
+        }
+    }
+
+    multi->group_boards[group] = board_mask;
+
+    return 0;
+}
+
+int set_multi_duty_cycle(struct pca9685_multi *multi, int channel,
+                         int duty_cycle) {
+    int board = channel / NUM_LED_CHANNELS;
+    int led_id = channel % NUM_LED_CHANNELS;
+
+    if ((channel < 0) || (board >= multi->num_boards)) {
+        return -1;
+    }
+
+    return set_pwm_duty_cycles_mask(multi->board_addr[board], 1 << led_id,
+                                    &duty_cycle);
+}
+
+int set_multi_duty_cycles(struct pca9685_multi *multi, int *duty_cycles) {
+    int current_bank[LED_BANK_BYTES];
+    int led_delay_times[NUM_LED_CHANNELS];
+
+    // Boards that need each LED updated:
+    uint64_t dirty[NUM_LED_CHANNELS] = {0};
+
+    int allcall_leds = 0;
+    int group_leds[NUM_GROUPS] = {0};
+
+    uint64_t members;
+
+    int board;
+    int led_id;
+    int group;
+    int i;
+    int ret;
+
+    // Build each board's LED image and note which LEDs changed:
+    for (board = 0; board < multi->num_boards; board++) {
+        if ((ret = read_register_cache(multi->board_addr[board], LED0_ON_L,
+             current_bank, LED_BANK_BYTES)) < 0) {
+            return ret;
+        }
+
+        if ((ret = get_channel_phases(multi->board_addr[board],
+             led_delay_times)) < 0) {
+            return ret;
+        }
+
+        encode_pwm_bank(&duty_cycles[board * NUM_LED_CHANNELS],
+                        led_delay_times, multi->led_bank[board]);
+
+        for (led_id = 0; led_id < NUM_LED_CHANNELS; led_id++) {
+            for (i = led_id * LED_REG_BYTES;
+                 i < (led_id + 1) * LED_REG_BYTES; i++) {
+                if (multi->led_bank[board][i] != current_bank[i]) {
+                    dirty[led_id] |= BOARD_BIT(board);
+                    break;
+                }
+            }
+        }
+    }
+
+    // Pick the widest group address that can carry each changed LED:
+    for (led_id = 0; led_id < NUM_LED_CHANNELS; led_id++) {
+        if (!dirty[led_id]) {
+            continue;
+        }
+
+        if ((multi->num_boards > 1) && (multi->allcall_addr >= 0)
+            && same_on_boards(multi, led_id, all_boards(multi))) {
+            allcall_leds |= 1 << led_id;
+            continue;
+        }
+
+        for (group = 0; group < NUM_GROUPS; group++) {
+            members = multi->group_boards[group];
+
+            // A group only pays off with at least two boards in it:
+            if (!(members & (members - 1)) || !(dirty[led_id] & members)) {
+                continue;
+            }
+
+            if (same_on_boards(multi, led_id, members)) {
+                group_leds[group] |= 1 << led_id;
+                dirty[led_id] &= ~members;
+            }
+        }
+    }
+
+    if ((ret = write_group(multi, multi->allcall_addr, all_boards(multi),
+         allcall_leds)) < 0) {
+        return ret;
+    }
+
+    for (group = 0; group < NUM_GROUPS; group++) {
+        if ((ret = write_group(multi, multi->group_addr[group],
+             multi->group_boards[group], group_leds[group])) < 0) {
+            return ret;
+        }
+    }
+
+    // Whatever is left differs per board; the cache now skips the LEDs
+    // already covered by group writes:
+    for (board = 0; board < multi->num_boards; board++) {
+        if ((ret = write_led_bank(multi->board_addr[board],
+             multi->led_bank[board])) < 0) {
+            return ret;
+        }
+    }
+
+    return 0;
+}
+
+int retune_boards(struct pca9685_multi *multi, int frequency) {
+    // discover_boards() turned on ALLCALL on every board (unless
+    // allcall_addr is -1):
+    return retune_devices(multi->num_boards, multi->board_addr,
+                          multi->allcall_addr, frequency);
+}
+
+int emergency_stop(struct pca9685_multi *multi) {
+    int full_off[1] = {PWM_FULL_BIT};
+
+    uint64_t stopped = 0;
+
+    int board;
+    int bus_id;
+    int ret = 0;
+    int error;
+
+    // Without ALLCALL each board gets its own byte:
+    if (multi->allcall_addr < 0) {
+        for (board = 0; board < multi->num_boards; board++) {
+            if ((error = blackout(multi->board_addr[board])) < 0) {
+                ret = (ret < 0) ? ret : error;
+            }
+        }
+
+        return ret;
+    }
+
+    // discover_boards() turned on ALLCALL on every board, so one byte per
+    // bus reaches all of them; keep going past a bus that fails:
+    for (bus_id = 0; bus_id < MAX_BUSES; bus_id++) {
+        if (!boards_on_bus(multi, bus_id)) {
+            continue;
+        }
+
+        if ((error = bus_write(DEVICE_ID(bus_id, multi->allcall_addr),
+             ALL_LED_OFF_H, full_off, 1)) < 0) {
+            ret = (ret < 0) ? ret : error;
+            continue;
+        }
+
+        stopped |= boards_on_bus(multi, bus_id);
+    }
+
+    // Bookkeeping only once every bus has been told:
+    for (board = 0; board < multi->num_boards; board++) {
+        if (stopped & BOARD_BIT(board)) {
+            update_register_cache(multi->board_addr[board], ALL_LED_OFF_H,
+                                  full_off, 1);
+        }
+    }
+
+    return ret;
+}
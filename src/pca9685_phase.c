@@ -0,0 +1,208 @@
+// Raspberry Pi PCA9685 Example
+//
+// Copyright (c) 2022 Benjamin Spencer
+// ============================================================================
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+// ============================================================================
+
+// Include C standard libraries:
+#include <stdint.h> // C Standard integer types
+
+#include "pca9685_cache.h"  // PCA9685 shadow register cache
+#include "pca9685_encode.h" // PCA9685 duty cycle encoder
+#include "pca9685_phase.h"  // PCA9685 phase scheduler
+
+// Round robin spacing between channels:
+#define PHASE_STEP (PWM_COUNTS / NUM_LED_CHANNELS)
+
+// ON delays of each device; devices that never had phases set use the
+// default delay:
+static int channel_phases[NUM_DEVICE_IDS][NUM_LED_CHANNELS];
+static int phases_set[NUM_DEVICE_IDS];
+
+static int check_channel(int device_addr, int led_id) {
+    if ((device_addr < 0) || (device_addr >= NUM_DEVICE_IDS)) {
+        return -1;
+    }
+
+    if ((led_id < 0) || (led_id >= NUM_LED_CHANNELS)) {
+        return -1;
+    }
+
+    return 0;
+}
+
+// Start a device off with every channel at the default delay:
+static void load_phase_defaults(int device_addr) {
+    int led_id;
+
+    if (phases_set[device_addr]) {
+        return;
+    }
+
+    for (led_id = 0; led_id < NUM_LED_CHANNELS; led_id++) {
+        channel_phases[device_addr][led_id] = PWM_DEFAULT_DELAY;
+    }
+
+    phases_set[device_addr] = 1;
+}
+
+int set_channel_phase(int device_addr, int led_id, int led_delay_time) {
+    if ((check_channel(device_addr, led_id) < 0) || (led_delay_time < 0)
+        || (led_delay_time >= PWM_COUNTS)) {
+        return -1;
+    }
+
+    load_phase_defaults(device_addr);
+
+    channel_phases[device_addr][led_id] = led_delay_time;
+
+    return 0;
+}
+
+int get_channel_phase(int device_addr, int led_id) {
+    if (check_channel(device_addr, led_id) < 0) {
+        return -1;
+    }
+
+    load_phase_defaults(device_addr);
+
+    return channel_phases[device_addr][led_id];
+}
+
+int get_channel_phases(int device_addr, int *led_delay_times) {
+    int led_id;
+
+    if (check_channel(device_addr, 0) < 0) {
+        return -1;
+    }
+
+    load_phase_defaults(device_addr);
+
+    for (led_id = 0; led_id < NUM_LED_CHANNELS; led_id++) {
+        led_delay_times[led_id] = channel_phases[device_addr][led_id];
+    }
+
+    return 0;
+}
+
+int schedule_phases(int device_addr, int *duty_cycles, int strategy) {
+    int next_phase = 0;
+
+    int led_id;
+
+    if (check_channel(device_addr, 0) < 0) {
+        return -1;
+    }
+
+    load_phase_defaults(device_addr);
+
+    for (led_id = 0; led_id < NUM_LED_CHANNELS; led_id++) {
+        switch (strategy) {
+            case PHASE_FIXED:
+                channel_phases[device_addr][led_id] = PWM_DEFAULT_DELAY;
+                break;
+            case PHASE_ROUND_ROBIN:
+                channel_phases[device_addr][led_id] = led_id * PHASE_STEP;
+                break;
+            case PHASE_LOAD_BALANCED:
+                // Fully on or off channels have no edges to place:
+                if ((duty_cycles[led_id] <= 0)
+                    || (duty_cycles[led_id] >= PWM_FULL_SCALE)) {
+                    channel_phases[device_addr][led_id] = 0;
+                    break;
+                }
+
+                // Pack channels back to back so each turns on as the one
+                // before turns off; the on-time is spread evenly over the
+                // frame and the peak is as low as the total duty allows:
+                channel_phases[device_addr][led_id] = next_phase;
+                next_phase = (next_phase + duty_cycles[led_id])
+                             & (PWM_COUNTS - 1);
+                break;
+            default:
+                return -1;
+        }
+    }
+
+    return 0;
+}
+
+int get_phase_stats(int *duty_cycles, int *led_delay_times,
+                    struct phase_stats *stats) {
+    // Change in channels on at each tick, and channels turning on:
+    int16_t on_delta[PWM_COUNTS + 1] = {0};
+    uint8_t rising[PWM_COUNTS] = {0};
+
+    uint32_t images[NUM_LED_CHANNELS];
+
+    int led_on_time;
+    int led_off_time;
+    int always_on = 0;
+    int channels_on;
+
+    int led_id;
+    int tick;
+
+    encode_pwm_images(duty_cycles, led_delay_times, images);
+
+    for (led_id = 0; led_id < NUM_LED_CHANNELS; led_id++) {
+        // Same ON/OFF counts (and wrapping) that get written to the device:
+        if (images[led_id] & PWM_FULL_OFF) {
+            continue;
+        }
+
+        if (images[led_id] & PWM_FULL_ON) {
+            always_on++;
+            continue;
+        }
+
+        led_on_time = images[led_id] & (PWM_COUNTS - 1);
+        led_off_time = (images[led_id] >> 16) & (PWM_COUNTS - 1);
+
+        on_delta[led_on_time]++;
+        on_delta[led_off_time]--;
+        rising[led_on_time]++;
+
+        // On time wraps past the end of the frame:
+        if (led_off_time < led_on_time) {
+            on_delta[0]++;
+            on_delta[PWM_COUNTS]--;
+        }
+    }
+
+    stats->peak_on = 0;
+    stats->peak_edges = 0;
+
+    channels_on = always_on;
+
+    for (tick = 0; tick < PWM_COUNTS; tick++) {
+        channels_on += on_delta[tick];
+
+        if (channels_on > stats->peak_on) {
+            stats->peak_on = channels_on;
+        }
+
+        if (rising[tick] > stats->peak_edges) {
+            stats->peak_edges = rising[tick];
+        }
+    }
+
+    return 0;
+}
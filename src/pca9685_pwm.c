@@ -0,0 +1,233 @@
+// Raspberry Pi PCA9685 Example
+//
+// Copyright (c) 2022 Benjamin Spencer
+// ============================================================================
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+// ============================================================================
+
+// Include C standard libraries:
+#include <stdio.h> // C Standard I/O libary
+
+#include "pca9685_registers.h" // PCA9685 register definitions
+#include "pca9685_bus.h"       // PCA9685 bus backend
+#include "pca9685_cache.h"     // PCA9685 shadow register cache
+#include "pca9685_pwm.h"       // PCA9685 PWM output helpers
+#include "pca9685_phase.h"     // PCA9685 phase scheduler
+
+// MODE1 auto-increment bit (page 14):
+#define MODE1_AI_BIT (0x01 << 5)
+
+#define ALL_CHANNELS ((1 << NUM_LED_CHANNELS) - 1)
+
+// Unchanged bytes between two dirty runs are resent rather than starting a
+// new transaction when that is cheaper (address + register bytes plus the
+// stop and start conditions):
+#define RUN_MERGE_GAP 2
+
+// Whether two duty cycles are both fully off or both fully on:
+static int same_full_state(int duty_cycle_a, int duty_cycle_b) {
+    return ((duty_cycle_a <= 0) && (duty_cycle_b <= 0))
+           || ((duty_cycle_a >= PWM_FULL_SCALE)
+               && (duty_cycle_b >= PWM_FULL_SCALE));
+}
+
+int write_led_runs(int device_addr, int *led_bank, const int *dirty,
+                   int max_gap, int *bytes_sent) {
+    int run_start = -1;
+    int run_end = -1;
+    int transactions = 0;
+
+    int i;
+    int ret;
+
+    for (i = 0; i <= LED_BANK_BYTES; i++) {
+        if ((i < LED_BANK_BYTES) && !dirty[i]) {
+            continue;
+        }
+
+        // End of the bank, or a gap too big to resend; flush the run:
+        if ((run_start >= 0)
+            && ((i == LED_BANK_BYTES) || (i - run_end - 1 > max_gap))) {
+            if ((ret = write_register_cache(device_addr, LED0_ON_L + run_start,
+                 &led_bank[run_start], run_end - run_start + 1)) < 0) {
+                return ret;
+            }
+
+            transactions++;
+
+            if (bytes_sent != NULL) {
+                *bytes_sent += run_end - run_start + 1;
+            }
+
+            run_start = -1;
+        }
+
+        if (i == LED_BANK_BYTES) {
+            break;
+        }
+
+        if (run_start < 0) {
+            run_start = i;
+        }
+
+        run_end = i;
+    }
+
+    return transactions;
+}
+
+int write_led_bank(int device_addr, int *led_bank) {
+    int current_bank[LED_BANK_BYTES];
+    int dirty[LED_BANK_BYTES];
+
+    int i;
+    int ret;
+
+    if ((ret = read_register_cache(device_addr, LED0_ON_L, current_bank,
+         LED_BANK_BYTES)) < 0) {
+        return ret;
+    }
+
+    for (i = 0; i < LED_BANK_BYTES; i++) {
+        dirty[i] = (led_bank[i] != current_bank[i]);
+    }
+
+    if ((ret = write_led_runs(device_addr, led_bank, dirty, RUN_MERGE_GAP,
+         NULL)) < 0) {
+        return ret;
+    }
+
+    return 0;
+}
+
+int set_pwm_duty_cycles_mask(int device_addr, int channel_mask,
+                             int *duty_cycles) {
+    int current_bank[LED_BANK_BYTES];
+    int led_bank[LED_BANK_BYTES];
+    int led_delay_times[NUM_LED_CHANNELS];
+
+    int led_id;
+    int i;
+    int ret;
+
+    if ((channel_mask & ~ALL_CHANNELS) != 0) {
+        return -1;
+    }
+
+    // Every channel fully off or fully on is a single ALL_LED write:
+    if (channel_mask == ALL_CHANNELS) {
+        for (led_id = 1; led_id < NUM_LED_CHANNELS; led_id++) {
+            if (!same_full_state(duty_cycles[0], duty_cycles[led_id])) {
+                break;
+            }
+        }
+
+        if ((led_id == NUM_LED_CHANNELS) && (duty_cycles[0] <= 0)) {
+            return blackout(device_addr);
+        }
+
+        if ((led_id == NUM_LED_CHANNELS)
+            && (duty_cycles[0] >= PWM_FULL_SCALE)) {
+            return set_all_duty_cycle(device_addr, PWM_FULL_SCALE);
+        }
+    }
+
+    // Start from what the device already has:
+    if ((ret = read_register_cache(device_addr, LED0_ON_L, current_bank,
+         LED_BANK_BYTES)) < 0) {
+        return ret;
+    }
+
+    for (i = 0; i < LED_BANK_BYTES; i++) {
+        led_bank[i] = current_bank[i];
+    }
+
+    if ((ret = get_channel_phases(device_addr, led_delay_times)) < 0) {
+        return ret;
+    }
+
+    for (led_id = 0; led_id < NUM_LED_CHANNELS; led_id++) {
+        if (channel_mask & (1 << led_id)) {
+            encode_pwm_update(*duty_cycles++, led_delay_times[led_id],
+                              &led_bank[led_id * LED_REG_BYTES]);
+        }
+    }
+
+    return write_led_bank(device_addr, led_bank);
+}
+
+int set_pwm_duty_cycles(int device_addr, int *duty_cycles, int num_leds) {
+    if ((num_leds < 1) || (num_leds > NUM_LED_CHANNELS)) {
+        return -1;
+    }
+
+    return set_pwm_duty_cycles_mask(device_addr, (1 << num_leds) - 1,
+                                    duty_cycles);
+}
+
+// Write ALL_LED registers and record the result in every LEDn register.
+// Reads of ALL_LED return nothing useful so the cache can't tell whether
+// the write is needed; it always goes out:
+static int write_all_led(int device_addr, int reg_addr, int *data,
+                         int bytes) {
+    int mode1[1] = {0};
+
+    int i;
+    int ret;
+
+    if ((ret = read_register_cache(device_addr, MODE1, mode1, 1)) < 0) {
+        return ret;
+    }
+
+    if ((bytes == 1) || (mode1[0] & MODE1_AI_BIT)) {
+        if ((ret = bus_write(device_addr, reg_addr, data, bytes)) < 0) {
+            return ret;
+        }
+    } else {
+        for (i = 0; i < bytes; i++) {
+            if ((ret = bus_write(device_addr, reg_addr + i, &data[i],
+                 1)) < 0) {
+                return ret;
+            }
+        }
+    }
+
+    return update_register_cache(device_addr, reg_addr, data, bytes);
+}
+
+int set_all_duty_cycle(int device_addr, int duty_cycle) {
+    int led_register_values[LED_REG_BYTES];
+
+    if (duty_cycle <= 0) {
+        return blackout(device_addr);
+    }
+
+    // One delay for every channel; ALL_LED can't stagger them:
+    encode_pwm_registers(duty_cycle, PWM_DEFAULT_DELAY, led_register_values);
+
+    return write_all_led(device_addr, ALL_LED_ON_L, led_register_values,
+                         LED_REG_BYTES);
+}
+
+int blackout(int device_addr) {
+    int full_off[1] = {PWM_FULL_BIT};
+
+    // The full OFF bit overrides everything else in the channel:
+    return write_all_led(device_addr, ALL_LED_OFF_H, full_off, 1);
+}
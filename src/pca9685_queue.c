@@ -0,0 +1,294 @@
+// Raspberry Pi PCA9685 Example
+//
+// Copyright (c) 2022 Benjamin Spencer
+// ============================================================================
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+// ============================================================================
+
+// Include C standard libraries:
+#include <stdint.h>    // C Standard integer types
+#include <stdatomic.h> // C Standard atomic operations
+#include <pthread.h>   // POSIX threads
+#include <semaphore.h> // POSIX semaphores
+#include <time.h>      // C Standard date and time manipulation
+
+#include "pca9685_registers.h" // PCA9685 register definitions
+#include "pca9685_cache.h"     // PCA9685 shadow register cache
+#include "pca9685_encode.h"    // PCA9685 duty cycle encoder
+#include "pca9685_pwm.h"       // PCA9685 PWM output helpers
+#include "pca9685_phase.h"     // PCA9685 phase scheduler
+#include "pca9685_verify.h"    // PCA9685 readback verification
+#include "pca9685_queue.h"     // PCA9685 asynchronous command queue
+
+#define QUEUE_MASK (QUEUE_SIZE - 1)
+
+// Wait for a command. With a verifier, idle time goes to readback one
+// short read at a time, checking for commands in between, and the worker
+// only sleeps once the bus time budget is spent:
+static int wait_for_command(struct pca9685_queue *queue) {
+    struct timespec deadline;
+
+    uint64_t idle_ns;
+
+    if (queue->verify == NULL) {
+        return sem_wait(&queue->pending);
+    }
+
+    for (;;) {
+        if (sem_trywait(&queue->pending) == 0) {
+            return 0;
+        }
+
+        // Errors are counted in the verifier's stats:
+        if (verify_step(queue->verify) != 0) {
+            continue;
+        }
+
+        idle_ns = verify_idle_ns(queue->verify);
+
+        // sem_timedwait() only takes the realtime clock:
+        clock_gettime(CLOCK_REALTIME, &deadline);
+
+        deadline.tv_sec += idle_ns / 1000000000u;
+        deadline.tv_nsec += idle_ns % 1000000000u;
+
+        if (deadline.tv_nsec >= 1000000000) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000;
+        }
+
+        if (sem_timedwait(&queue->pending, &deadline) == 0) {
+            return 0;
+        }
+    }
+}
+
+// A newer write is queued for the command's channel (a bank: for every
+// channel of the device):
+static int is_stale(struct pca9685_queue *queue,
+                    struct queue_command *command) {
+    int led_id;
+
+    if (command->led_id < 0) {
+        return 0;
+    }
+
+    if (command->led_id != QUEUE_ALL_LEDS) {
+        return atomic_load_explicit(
+            &queue->latest[command->device_addr][command->led_id],
+            memory_order_acquire) != command->sequence;
+    }
+
+    for (led_id = 0; led_id < NUM_LED_CHANNELS; led_id++) {
+        if (atomic_load_explicit(&queue->latest[command->device_addr][led_id],
+            memory_order_acquire) == command->sequence) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+// Drain the ring onto the bus until the queue is stopped and empty:
+static void *queue_worker(void *arg) {
+    struct pca9685_queue *queue = arg;
+    struct queue_command *command;
+
+    queue_callback callback;
+    void *context;
+
+    unsigned int head;
+    unsigned int tail;
+
+    int status;
+
+    for (;;) {
+        if (wait_for_command(queue) < 0) {
+            // Interrupted by a signal; nothing was taken:
+            continue;
+        }
+
+        tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+        head = atomic_load_explicit(&queue->head, memory_order_acquire);
+
+        if (tail == head) {
+            if (!atomic_load(&queue->running)) {
+                break;
+            }
+
+            continue;
+        }
+
+        command = &queue->commands[tail & QUEUE_MASK];
+
+        if (is_stale(queue, command)) {
+            // A newer setpoint for this channel is already queued:
+            status = QUEUE_STALE;
+        } else if ((status = write_register_cache(command->device_addr,
+                    command->reg_addr, command->data, command->bytes)) >= 0) {
+            status = QUEUE_DONE;
+        }
+
+        callback = command->callback;
+        context = command->context;
+
+        // Hand the slot back before the callback so it can queue more:
+        atomic_store_explicit(&queue->tail, tail + 1, memory_order_release);
+
+        if (callback != NULL) {
+            callback(status, context);
+        }
+    }
+
+    return NULL;
+}
+
+static int enqueue(struct pca9685_queue *queue, int device_addr,
+                   int reg_addr, int *data, int bytes, int led_id,
+                   queue_callback callback, void *context) {
+    struct queue_command *command;
+
+    unsigned int head;
+    unsigned int tail;
+
+    int i;
+
+    if ((device_addr < 0) || (device_addr >= NUM_DEVICE_IDS)
+        || (bytes < 1) || (bytes > QUEUE_MAX_BYTES)) {
+        return -1;
+    }
+
+    head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+
+    // Ring is full:
+    if (head - tail == QUEUE_SIZE) {
+        return -1;
+    }
+
+    command = &queue->commands[head & QUEUE_MASK];
+
+    command->device_addr = device_addr;
+    command->reg_addr = reg_addr;
+    command->bytes = bytes;
+    command->led_id = led_id;
+    command->sequence = queue->next_sequence++;
+    command->callback = callback;
+    command->context = context;
+
+    for (i = 0; i < bytes; i++) {
+        command->data[i] = data[i];
+    }
+
+    // Anything older for this channel (or every channel) is now stale:
+    if (led_id == QUEUE_ALL_LEDS) {
+        for (i = 0; i < NUM_LED_CHANNELS; i++) {
+            atomic_store_explicit(&queue->latest[device_addr][i],
+                                  command->sequence, memory_order_release);
+        }
+    } else if (led_id >= 0) {
+        atomic_store_explicit(&queue->latest[device_addr][led_id],
+                              command->sequence, memory_order_release);
+    }
+
+    atomic_store_explicit(&queue->head, head + 1, memory_order_release);
+
+    sem_post(&queue->pending);
+
+    return 0;
+}
+
+int start_queue(struct pca9685_queue *queue) {
+    return start_verified_queue(queue, NULL);
+}
+
+int start_verified_queue(struct pca9685_queue *queue,
+                         struct pca9685_verify *verify) {
+    int device_addr;
+    int led_id;
+
+    atomic_init(&queue->head, 0);
+    atomic_init(&queue->tail, 0);
+    atomic_init(&queue->running, 1);
+
+    queue->next_sequence = 1;
+    queue->verify = verify;
+
+    for (device_addr = 0; device_addr < NUM_DEVICE_IDS; device_addr++) {
+        for (led_id = 0; led_id < NUM_LED_CHANNELS; led_id++) {
+            atomic_init(&queue->latest[device_addr][led_id], 0);
+        }
+    }
+
+    if (sem_init(&queue->pending, 0, 0) < 0) {
+        return -1;
+    }
+
+    if (pthread_create(&queue->worker, NULL, queue_worker, queue) != 0) {
+        sem_destroy(&queue->pending);
+        return -1;
+    }
+
+    return 0;
+}
+
+int stop_queue(struct pca9685_queue *queue) {
+    atomic_store(&queue->running, 0);
+
+    // Wake the worker in case it is idle:
+    sem_post(&queue->pending);
+
+    if (pthread_join(queue->worker, NULL) != 0) {
+        return -1;
+    }
+
+    sem_destroy(&queue->pending);
+
+    return 0;
+}
+
+int queue_write(struct pca9685_queue *queue, int device_addr, int reg_addr,
+                int *data, int bytes, queue_callback callback,
+                void *context) {
+    return enqueue(queue, device_addr, reg_addr, data, bytes, -1, callback,
+                   context);
+}
+
+int queue_duty_cycle(struct pca9685_queue *queue, int device_addr,
+                     int led_id, int duty_cycle, queue_callback callback,
+                     void *context) {
+    int led_register_values[LED_REG_BYTES];
+
+    int led_delay_time;
+
+    if ((led_delay_time = get_channel_phase(device_addr, led_id)) < 0) {
+        return -1;
+    }
+
+    encode_pwm_registers(duty_cycle, led_delay_time, led_register_values);
+
+    return enqueue(queue, device_addr, LED_REG(led_id), led_register_values,
+                   LED_REG_BYTES, led_id, callback, context);
+}
+
+int queue_led_bank(struct pca9685_queue *queue, int device_addr,
+                   int *led_bank, queue_callback callback, void *context) {
+    return enqueue(queue, device_addr, LED0_ON_L, led_bank, LED_BANK_BYTES,
+                   QUEUE_ALL_LEDS, callback, context);
+}
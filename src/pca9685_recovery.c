@@ -0,0 +1,360 @@
+// Raspberry Pi PCA9685 Example
+//
+// Copyright (c) 2022 Benjamin Spencer
+// ============================================================================
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+// ============================================================================
+
+// Include C standard libraries:
+#include <stdio.h>  // C Standard I/O libary
+#include <stdint.h> // C Standard integer types
+#include <string.h> // C Standard string manipulation
+#include <time.h>   // C Standard date and time manipulation
+
+#include <pi_i2c.h> // Pi I2C library! (error codes)
+
+#include "pca9685_log.h"      // PCA9685 driver logging
+#include "pca9685_bus.h"      // PCA9685 bus backend
+#include "pca9685_cache.h"    // PCA9685 shadow register cache
+#include "pca9685_metrics.h"  // PCA9685 bus metrics
+#include "pca9685_recovery.h" // PCA9685 bus recovery
+
+// Software reset: general call address followed by SWRST (page 7):
+#define GENERAL_CALL_ADDR 0x00
+#define SWRST_DATA 0x06
+
+#define NS_PER_MS 1000000
+
+#define TRANSFER_READ 0
+#define TRANSFER_WRITE 1
+#define TRANSFER_SCAN 2
+
+struct transfer {
+    int type;
+    int device_addr; // -1 for a scan
+    int reg_addr;
+    int *data;
+    int bytes;
+};
+
+// Tier each error class starts at:
+static const int first_tier[RECOVERY_CLASSES] = {
+    RECOVERY_RETRY, RECOVERY_BUS_CLEAR, RECOVERY_SOFT_RESET
+};
+
+static int run_transfer(struct pca9685_recovery *recovery,
+                        struct transfer *transfer) {
+    const struct pca9685_bus *target = recovery->target;
+
+    switch (transfer->type) {
+        case TRANSFER_READ:
+            return target->read(target->context, transfer->device_addr,
+                                transfer->reg_addr, transfer->data,
+                                transfer->bytes);
+        case TRANSFER_WRITE:
+            return target->write(target->context, transfer->device_addr,
+                                 transfer->reg_addr, transfer->data,
+                                 transfer->bytes);
+        default:
+            return target->scan(target->context, transfer->data);
+    }
+}
+
+static struct recovery_device *get_device(struct pca9685_recovery *recovery,
+                                          int device_addr) {
+    if ((device_addr < 0) || (device_addr >= NUM_DEVICE_ADDR)) {
+        return NULL;
+    }
+
+    return &recovery->devices[device_addr];
+}
+
+// Wait on the failing backend itself (it needn't be an attached bus):
+static void backoff(struct pca9685_recovery *recovery, int usec) {
+    const struct pca9685_bus *target = recovery->target;
+
+    struct timespec wait;
+
+    if (target->delay != NULL) {
+        target->delay(target->context, usec);
+        return;
+    }
+
+    wait.tv_sec = usec / 1000000;
+    wait.tv_nsec = (usec % 1000000) * 1000;
+
+    while (nanosleep(&wait, &wait) < 0) {
+        // Interrupted; sleep for what is left
+    }
+}
+
+// Take one recovery step; returns -1 if the bus can't do it:
+static int run_tier(struct pca9685_recovery *recovery, int tier) {
+    const struct pca9685_bus *target = recovery->target;
+
+    int swrst[1] = {0};
+
+    int ret;
+
+    switch (tier) {
+        case RECOVERY_BUS_CLEAR:
+            if (target->bus_clear == NULL) {
+                return -1;
+            }
+
+            return target->bus_clear(target->context);
+        case RECOVERY_SOFT_RESET:
+            // Resets every PCA9685 on the bus, not just the one failing:
+            if ((ret = target->write(target->context, GENERAL_CALL_ADDR,
+                 SWRST_DATA, swrst, 0)) < 0) {
+                return ret;
+            }
+
+            break;
+        case RECOVERY_POWER_CYCLE:
+            if (target->power_cycle == NULL) {
+                return -1;
+            }
+
+            if ((ret = target->power_cycle(target->context)) < 0) {
+                return ret;
+            }
+
+            break;
+        default:
+            return 0;
+    }
+
+    // Every device on the bus is back at its power-on defaults:
+    restore_bus_registers(recovery->bus_id);
+
+    return 0;
+}
+
+static int recover(struct pca9685_recovery *recovery,
+                   struct transfer *transfer, int ret) {
+    struct recovery_policy *policy = &recovery->policy;
+
+    int error_class = recovery_error_class(ret);
+    int tier;
+    int retry;
+
+    recovery->stats.errors[error_class]++;
+    recovery->recovering = 1;
+
+    for (tier = first_tier[error_class]; tier <= policy->max_tier; tier++) {
+        recovery->stats.attempts[tier]++;
+
+        if (tier == RECOVERY_RETRY) {
+            for (retry = 0; (retry < policy->max_retries) && (ret < 0);
+                 retry++) {
+                backoff(recovery, policy->backoff_us << retry);
+                ret = run_transfer(recovery, transfer);
+            }
+        } else if (run_tier(recovery, tier) == 0) {
+            ret = run_transfer(recovery, transfer);
+        }
+
+        if (ret >= 0) {
+            recovery->stats.recovered[tier]++;
+
+            if (tier > RECOVERY_RETRY) {
+                PCA9685_LOG("I2C error recovered at tier %d\n", tier + 1);
+            }
+
+            break;
+        }
+    }
+
+    recovery->recovering = 0;
+
+    return ret;
+}
+
+static int transfer_with_recovery(struct pca9685_recovery *recovery,
+                                  struct transfer *transfer) {
+    struct recovery_device *device = get_device(recovery,
+                                                transfer->device_addr);
+
+    int half_open = 0;
+    int ret;
+
+    // Nested transfers from a recovery step (e.g. restoring registers):
+    if (recovery->recovering) {
+        return run_transfer(recovery, transfer);
+    }
+
+    if ((device != NULL) && device->open_until_ns) {
+        if (metrics_now() < device->open_until_ns) {
+            recovery->stats.rejected++;
+            return -EDEVICEHUNG;
+        }
+
+        half_open = 1;
+    }
+
+    if ((ret = run_transfer(recovery, transfer)) >= 0) {
+        if (device != NULL) {
+            device->failures = 0;
+            device->open_until_ns = 0;
+        }
+
+        return ret;
+    }
+
+    // A device on probation doesn't get to reset the whole bus again:
+    if (!half_open) {
+        ret = recover(recovery, transfer, ret);
+    } else {
+        recovery->stats.errors[recovery_error_class(ret)]++;
+    }
+
+    if (device == NULL) {
+        return ret;
+    }
+
+    if (ret >= 0) {
+        device->failures = 0;
+        device->open_until_ns = 0;
+        return ret;
+    }
+
+    recovery->stats.unrecovered++;
+
+    if (half_open
+        || (++device->failures >= recovery->policy.breaker_threshold)) {
+        if (!half_open) {
+            recovery->stats.breaker_trips++;
+
+            PCA9685_LOG("Device 0x%X taken out of service after error %d\n",
+                        transfer->device_addr, ret);
+        }
+
+        device->open_until_ns = metrics_now()
+            + (uint64_t) recovery->policy.breaker_ms * NS_PER_MS;
+    }
+
+    return ret;
+}
+
+static int recovery_read(void *context, int device_addr, int reg_addr,
+                         int *data, int bytes) {
+    struct transfer transfer = {TRANSFER_READ, device_addr, reg_addr, data,
+                                bytes};
+
+    return transfer_with_recovery(context, &transfer);
+}
+
+static int recovery_write(void *context, int device_addr, int reg_addr,
+                          int *data, int bytes) {
+    struct transfer transfer = {TRANSFER_WRITE, device_addr, reg_addr, data,
+                                bytes};
+
+    return transfer_with_recovery(context, &transfer);
+}
+
+static int recovery_scan(void *context, int *address_book) {
+    struct transfer transfer = {TRANSFER_SCAN, -1, 0, address_book, 0};
+
+    return transfer_with_recovery(context, &transfer);
+}
+
+static int recovery_power_cycle(void *context) {
+    struct pca9685_recovery *recovery = context;
+
+    return recovery->target->power_cycle(recovery->target->context);
+}
+
+static int recovery_bus_clear(void *context) {
+    struct pca9685_recovery *recovery = context;
+
+    return recovery->target->bus_clear(recovery->target->context);
+}
+
+static int recovery_delay(void *context, int usec) {
+    struct pca9685_recovery *recovery = context;
+
+    return recovery->target->delay(recovery->target->context, usec);
+}
+
+void init_recovery(struct pca9685_recovery *recovery, int bus_id,
+                   const struct pca9685_bus *target) {
+    memset(recovery, 0, sizeof(*recovery));
+
+    recovery->target = target;
+    recovery->bus_id = bus_id;
+
+    recovery->policy.max_retries = 3;
+    recovery->policy.backoff_us = 100;
+    recovery->policy.max_tier = RECOVERY_BUS_CLEAR;
+    recovery->policy.breaker_threshold = 1;
+    recovery->policy.breaker_ms = 1000;
+
+    // Only offer what the wrapped bus can do:
+    recovery->bus.read = recovery_read;
+    recovery->bus.write = recovery_write;
+    recovery->bus.scan = recovery_scan;
+    recovery->bus.power_cycle = target->power_cycle ? recovery_power_cycle
+                                                    : NULL;
+    recovery->bus.bus_clear = target->bus_clear ? recovery_bus_clear : NULL;
+    recovery->bus.delay = target->delay ? recovery_delay : NULL;
+    recovery->bus.context = recovery;
+}
+
+int recovery_error_class(int error) {
+    switch (error) {
+        case -ECLKTIMEOUT:
+        case -EBUSLOCKUP:
+        case -EFAILSTCOND:
+            return RECOVERY_BUS_FAULT;
+        case -EDEVICEHUNG:
+        case -ENACKRST:
+            return RECOVERY_DEVICE_HUNG;
+        default:
+            return RECOVERY_TRANSIENT;
+    }
+}
+
+int breaker_open(struct pca9685_recovery *recovery, int device_addr) {
+    struct recovery_device *device = get_device(recovery, device_addr);
+
+    if (device == NULL) {
+        return -1;
+    }
+
+    return device->open_until_ns && (metrics_now() < device->open_until_ns);
+}
+
+int reset_breaker(struct pca9685_recovery *recovery, int device_addr) {
+    struct recovery_device *device = get_device(recovery, device_addr);
+
+    if (device == NULL) {
+        return -1;
+    }
+
+    device->failures = 0;
+    device->open_until_ns = 0;
+
+    return 0;
+}
+
+void get_recovery_stats(struct pca9685_recovery *recovery,
+                        struct recovery_stats *stats) {
+    *stats = recovery->stats;
+}
@@ -0,0 +1,403 @@
+// Raspberry Pi PCA9685 Example
+//
+// Copyright (c) 2022 Benjamin Spencer
+// ============================================================================
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+// ============================================================================
+
+// Include C standard libraries:
+#include <stdlib.h> // C Standard library
+#include <string.h> // C Standard string manipulation
+#include <time.h>   // C Standard date and time manipulation
+#include <stdint.h> // C Standard integer types
+
+#include <pi_i2c.h> // Pi I2C library! (error codes)
+
+#include "pca9685_registers.h" // PCA9685 register definitions
+#include "pca9685_sim.h"       // Simulated PCA9685 bus
+
+// MODE1 bits (page 14):
+#define MODE1_RESTART_BIT (0x01 << 7)
+#define MODE1_EXTCLK_BIT (0x01 << 6)
+#define MODE1_AI_BIT (0x01 << 5)
+#define MODE1_SLEEP_BIT (0x01 << 4)
+#define MODE1_SUB1_BIT (0x01 << 3)
+#define MODE1_SUB2_BIT (0x01 << 2)
+#define MODE1_SUB3_BIT (0x01 << 1)
+#define MODE1_ALLCALL_BIT 0x01
+
+#define LEDN_FULL_OFF_BIT 0x10 // Bit 4 of LEDn_OFF_H
+#define MIN_PRE_SCALE 0x03     // Lower values are forced to 3 (page 25)
+
+// Software reset (page 30):
+#define GENERAL_CALL_ADDR 0x00
+#define SWRST_DATA 0x06
+
+// Bytes on the bus besides the data: address and register pointer
+// (reads add the repeated address):
+#define WRITE_OVERHEAD_BYTES 2
+#define READ_OVERHEAD_BYTES 3
+
+static void reset_device(struct sim_device *device) {
+    int led_reg;
+
+    memset(device->reg, 0x00, sizeof(device->reg));
+
+    device->reg[MODE1] = MODE1_DEFAULT;
+    device->reg[MODE2] = MODE2_DEFAULT;
+    device->reg[SUBADR1] = SUBADR1_DEFAULT;
+    device->reg[SUBADR2] = SUBADR2_DEFAULT;
+    device->reg[SUBADR3] = SUBADR3_DEFAULT;
+    device->reg[ALLCALLADR] = ALLCALLADR_DEFAULT;
+
+    for (led_reg = LED0_ON_L; led_reg <= LED15_OFF_H; led_reg += 4) {
+        device->reg[led_reg] = LEDN_ON_L_DEFAULT;
+        device->reg[led_reg + 1] = LEDN_ON_H_DEFAULT;
+        device->reg[led_reg + 2] = LEDN_OFF_L_DEFAULT;
+        device->reg[led_reg + 3] = LEDN_OFF_H_DEFAULT;
+    }
+
+    device->reg[PRE_SCALE] = PRE_SCALE_DEFAULT;
+    device->hung = 0;
+}
+
+// Busy wait for the time the transfer holds the bus:
+static void spend_bus_time(struct pca9685_sim *sim, int bytes) {
+    struct timespec start;
+    struct timespec now;
+
+    long wait_ns = (long) sim->byte_latency_ns * bytes;
+
+    if (wait_ns <= 0) {
+        return;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    do {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+    } while ((now.tv_sec - start.tv_sec) * 1000000000L
+             + (now.tv_nsec - start.tv_nsec) < wait_ns);
+}
+
+static int inject_nack(struct pca9685_sim *sim) {
+    if (sim->nack_one_in <= 0) {
+        return 0;
+    }
+
+    return (rand_r(&sim->seed) % sim->nack_one_in) == 0;
+}
+
+// Reads only answer on the hardware address; writes also on enabled
+// group addresses:
+static int responds(struct sim_device *device, int device_addr, int write) {
+    uint8_t mode1 = device->reg[MODE1];
+
+    if (device->device_addr == device_addr) {
+        return 1;
+    }
+
+    if (!write) {
+        return 0;
+    }
+
+    if ((mode1 & MODE1_ALLCALL_BIT)
+        && ((device->reg[ALLCALLADR] >> 1) == device_addr)) {
+        return 1;
+    }
+
+    if ((mode1 & MODE1_SUB1_BIT)
+        && ((device->reg[SUBADR1] >> 1) == device_addr)) {
+        return 1;
+    }
+
+    if ((mode1 & MODE1_SUB2_BIT)
+        && ((device->reg[SUBADR2] >> 1) == device_addr)) {
+        return 1;
+    }
+
+    if ((mode1 & MODE1_SUB3_BIT)
+        && ((device->reg[SUBADR3] >> 1) == device_addr)) {
+        return 1;
+    }
+
+    return 0;
+}
+
+static int pwm_active(struct sim_device *device) {
+    int led_reg;
+
+    for (led_reg = LED0_ON_L; led_reg <= LED15_OFF_H; led_reg += 4) {
+        if (!(device->reg[led_reg + 3] & LEDN_FULL_OFF_BIT)) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+static void write_mode1(struct sim_device *device, uint8_t value) {
+    uint8_t old_value = device->reg[MODE1];
+    uint8_t new_value = value & ~MODE1_RESTART_BIT;
+
+    // EXTCLK can only be cleared by a reset:
+    new_value |= old_value & MODE1_EXTCLK_BIT;
+
+    // Writing a 1 to RESTART clears it; writing 0 has no effect:
+    if (!(value & MODE1_RESTART_BIT)) {
+        new_value |= old_value & MODE1_RESTART_BIT;
+    }
+
+    // Going to sleep with PWM running flags that it can be restarted:
+    if (!(old_value & MODE1_SLEEP_BIT) && (new_value & MODE1_SLEEP_BIT)
+        && pwm_active(device)) {
+        new_value |= MODE1_RESTART_BIT;
+    }
+
+    device->reg[MODE1] = new_value;
+}
+
+static void write_register(struct sim_device *device, int reg_addr,
+                           uint8_t value) {
+    int led_reg;
+
+    if (reg_addr == MODE1) {
+        write_mode1(device, value);
+    } else if (reg_addr == PRE_SCALE) {
+        // Locked out while the oscillator is running:
+        if (device->reg[MODE1] & MODE1_SLEEP_BIT) {
+            device->reg[PRE_SCALE] = (value < MIN_PRE_SCALE) ? MIN_PRE_SCALE
+                                                              : value;
+        }
+    } else if ((reg_addr >= ALL_LED_ON_L) && (reg_addr <= ALL_LED_OFF_H)) {
+        for (led_reg = LED0_ON_L; led_reg <= LED15_OFF_H; led_reg += 4) {
+            device->reg[led_reg + (reg_addr - ALL_LED_ON_L)] = value;
+        }
+    } else if (reg_addr <= LED15_OFF_H) {
+        device->reg[reg_addr] = value;
+    }
+
+    // Reserved registers and TestMode ignore writes
+}
+
+static int read_register(struct sim_device *device, int reg_addr) {
+    // ALL_LED registers are write only:
+    if ((reg_addr >= ALL_LED_ON_L) && (reg_addr <= ALL_LED_OFF_H)) {
+        return 0;
+    }
+
+    return device->reg[reg_addr];
+}
+
+static int next_register(struct sim_device *device, int reg_addr) {
+    if (device->reg[MODE1] & MODE1_AI_BIT) {
+        return (reg_addr + 1) & 0xFF;
+    }
+
+    return reg_addr;
+}
+
+static int sim_write(void *context, int device_addr, int reg_addr,
+                     int *data, int bytes) {
+    struct pca9685_sim *sim = context;
+    struct sim_device *device;
+
+    int acked = 0;
+    int pointer;
+
+    int i;
+    int j;
+
+    spend_bus_time(sim, bytes + WRITE_OVERHEAD_BYTES);
+
+    if (inject_nack(sim)) {
+        return -ENACK;
+    }
+
+    if (sim->bus_stuck) {
+        return -EBUSLOCKUP;
+    }
+
+    if (device_addr == GENERAL_CALL_ADDR) {
+        if (reg_addr != SWRST_DATA) {
+            return -ENACK;
+        }
+
+        for (i = 0; i < sim->num_devices; i++) {
+            reset_device(&sim->devices[i]);
+        }
+
+        return 0;
+    }
+
+    for (i = 0; i < sim->num_devices; i++) {
+        device = &sim->devices[i];
+
+        if (!responds(device, device_addr, 1)) {
+            continue;
+        }
+
+        if (device->hung) {
+            return -EDEVICEHUNG;
+        }
+
+        acked = 1;
+        pointer = reg_addr & 0xFF;
+
+        for (j = 0; j < bytes; j++) {
+            write_register(device, pointer, (uint8_t) data[j]);
+            pointer = next_register(device, pointer);
+        }
+    }
+
+    return acked ? 0 : -ENACK;
+}
+
+static int sim_read(void *context, int device_addr, int reg_addr,
+                    int *data, int bytes) {
+    struct pca9685_sim *sim = context;
+    struct sim_device *device;
+
+    int pointer;
+
+    int i;
+    int j;
+
+    spend_bus_time(sim, bytes + READ_OVERHEAD_BYTES);
+
+    if (inject_nack(sim)) {
+        return -ENACK;
+    }
+
+    if (sim->bus_stuck) {
+        return -EBUSLOCKUP;
+    }
+
+    for (i = 0; i < sim->num_devices; i++) {
+        device = &sim->devices[i];
+
+        if (!responds(device, device_addr, 0)) {
+            continue;
+        }
+
+        if (device->hung) {
+            return -EDEVICEHUNG;
+        }
+
+        pointer = reg_addr & 0xFF;
+
+        for (j = 0; j < bytes; j++) {
+            data[j] = read_register(device, pointer);
+            pointer = next_register(device, pointer);
+        }
+
+        return 0;
+    }
+
+    return -ENACK;
+}
+
+static int sim_scan(void *context, int *address_book) {
+    struct pca9685_sim *sim = context;
+
+    int device_addr;
+    int i;
+
+    // One address byte per probe:
+    spend_bus_time(sim, SIM_ADDRESS_BOOK);
+
+    for (device_addr = 0; device_addr < SIM_ADDRESS_BOOK; device_addr++) {
+        address_book[device_addr] = 0;
+
+        for (i = 0; i < sim->num_devices; i++) {
+            if (responds(&sim->devices[i], device_addr, 1)) {
+                address_book[device_addr] = 1;
+                break;
+            }
+        }
+    }
+
+    return 0;
+}
+
+// Power loss puts every device back to its reset state:
+static int sim_power_cycle(void *context) {
+    struct pca9685_sim *sim = context;
+
+    int i;
+
+    for (i = 0; i < sim->num_devices; i++) {
+        reset_device(&sim->devices[i]);
+    }
+
+    return 0;
+}
+
+// Clocking SCL frees a device holding SDA low:
+static int sim_bus_clear(void *context) {
+    struct pca9685_sim *sim = context;
+
+    sim->bus_stuck = 0;
+
+    return 0;
+}
+
+void init_sim(struct pca9685_sim *sim) {
+    sim->num_devices = 0;
+    sim->byte_latency_ns = 0;
+    sim->nack_one_in = 0;
+    sim->seed = 1;
+    sim->bus_stuck = 0;
+
+    sim->bus.read = sim_read;
+    sim->bus.write = sim_write;
+    sim->bus.scan = sim_scan;
+    sim->bus.power_cycle = sim_power_cycle;
+    sim->bus.delay = NULL;
+    sim->bus.bus_clear = sim_bus_clear;
+    sim->bus.context = sim;
+}
+
+int add_sim_device(struct pca9685_sim *sim, int device_addr) {
+    struct sim_device *device;
+
+    if ((sim->num_devices == SIM_MAX_DEVICES) || (device_addr <= 0)
+        || (device_addr >= SIM_ADDRESS_BOOK)) {
+        return -1;
+    }
+
+    device = &sim->devices[sim->num_devices++];
+    device->device_addr = device_addr;
+
+    reset_device(device);
+
+    return 0;
+}
+
+uint8_t *get_sim_registers(struct pca9685_sim *sim, int device_addr) {
+    int i;
+
+    for (i = 0; i < sim->num_devices; i++) {
+        if (sim->devices[i].device_addr == device_addr) {
+            return sim->devices[i].reg;
+        }
+    }
+
+    return NULL;
+}
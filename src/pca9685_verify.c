@@ -0,0 +1,302 @@
+// Raspberry Pi PCA9685 Example
+//
+// Copyright (c) 2022 Benjamin Spencer
+// ============================================================================
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+// ============================================================================
+
+// Include C standard libraries:
+#include <stdio.h>  // C Standard I/O libary
+#include <stdint.h> // C Standard integer types
+
+#include <pi_i2c.h> // Pi I2C library! (speed grades)
+
+#include "pca9685_registers.h" // PCA9685 register definitions
+#include "pca9685_log.h"       // PCA9685 driver logging
+#include "pca9685_bus.h"       // PCA9685 bus backend
+#include "pca9685_cache.h"     // PCA9685 shadow register cache
+#include "pca9685_metrics.h"   // PCA9685 bus metrics (clock)
+#include "pca9685_coalesce.h"  // PCA9685 write coalescing (bus cost model)
+#include "pca9685_verify.h"    // PCA9685 readback verification
+
+// MODE1 bits (page 14):
+#define MODE1_AI_BIT (0x01 << 5)
+#define MODE1_RESTART_BIT (0x01 << 7)
+
+#define CHECK_MODES -1 // Offset of the MODE1 and MODE2 step
+
+int init_verify(struct pca9685_verify *verify, int budget_us, int period_ms,
+                int repair) {
+    if ((budget_us < 0) || (period_ms <= 0)) {
+        return -1;
+    }
+
+    verify->num_devices = 0;
+    verify->repair = repair;
+
+    verify->budget_ns = (uint64_t) budget_us * 1000;
+    verify->period_ns = (uint64_t) period_ms * 1000000;
+
+    bus_cost_for_speed(&verify->cost, I2C_FULL_SPEED);
+
+    verify->callback = NULL;
+    verify->context = NULL;
+
+    verify->device = 0;
+    verify->offset = CHECK_MODES;
+    verify->period_start_ns = metrics_now();
+    verify->spent_ns = 0;
+
+    verify->stats = (struct verify_stats) {0};
+
+    return 0;
+}
+
+int add_verify_device(struct pca9685_verify *verify, int device_addr) {
+    if ((device_addr < 0) || (device_addr >= NUM_DEVICE_IDS)
+        || (verify->num_devices == MAX_VERIFY_DEVICES)) {
+        return -1;
+    }
+
+    verify->device_addrs[verify->num_devices++] = device_addr;
+
+    return 0;
+}
+
+void set_verify_callback(struct pca9685_verify *verify,
+                         verify_callback callback, void *context) {
+    verify->callback = callback;
+    verify->context = context;
+}
+
+// Wire time of transfers moving bytes in all (a read adds a repeated start
+// and the address again, about one byte):
+static void charge(struct pca9685_verify *verify, uint64_t *wire_ns,
+                   int transfers, int bytes) {
+    *wire_ns += (uint64_t) transfers * verify->cost.transaction_ns
+                + (uint64_t) bytes * verify->cost.byte_ns;
+}
+
+static void report(struct pca9685_verify *verify, int event,
+                   int device_addr, int reg_addr) {
+    if (verify->callback != NULL) {
+        verify->callback(event, device_addr, reg_addr, verify->context);
+    }
+}
+
+static int repair_device(struct pca9685_verify *verify, int device_addr,
+                         uint64_t *wire_ns) {
+    int ret;
+
+    if (!verify->repair) {
+        return 0;
+    }
+
+    // MODE1 asleep, MODE2 to LED15_OFF_H, PRE_SCALE and MODE1 again:
+    charge(verify, wire_ns, 4, LED15_OFF_H + 3);
+
+    if ((ret = restore_register_cache(device_addr)) < 0) {
+        return ret;
+    }
+
+    verify->stats.repairs++;
+
+    return 0;
+}
+
+static int check_modes(struct pca9685_verify *verify, int device_addr,
+                       uint64_t *wire_ns) {
+    int expected[2];
+    int actual[2];
+
+    int ret;
+
+    if ((ret = read_register_cache(device_addr, MODE1, expected, 2)) < 0) {
+        return ret;
+    }
+
+    charge(verify, wire_ns, 1, 2 + 1);
+
+    if ((ret = bus_read(device_addr, MODE1, actual, 2)) < 0) {
+        return ret;
+    }
+
+    verify->stats.reads++;
+    verify->stats.bytes += 2;
+
+    // Reset: asleep with auto-increment off, which this driver never leaves
+    // a device in on purpose:
+    if ((actual[0] == MODE1_DEFAULT) && (expected[0] != MODE1_DEFAULT)) {
+        PCA9685_LOG("Device 0x%X was reset; restoring its registers\n",
+                    device_addr);
+
+        verify->stats.brownouts++;
+        report(verify, VERIFY_BROWNOUT, device_addr, MODE1);
+
+        return repair_device(verify, device_addr, wire_ns);
+    }
+
+    // RESTART reads back as set while outputs are held, and without
+    // auto-increment the second byte is MODE1 again:
+    if (((actual[0] ^ expected[0]) & ~MODE1_RESTART_BIT)
+        || ((actual[0] & MODE1_AI_BIT) && (actual[1] != expected[1]))) {
+        verify->stats.mode_errors++;
+        report(verify, VERIFY_MODE, device_addr, MODE1);
+
+        return repair_device(verify, device_addr, wire_ns);
+    }
+
+    return 0;
+}
+
+static int check_leds(struct pca9685_verify *verify, int device_addr,
+                      uint64_t *wire_ns) {
+    int expected[VERIFY_CHUNK_BYTES];
+    int actual[VERIFY_CHUNK_BYTES];
+
+    int reg_addr = LED0_ON_L + verify->offset;
+    int bytes = LED_BANK_BYTES - verify->offset;
+
+    int i;
+    int ret;
+
+    bytes = (bytes < VERIFY_CHUNK_BYTES) ? bytes : VERIFY_CHUNK_BYTES;
+
+    if ((ret = read_register_cache(device_addr, reg_addr, expected,
+         bytes)) < 0) {
+        return ret;
+    }
+
+    charge(verify, wire_ns, 1, bytes + 1);
+
+    if ((ret = bus_read(device_addr, reg_addr, actual, bytes)) < 0) {
+        return ret;
+    }
+
+    verify->stats.reads++;
+    verify->stats.bytes += bytes;
+
+    for (i = 0; i < bytes; i++) {
+        if (actual[i] != expected[i]) {
+            break;
+        }
+    }
+
+    if (i == bytes) {
+        return 0;
+    }
+
+    verify->stats.mismatches++;
+    report(verify, VERIFY_MISMATCH, device_addr, reg_addr + i);
+
+    if (!verify->repair) {
+        return 0;
+    }
+
+    // The cache already holds these bytes so write_register_cache() would
+    // skip them:
+    charge(verify, wire_ns, 1, bytes);
+
+    if ((ret = bus_write(device_addr, reg_addr, expected, bytes)) < 0) {
+        return ret;
+    }
+
+    verify->stats.repairs++;
+
+    return 0;
+}
+
+// Move on to the next read; LED banks can only be read in bursts with
+// auto-increment on:
+static void advance(struct pca9685_verify *verify, int device_addr) {
+    int mode1[1] = {0};
+
+    if (verify->offset == CHECK_MODES) {
+        read_register_cache(device_addr, MODE1, mode1, 1);
+    }
+
+    if ((verify->offset == CHECK_MODES) && (mode1[0] & MODE1_AI_BIT)) {
+        verify->offset = 0;
+    } else if ((verify->offset != CHECK_MODES)
+               && (verify->offset + VERIFY_CHUNK_BYTES < LED_BANK_BYTES)) {
+        verify->offset += VERIFY_CHUNK_BYTES;
+    } else {
+        verify->offset = CHECK_MODES;
+
+        if (++verify->device == verify->num_devices) {
+            verify->device = 0;
+            verify->stats.passes++;
+        }
+    }
+}
+
+int verify_step(struct pca9685_verify *verify) {
+    uint64_t start_ns = metrics_now();
+    uint64_t wire_ns = 0;
+    uint64_t elapsed_ns;
+
+    int device_addr;
+    int ret;
+
+    if (start_ns - verify->period_start_ns >= verify->period_ns) {
+        verify->period_start_ns = start_ns;
+        verify->spent_ns = 0;
+    }
+
+    if ((verify->num_devices == 0) || (verify->spent_ns >= verify->budget_ns)) {
+        return 0;
+    }
+
+    device_addr = verify->device_addrs[verify->device];
+
+    if (verify->offset == CHECK_MODES) {
+        ret = check_modes(verify, device_addr, &wire_ns);
+    } else {
+        ret = check_leds(verify, device_addr, &wire_ns);
+    }
+
+    elapsed_ns = metrics_now() - start_ns;
+
+    // A read may overrun the budget; the next one then waits a period:
+    verify->spent_ns += (elapsed_ns > wire_ns) ? elapsed_ns : wire_ns;
+
+    advance(verify, device_addr);
+
+    if (ret < 0) {
+        verify->stats.errors++;
+        return ret;
+    }
+
+    return 1;
+}
+
+uint64_t verify_idle_ns(struct pca9685_verify *verify) {
+    uint64_t elapsed_ns = metrics_now() - verify->period_start_ns;
+
+    if (verify->num_devices == 0) {
+        return verify->period_ns;
+    }
+
+    if ((verify->spent_ns < verify->budget_ns)
+        || (elapsed_ns >= verify->period_ns)) {
+        return 0;
+    }
+
+    return verify->period_ns - elapsed_ns;
+}
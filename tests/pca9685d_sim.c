@@ -0,0 +1,131 @@
+// Raspberry Pi PCA9685 Example
+//
+// Copyright (c) 2022 Benjamin Spencer
+// ============================================================================
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+// ============================================================================
+
+// pca9685d against simulated boards
+//
+// Linked into the daemon in place of pca9685_bus_pi.c and the pi_i2c
+// library: pi_i2c_bus forwards to a simulated bus holding boards 0x40 and
+// 0x41. On exit the register file of each board is written to the file
+// named by PCA9685D_SIM_DUMP (SIM_DUMP_BYTES per board, in order) for the
+// test to check. SIGUSR1 makes every write fail with -ENACK until
+// SIGUSR2.
+
+// Include C standard libraries:
+#include <stdio.h>  // C Standard I/O libary
+#include <stdlib.h> // C Standard library
+#include <stdint.h> // C Standard integer types
+#include <signal.h> // C Standard signals
+
+#include <pi_i2c.h> // Pi I2C library! (config_i2c())
+
+#include "pca9685_bus.h" // PCA9685 bus backend
+#include "pca9685_sim.h" // Simulated PCA9685 bus
+
+#define SIM_FIRST_ADDR 0x40
+#define SIM_BOARDS 2
+#define SIM_DUMP_BYTES 256
+
+static struct pca9685_sim sim;
+
+static volatile sig_atomic_t failing;
+
+static void start_failing(int signal_number) {
+    failing = 1;
+}
+
+static void stop_failing(int signal_number) {
+    failing = 0;
+}
+
+static int sim_read(void *context, int device_addr, int reg_addr,
+                    int *data, int bytes) {
+    return sim.bus.read(sim.bus.context, device_addr, reg_addr, data, bytes);
+}
+
+static int sim_write(void *context, int device_addr, int reg_addr,
+                     int *data, int bytes) {
+    if (failing) {
+        return -ENACK;
+    }
+
+    return sim.bus.write(sim.bus.context, device_addr, reg_addr, data,
+                         bytes);
+}
+
+static int sim_scan(void *context, int *address_book) {
+    return sim.bus.scan(sim.bus.context, address_book);
+}
+
+static int sim_power_cycle(void *context) {
+    return sim.bus.power_cycle(sim.bus.context);
+}
+
+static int sim_bus_clear(void *context) {
+    return sim.bus.bus_clear(sim.bus.context);
+}
+
+const struct pca9685_bus pi_i2c_bus = {
+    .read = sim_read,
+    .write = sim_write,
+    .scan = sim_scan,
+    .power_cycle = sim_power_cycle,
+    .bus_clear = sim_bus_clear,
+    .delay = NULL,
+    .context = NULL,
+};
+
+int config_i2c(int sda_pin, int scl_pin, int speed_grade) {
+    return 0;
+}
+
+__attribute__((constructor)) static void start_sim(void) {
+    int board;
+
+    init_sim(&sim);
+
+    for (board = 0; board < SIM_BOARDS; board++) {
+        add_sim_device(&sim, SIM_FIRST_ADDR + board);
+    }
+
+    signal(SIGUSR1, start_failing);
+    signal(SIGUSR2, stop_failing);
+}
+
+__attribute__((destructor)) static void dump_sim(void) {
+    const char *path = getenv("PCA9685D_SIM_DUMP");
+
+    FILE *file;
+
+    int board;
+
+    if ((path == NULL) || ((file = fopen(path, "wb")) == NULL)) {
+        return;
+    }
+
+    for (board = 0; board < SIM_BOARDS; board++) {
+        fwrite(get_sim_registers(&sim, SIM_FIRST_ADDR + board), 1,
+               SIM_DUMP_BYTES, file);
+    }
+
+    fclose(file);
+}
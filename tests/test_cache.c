@@ -0,0 +1,218 @@
+// Raspberry Pi PCA9685 Example
+//
+// Copyright (c) 2022 Benjamin Spencer
+// ============================================================================
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+// ============================================================================
+
+// Shadow register cache tests
+
+// Include C standard libraries:
+#include <stdint.h> // C Standard integer types
+
+#include "pca9685_registers.h" // PCA9685 register definitions
+#include "pca9685_bus.h"       // PCA9685 bus backend
+#include "pca9685_sim.h"       // Simulated PCA9685 bus
+#include "pca9685_cache.h"     // PCA9685 shadow register cache
+#include "pca9685.h"           // PCA9685 driver
+#include "test_util.h"         // Test helpers
+
+#define TEST_ADDR 0x40
+
+static struct pca9685_sim sim;
+static struct counting_bus counter;
+
+static void setup(void) {
+    init_sim(&sim);
+    add_sim_device(&sim, TEST_ADDR);
+    init_counting_bus(&counter, &sim.bus);
+    set_bus(&counter.bus);
+    invalidate_register_cache(ALL_DEVICES);
+}
+
+static void test_load(void) {
+    int data[2];
+
+    setup();
+
+    CHECK(init_register_cache(TEST_ADDR) == 0);
+    CHECK(counter.reads == 2); // MODE1..LED15_OFF_H, then PRE_SCALE
+
+    reset_counting_bus(&counter);
+    CHECK(read_register_cache(TEST_ADDR, MODE1, data, 2) == 0);
+    CHECK((data[0] == MODE1_DEFAULT) && (data[1] == MODE2_DEFAULT));
+    CHECK(read_register_cache(TEST_ADDR, PRE_SCALE, data, 1) == 0);
+    CHECK(data[0] == PRE_SCALE_DEFAULT);
+    CHECK(counter.reads == 0);
+
+    // Stale caches reload on the next read:
+    CHECK(invalidate_register_cache(TEST_ADDR) == 0);
+    CHECK(read_register_cache(TEST_ADDR, MODE1, data, 1) == 0);
+    CHECK(counter.reads == 2);
+}
+
+static void test_write_changed_only(void) {
+    int data[4] = {0x00, 0x00, 0x00, 0x10}; // Power-on LED0 values
+    uint8_t *reg;
+
+    setup();
+    reg = get_sim_registers(&sim, TEST_ADDR);
+    CHECK(init_register_cache(TEST_ADDR) == 0);
+
+    reset_counting_bus(&counter);
+    CHECK(write_register_cache(TEST_ADDR, LED0_ON_L, data, 4) == 0);
+    CHECK(counter.writes == 0);
+
+    // Without AI the changed bytes go one at a time:
+    data[1] = 0x01;
+    data[3] = 0x02;
+    CHECK(write_register_cache(TEST_ADDR, LED0_ON_L, data, 4) == 0);
+    CHECK(counter.writes == 2);
+    CHECK((reg[LED0_ON_H] == 0x01) && (reg[LED0_OFF_H] == 0x02));
+
+    // With AI the changed span is one burst:
+    data[0] = MODE1_DEFAULT | 0x20;
+    CHECK(write_register_cache(TEST_ADDR, MODE1, data, 1) == 0);
+    reset_counting_bus(&counter);
+    data[0] = 0x00;
+    data[1] = 0x03;
+    data[2] = 0x00;
+    data[3] = 0x04;
+    CHECK(write_register_cache(TEST_ADDR, LED0_ON_L, data, 4) == 0);
+    CHECK(counter.writes == 1);
+    CHECK(counter.bytes_written == 3);
+    CHECK(counter.last_reg == LED0_ON_H);
+    CHECK((reg[LED0_ON_H] == 0x03) && (reg[LED0_OFF_H] == 0x04));
+
+    // TestMode is never written:
+    CHECK(write_register_cache(TEST_ADDR, TestMode, data, 1) < 0);
+}
+
+static void test_configure_device(void) {
+    int sleep_config[1] = {LOW_POWER};
+    int wake_config[2] = {NORMAL_MODE, AI};
+    uint8_t *reg;
+
+    setup();
+    reg = get_sim_registers(&sim, TEST_ADDR);
+
+    CHECK(configure_device(TEST_ADDR, MODE1, wake_config, 2) == 0);
+    CHECK(reg[MODE1] == 0x21);
+
+    // Same value again costs nothing:
+    reset_counting_bus(&counter);
+    CHECK(configure_device(TEST_ADDR, MODE1, wake_config, 2) == 0);
+    CHECK((counter.reads == 0) && (counter.writes == 0));
+
+    CHECK(configure_device(TEST_ADDR, MODE1, sleep_config, 1) == 0);
+    CHECK(reg[MODE1] == 0x31);
+    CHECK(counter.writes == 1);
+}
+
+static void test_restore(void) {
+    int data[4] = {0x00, 0x01, 0x00, 0x02};
+    int prescale = 0x79;
+    int mode1 = 0x21;
+    uint8_t *reg;
+
+    setup();
+    reg = get_sim_registers(&sim, TEST_ADDR);
+    CHECK(init_register_cache(TEST_ADDR) == 0);
+
+    CHECK(write_register_cache(TEST_ADDR, PRE_SCALE, &prescale, 1) == 0);
+    CHECK(write_register_cache(TEST_ADDR, MODE1, &mode1, 1) == 0);
+    CHECK(write_register_cache(TEST_ADDR, LED3_ON_L, data, 4) == 0);
+
+    CHECK(bus_power_cycle(0) == 0);
+    CHECK(reg[PRE_SCALE] == PRE_SCALE_DEFAULT);
+
+    CHECK(restore_register_cache(TEST_ADDR) == 0);
+    CHECK(reg[MODE1] == 0x21);
+    CHECK(reg[PRE_SCALE] == 0x79);
+    CHECK((reg[LED3_ON_H] == 0x01) && (reg[LED3_OFF_H] == 0x02));
+
+    // Nothing to restore for a device never loaded:
+    CHECK(restore_register_cache(0x41) < 0);
+}
+
+static void test_update_and_assume(void) {
+    int data[1] = {0x00};
+
+    setup();
+    CHECK(init_register_cache(TEST_ADDR) == 0);
+
+    // A group write recorded without the bus; the next write of that
+    // value is then skipped:
+    CHECK(update_register_cache(TEST_ADDR, ALL_LED_OFF_H, data, 1) == 0);
+    reset_counting_bus(&counter);
+    CHECK(write_register_cache(TEST_ADDR, LED9_OFF_H, data, 1) == 0);
+    CHECK(counter.writes == 0);
+
+    data[0] = 0x79;
+    CHECK(assume_register_cache(0x41, PRE_SCALE, data, 1) == 0);
+    CHECK(read_register_cache(0x41, PRE_SCALE, data, 1) == 0);
+    CHECK(data[0] == 0x79);
+    CHECK(read_register_cache(0x41, MODE1, data, 1) == 0);
+    CHECK(data[0] == MODE1_DEFAULT);
+    CHECK(counter.reads == 0);
+}
+
+// Rebooting one bus restores its devices and leaves other buses alone:
+static void test_reboot_one_bus(void) {
+    struct pca9685_sim other_sim;
+    struct counting_bus other_counter;
+
+    int mode1 = 0x21;
+    int other_id = DEVICE_ID(1, TEST_ADDR);
+
+    setup();
+    init_sim(&other_sim);
+    add_sim_device(&other_sim, TEST_ADDR);
+    init_counting_bus(&other_counter, &other_sim.bus);
+    attach_bus(1, &other_counter.bus);
+
+    CHECK(init_register_cache(TEST_ADDR) == 0);
+    CHECK(init_register_cache(other_id) == 0);
+    CHECK(write_register_cache(TEST_ADDR, MODE1, &mode1, 1) == 0);
+    CHECK(write_register_cache(other_id, MODE1, &mode1, 1) == 0);
+
+    // Changed behind the cache's back; a restore would undo it:
+    get_sim_registers(&sim, TEST_ADDR)[MODE2] = 0x00;
+
+    reset_counting_bus(&counter);
+    reboot_device(1);
+
+    CHECK(get_sim_registers(&other_sim, TEST_ADDR)[MODE1] == 0x21);
+    CHECK(is_register_cache_loaded(other_id));
+    CHECK(counter.writes == 0);
+    CHECK(get_sim_registers(&sim, TEST_ADDR)[MODE2] == 0x00);
+
+    attach_bus(1, NULL);
+}
+
+int main(void) {
+    test_load();
+    test_write_changed_only();
+    test_configure_device();
+    test_restore();
+    test_update_and_assume();
+    test_reboot_one_bus();
+
+    return test_result("test_cache");
+}
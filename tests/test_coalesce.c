@@ -0,0 +1,168 @@
+// Raspberry Pi PCA9685 Example
+//
+// Copyright (c) 2022 Benjamin Spencer
+// ============================================================================
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+// ============================================================================
+
+// Write coalescing tests
+
+// Include C standard libraries:
+#include <stdint.h> // C Standard integer types
+
+#include "pca9685_registers.h" // PCA9685 register definitions
+#include "pca9685_bus.h"       // PCA9685 bus backend
+#include "pca9685_sim.h"       // Simulated PCA9685 bus
+#include "pca9685_cache.h"     // PCA9685 shadow register cache
+#include "pca9685_pwm.h"       // PCA9685 PWM output helpers
+#include "pca9685_coalesce.h"  // PCA9685 write coalescing
+#include "test_util.h"         // Test helpers
+
+#define TEST_ADDR 0x40
+#define LONG_WINDOW_US 10000000
+
+static struct pca9685_sim sim;
+static struct counting_bus counter;
+static struct pca9685_coalesce coalesce;
+
+// Duty cycle a channel's registers give (phase offset included):
+static int channel_duty(uint8_t *reg, int led_id) {
+    uint8_t *led = &reg[LED0_ON_L + 4 * led_id];
+
+    return ((((led[3] << 8) | led[2]) - ((led[1] << 8) | led[0])) & 0xFFF);
+}
+
+static void setup(int window_us) {
+    init_sim(&sim);
+    add_sim_device(&sim, TEST_ADDR);
+    init_counting_bus(&counter, &sim.bus);
+    set_bus(&counter.bus);
+    invalidate_register_cache(ALL_DEVICES);
+    init_register_cache(TEST_ADDR);
+
+    init_coalesce(&coalesce, TEST_ADDR, window_us);
+    reset_counting_bus(&counter);
+}
+
+static void test_cost_model(void) {
+    struct bus_cost_model cost;
+
+    bus_cost_for_speed(&cost, 400000);
+    CHECK(cost.byte_ns == 22500);
+    CHECK(cost.transaction_ns == 50000);
+}
+
+// The one run-merging rule write_led_bank() and flush_coalesce() share:
+static void test_led_runs(void) {
+    int led_bank[LED_BANK_BYTES] = {0};
+    int dirty[LED_BANK_BYTES] = {0};
+    int bytes_sent = 0;
+
+    setup(0);
+
+    // Dirty at 0, 3 (gap 2) and 8 (gap 4):
+    led_bank[0] = 0x01;
+    led_bank[3] = 0x02;
+    led_bank[8] = 0x03;
+    dirty[0] = dirty[3] = dirty[8] = 1;
+
+    CHECK(write_led_runs(TEST_ADDR, led_bank, dirty, 2, &bytes_sent) == 2);
+    CHECK(bytes_sent == 4 + 1);
+    CHECK(counter.writes == 2);
+
+    bytes_sent = 0;
+    led_bank[0] = 0x04;
+    led_bank[8] = 0x05;
+    CHECK(write_led_runs(TEST_ADDR, led_bank, dirty, 4, &bytes_sent) == 1);
+    CHECK(bytes_sent == 9);
+    CHECK(get_sim_registers(&sim, TEST_ADDR)[LED0_ON_L + 8] == 0x05);
+
+    dirty[0] = dirty[3] = dirty[8] = 0;
+    CHECK(write_led_runs(TEST_ADDR, led_bank, dirty, 2, NULL) == 0);
+}
+
+static void test_immediate(void) {
+    setup(0);
+
+    CHECK(coalesce_duty_cycle(&coalesce, 2, 0x100) == 0);
+    CHECK(counter.writes == 1);
+    CHECK(channel_duty(get_sim_registers(&sim, TEST_ADDR), 2) == 0x100);
+    CHECK(coalesce.pending == 0);
+    CHECK(coalesce.stats.requests == 1);
+    CHECK(coalesce.stats.transactions == 1);
+
+    CHECK(coalesce_write(&coalesce, LED0_ON_L - 1, (int[]) {0}, 1) == -1);
+    CHECK(coalesce_write(&coalesce, LED15_OFF_H, (int[]) {0, 0}, 2) == -1);
+}
+
+static void test_window(void) {
+    setup(LONG_WINDOW_US);
+
+    CHECK(coalesce_duty_cycle(&coalesce, 5, 0x100) == 0);
+    CHECK(coalesce_duty_cycle(&coalesce, 5, 0x200) == 0);
+    CHECK(poll_coalesce(&coalesce) == 0);
+    CHECK(counter.writes == 0);
+    CHECK(coalesce.stats.merged == 1);
+
+    CHECK(flush_coalesce(&coalesce) == 0);
+    CHECK(counter.writes == 1);
+    CHECK(channel_duty(get_sim_registers(&sim, TEST_ADDR), 5) == 0x200);
+
+    // Asking for what the device already has costs nothing:
+    reset_counting_bus(&counter);
+    CHECK(coalesce_duty_cycle(&coalesce, 5, 0x200) == 0);
+    CHECK(flush_coalesce(&coalesce) == 0);
+    CHECK(counter.writes == 0);
+    CHECK(coalesce.stats.suppressed == 1);
+    CHECK(coalesce.stats.flushes == 2);
+
+    // Nothing pending:
+    CHECK(flush_coalesce(&coalesce) == 0);
+    CHECK(coalesce.stats.flushes == 2);
+}
+
+// Gaps are resent only while cheaper than another transaction:
+static void test_gap_cost(void) {
+    setup(LONG_WINDOW_US);
+
+    // Only the OFF_H bytes of channels 0 and 1 change (3 bytes apart):
+    coalesce_write(&coalesce, LED0_OFF_H, (int[]) {0x01}, 1);
+    coalesce_write(&coalesce, LED1_OFF_H, (int[]) {0x01}, 1);
+    CHECK(flush_coalesce(&coalesce) == 0);
+    CHECK(coalesce.stats.transactions == 2);
+    CHECK(coalesce.stats.bytes == 2);
+
+    coalesce.cost.transaction_ns = 4 * coalesce.cost.byte_ns;
+    coalesce_write(&coalesce, LED0_OFF_H, (int[]) {0x02}, 1);
+    coalesce_write(&coalesce, LED1_OFF_H, (int[]) {0x02}, 1);
+    CHECK(flush_coalesce(&coalesce) == 0);
+    CHECK(coalesce.stats.transactions == 3);
+    CHECK(coalesce.stats.bytes == 2 + 5);
+    CHECK(get_sim_registers(&sim, TEST_ADDR)[LED1_OFF_H] == 0x02);
+}
+
+int main(void) {
+    test_cost_model();
+    test_led_runs();
+    test_immediate();
+    test_window();
+    test_gap_cost();
+
+    return test_result("test_coalesce");
+}
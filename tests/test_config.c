@@ -0,0 +1,265 @@
+// Raspberry Pi PCA9685 Example
+//
+// Copyright (c) 2022 Benjamin Spencer
+// ============================================================================
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+// ============================================================================
+
+// Configuration file parser tests
+
+// Include C standard libraries:
+#include <stdio.h>  // C Standard I/O libary
+#include <string.h> // C Standard string manipulation
+
+#include "pca9685_registers.h" // PCA9685 register definitions
+#include "pca9685_bus.h"       // PCA9685 bus backend
+#include "pca9685_encode.h"    // PCA9685 duty cycle encoder
+#include "pca9685_pwm.h"       // PCA9685 PWM output helpers (LED_REG)
+#include "pca9685_cache.h"     // PCA9685 shadow register cache
+#include "pca9685_config.h"    // PCA9685 configuration file
+#include "pca9685.h"           // PCA9685 driver (OSCILLATOR_SETTLE_US)
+#include "test_util.h"         // Test helpers
+
+// MODE1/MODE2 bits (pages 14 and 16):
+#define MODE1_AI_BIT (0x01 << 5)
+#define MODE1_SLEEP_BIT (0x01 << 4)
+#define MODE1_EXTCLK_BIT (0x01 << 6)
+#define MODE1_RESTART_BIT (0x01 << 7)
+#define MODE1_ALLCALL_BIT 0x01
+#define MODE2_INVRT_BIT (0x01 << 4)
+#define MODE2_OCH_BIT (0x01 << 3)
+#define MODE2_OUTDRV_BIT (0x01 << 2)
+#define MODE2_OUTNE_MASK 0x03
+
+#define MAX_EVENTS 64
+
+// A write (first byte) or a delay (usec > 0), in the order they happen:
+struct event {
+    int usec;
+    int device_addr;
+    int reg_addr;
+    int value;
+};
+
+static struct pca9685_config config;
+
+static struct event events[MAX_EVENTS];
+static int num_events;
+
+static int record_write(void *context, int device_addr, int reg_addr,
+                        int *data, int bytes) {
+    struct event event = {0, device_addr, reg_addr, data[0]};
+
+    if (num_events < MAX_EVENTS) {
+        events[num_events++] = event;
+    }
+
+    return 0;
+}
+
+static int record_delay(void *context, int usec) {
+    struct event event = {usec, -1, -1, -1};
+
+    if (num_events < MAX_EVENTS) {
+        events[num_events++] = event;
+    }
+
+    return 0;
+}
+
+static const struct pca9685_bus recording_bus = {
+    .read = NULL,
+    .write = record_write,
+    .scan = NULL,
+    .power_cycle = NULL,
+    .bus_clear = NULL,
+    .delay = record_delay,
+    .context = NULL,
+};
+
+// Parse a config held in a string:
+static int parse(const char *text) {
+    FILE *file;
+
+    int ret;
+
+    file = fmemopen((void *) text, strlen(text), "r");
+    ret = read_config(file, &config);
+    fclose(file);
+
+    return ret;
+}
+
+static void test_example(void) {
+    struct config_board *board = &config.boards[0];
+
+    CHECK(parse("# Applies to the boards that follow\n"
+                "[defaults]\n"
+                "frequency = 200       ; Hz\n"
+                "allcall = yes\n"
+                "duty = 0\n"
+                "\n"
+                "[board 0x40]\n"
+                "bus = 1\n"
+                "frequency = 1526\n"
+                "led15.duty = 2048\n"
+                "led15.phase = 0\n") == 0);
+
+    CHECK(config.num_boards == 1);
+    CHECK(board->device_addr == DEVICE_ID(1, 0x40));
+    CHECK(board->frequency == 1526);
+    CHECK(board->prescale == 0x03);
+
+    // Awake, auto-increment, ALLCALL, internal clock:
+    CHECK(board->reg_values[MODE1] == (MODE1_AI_BIT | MODE1_ALLCALL_BIT));
+
+    CHECK(decode_pwm_registers(&board->reg_values[LED_REG(15)]) == 2048);
+    CHECK(board->reg_values[LED_REG(15)] == 0);
+    CHECK(board->led_delay_times[15] == 0);
+    CHECK(decode_pwm_registers(&board->reg_values[LED_REG(0)]) == 0);
+}
+
+// Nothing given is the safe power-on state with the outputs off:
+static void test_safe_defaults(void) {
+    struct config_board *board = &config.boards[0];
+
+    int led_id;
+
+    CHECK(parse("[board 0x41]\n") == 0);
+    CHECK(board->device_addr == 0x41);
+    CHECK(board->prescale == PRE_SCALE_DEFAULT);
+    CHECK(board->clock_hz == 0);
+    CHECK(board->reg_values[MODE2] == MODE2_DEFAULT);
+    CHECK(!(board->reg_values[MODE1] & MODE1_SLEEP_BIT));
+
+    for (led_id = 0; led_id < NUM_LED_CHANNELS; led_id++) {
+        CHECK(decode_pwm_registers(&board->reg_values[LED_REG(led_id)])
+              == 0);
+    }
+}
+
+static void test_mode_settings(void) {
+    struct config_board *board = &config.boards[0];
+
+    CHECK(parse("[board 0x40]\n"
+                "invert = yes\n"
+                "output = open_drain\n"
+                "output_disabled = high_z\n"
+                "allcall = no\n"
+                "clock = 50000000\n"
+                "frequency = 400\n"
+                "phase = round_robin\n"
+                "duty = 4095\n") == 0);
+
+    CHECK(board->reg_values[MODE2] & MODE2_INVRT_BIT);
+    CHECK(!(board->reg_values[MODE2] & MODE2_OUTDRV_BIT));
+    CHECK(!(board->reg_values[MODE2] & MODE2_OCH_BIT));
+    CHECK((board->reg_values[MODE2] & MODE2_OUTNE_MASK) == 0x02);
+
+    CHECK(!(board->reg_values[MODE1] & MODE1_ALLCALL_BIT));
+    CHECK(board->reg_values[MODE1] & MODE1_EXTCLK_BIT);
+    CHECK(board->clock_hz == 50000000);
+    CHECK(board->prescale == 0x1E); // 393.8 Hz, closer than 406.9 Hz
+
+    CHECK(board->led_delay_times[1] == PWM_COUNTS / NUM_LED_CHANNELS);
+    CHECK(decode_pwm_registers(&board->reg_values[LED_REG(1)])
+          == PWM_FULL_SCALE);
+
+    // Same for both outputs while OE is high:
+    CHECK(parse("[board 0x40]\noutput_disabled = high\n") == 0);
+    CHECK((board->reg_values[MODE2] & MODE2_OUTNE_MASK) == 0x01);
+}
+
+static void test_errors(void) {
+    config.num_boards = -1;
+
+    CHECK(parse("frequency = 200\n") == -1);              // No section
+    CHECK(parse("[board 0x40]\ncolour = red\n") == -1);   // Unknown key
+    CHECK(parse("[board 0x40]\nduty = 0x4G\n") == -1);    // Not a number
+    CHECK(parse("[board 0x40]\nduty = 4096\n") == -1);    // Out of range
+    CHECK(parse("[board 0x40]\nled16.duty = 1\n") == -1); // No such LED
+    CHECK(parse("[board 0x40]\ninvert = maybe\n") == -1);
+    CHECK(parse("[board 0x40]\nfrequency\n") == -1);      // No value
+
+    // Each board once per bus:
+    CHECK(parse("[board 0x40]\n[board 0x40]\n") == -1);
+    CHECK(parse("[board 0x40]\n[board 0x40]\nbus = 1\n") == 0);
+
+    // Too fast for the clock (PRE_SCALE under 3):
+    CHECK(parse("[board 0x40]\nfrequency = 2000\n") == -1);
+
+    // The ALLCALL address is only free if nothing else answers it:
+    CHECK(parse("[board 0x40]\n[board 0x70]\n") == -1);
+    CHECK(parse("[board 0x40]\nallcall = no\n"
+                "[board 0x70]\nallcall = no\n") == 0);
+
+    CHECK(config.num_boards == 2);
+}
+
+// Wake, one oscillator wait, then RESTART (page 15):
+static void test_run_order(void) {
+    int settled = -1;
+    int awake = 0;
+    int restarts = 0;
+    int i;
+
+    CHECK(parse("[board 0x40]\n[board 0x41]\n") == 0);
+    config.boards[0].reg_values[MODE1] |= MODE1_RESTART_BIT;
+
+    set_bus(&recording_bus);
+    invalidate_register_cache(ALL_DEVICES);
+    num_events = 0;
+
+    CHECK(run_config(&config) == 0);
+
+    for (i = 0; i < num_events; i++) {
+        if (events[i].usec) {
+            CHECK(settled < 0);
+            CHECK(events[i].usec >= OSCILLATOR_SETTLE_US);
+            settled = i;
+        } else if (events[i].reg_addr != MODE1) {
+            CHECK(settled < 0);
+        } else if (settled < 0) {
+            CHECK(!(events[i].value & MODE1_RESTART_BIT));
+            awake += !(events[i].value & MODE1_SLEEP_BIT);
+        } else {
+            CHECK(events[i].device_addr == 0x40);
+            CHECK(events[i].value & MODE1_RESTART_BIT);
+            CHECK(!(events[i].value & MODE1_SLEEP_BIT));
+            restarts++;
+        }
+    }
+
+    // Both boards were awake before the wait, only 0x40 restarted after:
+    CHECK(settled >= 0);
+    CHECK(awake == 2);
+    CHECK(restarts == 1);
+
+    set_bus(NULL);
+}
+
+int main(void) {
+    test_example();
+    test_safe_defaults();
+    test_mode_settings();
+    test_errors();
+    test_run_order();
+
+    return test_result("test_config");
+}
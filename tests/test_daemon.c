@@ -0,0 +1,497 @@
+// Raspberry Pi PCA9685 Example
+//
+// Copyright (c) 2022 Benjamin Spencer
+// ============================================================================
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+// ============================================================================
+
+// pca9685d smoke tests
+//
+// Runs pca9685d_sim (the daemon on simulated boards 0x40 and 0x41, see
+// pca9685d_sim.c) from the same directory as this test, talks to it over
+// its socket and the setpoint ring, stops it and checks the registers it
+// left behind.
+
+#define _GNU_SOURCE // mkdtemp()
+
+// Include C standard libraries:
+#include <stdio.h>      // C Standard I/O libary
+#include <stdlib.h>     // C Standard library
+#include <stdint.h>     // C Standard integer types
+#include <string.h>     // C Standard string manipulation
+#include <signal.h>     // C Standard signals
+#include <time.h>       // C Standard date and time manipulation
+#include <fcntl.h>      // POSIX open()
+#include <unistd.h>     // POSIX fork(), exec(), read(), write()
+#include <libgen.h>     // POSIX dirname()
+#include <sys/mman.h>   // POSIX mmap()
+#include <sys/socket.h> // POSIX sockets
+#include <sys/stat.h>   // POSIX stat()
+#include <sys/un.h>     // POSIX UNIX domain sockets
+#include <sys/wait.h>   // POSIX waitpid()
+
+#include "pca9685_registers.h" // PCA9685 register definitions
+#include "pca9685_encode.h"    // PCA9685 duty cycle encoder
+#include "pca9685d.h"          // pca9685d shared memory protocol
+#include "test_util.h"         // Test helpers
+
+#define SIM_BOARDS 2
+#define SIM_DUMP_BYTES 256
+#define CONNECT_TRIES 200 // 10 ms apart
+#define BREAKER_WAIT_MS 1200 // The daemon's breaker_ms (1 s) and some
+
+// MODE1 ALLCALL bit (page 14):
+#define MODE1_ALLCALL_BIT 0x01
+
+static char daemon_path[256];
+static char work_dir[] = "/tmp/pca9685d_test.XXXXXX";
+static char socket_path[300];
+static char dump_path[300];
+static char config_path[300];
+
+static uint8_t regs[SIM_BOARDS][SIM_DUMP_BYTES];
+
+static void sleep_ms(int ms) {
+    struct timespec wait = {ms / 1000, (ms % 1000) * 1000000L};
+
+    nanosleep(&wait, NULL);
+}
+
+// Start the daemon (with a config file if config is not NULL) and connect:
+static int start_daemon(pid_t *pid, const char *config) {
+    struct sockaddr_un address;
+
+    FILE *file;
+
+    int fd;
+    int i;
+
+    if (config != NULL) {
+        file = fopen(config_path, "w");
+        fputs(config, file);
+        fclose(file);
+    }
+
+    if ((*pid = fork()) == 0) {
+        setenv("PCA9685D_SIM_DUMP", dump_path, 1);
+
+        // Keep the banner out of the test output:
+        dup2(open("/dev/null", O_WRONLY), STDOUT_FILENO);
+
+        if (config != NULL) {
+            execl(daemon_path, daemon_path, "-s", socket_path, "-c",
+                  config_path, (char *) NULL);
+        } else {
+            execl(daemon_path, daemon_path, "-s", socket_path,
+                  (char *) NULL);
+        }
+
+        _exit(127);
+    }
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, socket_path);
+
+    for (i = 0; i < CONNECT_TRIES; i++) {
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+        if (connect(fd, (struct sockaddr *) &address, sizeof(address)) == 0) {
+            return fd;
+        }
+
+        close(fd);
+        sleep_ms(10);
+    }
+
+    return -1;
+}
+
+// Stop the daemon and load the registers it left the boards with:
+static int stop_daemon(pid_t pid, int fd) {
+    FILE *file;
+
+    int status;
+
+    close(fd);
+    kill(pid, SIGTERM);
+
+    if ((waitpid(pid, &status, 0) != pid) || !WIFEXITED(status)
+        || (WEXITSTATUS(status) != 0)) {
+        return -1;
+    }
+
+    if ((file = fopen(dump_path, "rb")) == NULL) {
+        return -1;
+    }
+
+    if (fread(regs, 1, sizeof(regs), file) != sizeof(regs)) {
+        fclose(file);
+        return -1;
+    }
+
+    fclose(file);
+
+    return 0;
+}
+
+// Read one reply line, and with MAP the two descriptors sent with it:
+static int read_reply(int fd, char *reply, int *fds) {
+    char control[CMSG_SPACE(2 * sizeof(int))];
+
+    struct iovec iov;
+    struct msghdr message;
+    struct cmsghdr *header;
+
+    ssize_t received;
+
+    int length = 0;
+
+    reply[0] = '\0';
+
+    while (strchr(reply, '\n') == NULL) {
+        iov.iov_base = reply + length;
+        iov.iov_len = PCA9685D_REPLY_LENGTH - 1 - length;
+
+        memset(&message, 0, sizeof(message));
+        message.msg_iov = &iov;
+        message.msg_iovlen = 1;
+        message.msg_control = control;
+        message.msg_controllen = sizeof(control);
+
+        if ((received = recvmsg(fd, &message, 0)) <= 0) {
+            return -1;
+        }
+
+        header = CMSG_FIRSTHDR(&message);
+
+        if ((fds != NULL) && (length == 0) && (header != NULL)) {
+            memcpy(fds, CMSG_DATA(header), 2 * sizeof(int));
+        }
+
+        length += received;
+        reply[length] = '\0';
+    }
+
+    return 0;
+}
+
+// Send a command; 1 if the reply is exactly expected:
+static int command(int fd, const char *line, const char *expected) {
+    char reply[PCA9685D_REPLY_LENGTH];
+
+    if ((dprintf(fd, "%s\n", line) < 0)
+        || (read_reply(fd, reply, NULL) < 0)) {
+        return 0;
+    }
+
+    if (strcmp(reply, expected)) {
+        fprintf(stderr, "%s: got %s", line, reply);
+        return 0;
+    }
+
+    return 1;
+}
+
+static int channel_duty(int board, int led_id) {
+    int led_register_values[LED_REG_BYTES];
+    int i;
+
+    for (i = 0; i < LED_REG_BYTES; i++) {
+        led_register_values[i] = regs[board][LED0_ON_L + 4 * led_id + i];
+    }
+
+    return decode_pwm_registers(led_register_values);
+}
+
+static void test_commands(void) {
+    struct stat info;
+
+    pid_t pid;
+    int fd;
+
+    CHECK((fd = start_daemon(&pid, NULL)) >= 0);
+
+    // Only the owner and group may connect:
+    CHECK(stat(socket_path, &info) == 0);
+    CHECK((info.st_mode & 0777) == 0660);
+
+    CHECK(command(fd, "BOARDS", "OK 2 0x40 0x41\n"));
+    CHECK(command(fd, "SET 17 5000", "OK\n")); // Clamped to full on
+    CHECK(command(fd, "SET 2 -7", "OK\n"));    // Clamped to off
+    CHECK(command(fd, "SET 5 1000", "OK\n"));
+    CHECK(command(fd, "SET 32 1", "ERR no channel 32\n"));
+    CHECK(command(fd, "SET -1 1", "ERR no channel -1\n"));
+    CHECK(command(fd, "HELLO", "ERR unknown command\n"));
+    CHECK(command(fd, "STATS", "OK setpoints 3 batches 3 dropped 0\n"));
+
+    CHECK(stop_daemon(pid, fd) == 0);
+    CHECK(channel_duty(1, 1) == PWM_FULL_SCALE);
+    CHECK(channel_duty(0, 2) == 0);
+    CHECK(channel_duty(0, 5) == 1000);
+
+    // Scanned, so ALLCALL was turned on:
+    CHECK(regs[0][MODE1] & MODE1_ALLCALL_BIT);
+}
+
+// Setpoints through shared memory, including past a dead producer:
+// MAP the daemon's ring; NULL if it can't be:
+static struct pca9685d_ring *map_ring(int fd, int *event_fd) {
+    struct pca9685d_ring *ring;
+
+    char reply[PCA9685D_REPLY_LENGTH];
+
+    int fds[2] = {-1, -1};
+
+    dprintf(fd, "MAP\n");
+
+    if ((read_reply(fd, reply, fds) < 0) || strcmp(reply, "OK 32 4096\n")) {
+        return NULL;
+    }
+
+    ring = mmap(NULL, sizeof(*ring), PROT_READ | PROT_WRITE, MAP_SHARED,
+                fds[0], 0);
+    close(fds[0]);
+    *event_fd = fds[1];
+
+    return (ring == MAP_FAILED) ? NULL : ring;
+}
+
+static void test_ring(void) {
+    struct pca9685d_ring *ring;
+
+    int event_fd;
+
+    pid_t pid;
+    int fd;
+
+    CHECK((fd = start_daemon(&pid, NULL)) >= 0);
+    CHECK((ring = map_ring(fd, &event_fd)) != NULL);
+
+    if (ring == NULL) {
+        stop_daemon(pid, fd);
+        return;
+    }
+
+    CHECK(ring->magic == PCA9685D_MAGIC);
+    CHECK(ring->num_channels == 32);
+    CHECK(pca9685d_push(ring, 32, 100) == -1);
+
+    CHECK(pca9685d_push(ring, 3, 1000) == 0);
+    CHECK(pca9685d_wake(ring, event_fd) == 0);
+    sleep_ms(50);
+
+    // A producer claims a slot and dies before filling it:
+    atomic_fetch_add(&ring->head, 1);
+    CHECK(pca9685d_push(ring, 20, 2000) == 0);
+    CHECK(pca9685d_wake(ring, event_fd) == 0);
+
+    sleep_ms(3 * PCA9685D_STUCK_MS);
+    CHECK(atomic_load(&ring->dropped) == 1);
+    CHECK(command(fd, "STATS", "OK setpoints 2 batches 2 dropped 1\n"));
+
+    // The ring keeps going after the skipped slot:
+    CHECK(pca9685d_push(ring, 21, 3000) == 0);
+    CHECK(pca9685d_wake(ring, event_fd) == 0);
+    sleep_ms(50);
+
+    CHECK(stop_daemon(pid, fd) == 0);
+    CHECK(channel_duty(0, 3) == 1000);
+    CHECK(channel_duty(1, 4) == 2000);
+    CHECK(channel_duty(1, 5) == 3000);
+}
+
+// A producer stalls past PCA9685D_STUCK_MS, its slot is taken back and
+// reused on the next lap, and then it finishes its push:
+static void test_slow_producer(void) {
+    struct pca9685d_ring *ring;
+
+    unsigned int stalled;
+    unsigned int owner;
+
+    int event_fd;
+    int pushed = 1;
+
+    pid_t pid;
+    int fd;
+
+    CHECK((fd = start_daemon(&pid, NULL)) >= 0);
+    CHECK((ring = map_ring(fd, &event_fd)) != NULL);
+
+    if (ring == NULL) {
+        stop_daemon(pid, fd);
+        return;
+    }
+
+    stalled = atomic_fetch_add(&ring->head, 1);
+    CHECK(pca9685d_push(ring, 20, 2000) == 0);
+    CHECK(pca9685d_wake(ring, event_fd) == 0);
+
+    sleep_ms(3 * PCA9685D_STUCK_MS);
+    CHECK(atomic_load(&ring->dropped) == 1);
+
+    // Go round the ring up to the stalled slot:
+    while (atomic_load(&ring->head) - stalled < PCA9685D_RING_SIZE) {
+        if (atomic_load(&ring->head) - atomic_load(&ring->tail)
+            >= PCA9685D_RING_SIZE / 2) {
+            pca9685d_wake(ring, event_fd);
+            sleep_ms(1);
+            continue;
+        }
+
+        pushed &= (pca9685d_push(ring, 6, 100) == 0);
+    }
+
+    CHECK(pushed);
+
+    // Another producer claims the slot on this lap:
+    owner = atomic_fetch_add(&ring->head, 1);
+    CHECK(owner == stalled + PCA9685D_RING_SIZE);
+
+    // The slow one's late push fails and leaves the slot alone:
+    CHECK(pca9685d_publish(ring, stalled, 7, 1234) == -1);
+    CHECK(atomic_load(&ring->slots[stalled & PCA9685D_RING_MASK].word)
+          == owner);
+
+    CHECK(pca9685d_publish(ring, owner, 8, 2500) == 0);
+    CHECK(pca9685d_wake(ring, event_fd) == 0);
+    sleep_ms(50);
+
+    CHECK(atomic_load(&ring->dropped) == 1);
+
+    CHECK(stop_daemon(pid, fd) == 0);
+    CHECK(channel_duty(0, 6) == 100);
+    CHECK(channel_duty(0, 7) == 0);
+    CHECK(channel_duty(0, 8) == 2500);
+    CHECK(channel_duty(1, 4) == 2000);
+}
+
+// Setpoints a board refused go out once it answers again:
+static void test_retry(void) {
+    pid_t pid;
+    int fd;
+
+    CHECK((fd = start_daemon(&pid, NULL)) >= 0);
+
+    kill(pid, SIGUSR1); // Every write fails
+    CHECK(command(fd, "SET 3 900", "OK\n"));
+    sleep_ms(50);
+
+    // Resent once the board's breaker lets writes through again:
+    kill(pid, SIGUSR2);
+    sleep_ms(BREAKER_WAIT_MS);
+
+    CHECK(stop_daemon(pid, fd) == 0);
+    CHECK(channel_duty(0, 3) == 900);
+}
+
+// The ring on its own: full ring, clamping and the sequence numbers:
+static void test_push(void) {
+    static struct pca9685d_ring ring;
+
+    uint64_t word;
+
+    int i;
+
+    ring.num_channels = 16;
+    atomic_init(&ring.head, 0);
+    atomic_init(&ring.tail, 0);
+    atomic_init(&ring.waiting, 0);
+    atomic_init(&ring.dropped, 0);
+
+    for (i = 0; i < PCA9685D_RING_SIZE; i++) {
+        atomic_init(&ring.slots[i].word, (uint64_t) i);
+    }
+
+    CHECK(pca9685d_push(&ring, 0, -5) == 0);
+    CHECK(pca9685d_push(&ring, 1, 5000) == 0);
+    word = atomic_load(&ring.slots[0].word);
+    CHECK((PCA9685D_CHANNEL(word) == 0) && (PCA9685D_DUTY_CYCLE(word) == 0));
+    word = atomic_load(&ring.slots[1].word);
+    CHECK(PCA9685D_SEQUENCE(word) == 2);
+    CHECK(PCA9685D_CHANNEL(word) == 1);
+    CHECK(PCA9685D_DUTY_CYCLE(word) == PCA9685D_FULL_SCALE);
+    CHECK(pca9685d_push(&ring, 16, 0) == -1);
+
+    for (i = 2; i < PCA9685D_RING_SIZE; i++) {
+        pca9685d_push(&ring, 2, i);
+    }
+
+    CHECK(atomic_load(&ring.head) == PCA9685D_RING_SIZE);
+    CHECK(pca9685d_push(&ring, 2, 0) == -1);
+    CHECK(atomic_load(&ring.dropped) == 1);
+
+    // Nobody asleep, nothing to write:
+    CHECK(pca9685d_wake(&ring, -1) == 0);
+}
+
+// With a config file its boards are used as configured, without a scan:
+static void test_config(void) {
+    pid_t pid;
+    int fd;
+
+    CHECK((fd = start_daemon(&pid, "[board 0x41]\n"
+                                   "allcall = no\n"
+                                   "led0.duty = 500\n")) >= 0);
+
+    CHECK(command(fd, "BOARDS", "OK 1 0x41\n"));
+    CHECK(command(fd, "SET 15 700", "OK\n"));
+    CHECK(command(fd, "STOP", "OK\n"));
+    CHECK(command(fd, "SET 16 1", "ERR no channel 16\n"));
+
+    CHECK(stop_daemon(pid, fd) == 0);
+
+    // allcall = no held, and the board not in the file was left alone:
+    CHECK(!(regs[1][MODE1] & MODE1_ALLCALL_BIT));
+    CHECK(channel_duty(1, 0) == 0);
+    CHECK(channel_duty(1, 15) == 0);
+    CHECK(regs[0][MODE1] == MODE1_DEFAULT);
+}
+
+int main(int argc, char **argv) {
+    char self[256];
+
+    snprintf(self, sizeof(self), "%s", argv[0]);
+    snprintf(daemon_path, sizeof(daemon_path), "%s/pca9685d_sim",
+             dirname(self));
+
+    if (mkdtemp(work_dir) == NULL) {
+        perror(work_dir);
+        return 1;
+    }
+
+    snprintf(socket_path, sizeof(socket_path), "%s/sock", work_dir);
+    snprintf(dump_path, sizeof(dump_path), "%s/regs", work_dir);
+    snprintf(config_path, sizeof(config_path), "%s/conf", work_dir);
+
+    signal(SIGPIPE, SIG_IGN);
+
+    test_push();
+    test_commands();
+    test_ring();
+    test_slow_producer();
+    test_retry();
+    test_config();
+
+    unlink(dump_path);
+    unlink(config_path);
+    rmdir(work_dir);
+
+    return test_result("test_daemon");
+}
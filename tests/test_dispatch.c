@@ -0,0 +1,231 @@
+// Raspberry Pi PCA9685 Example
+//
+// Copyright (c) 2022 Benjamin Spencer
+// ============================================================================
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+// ============================================================================
+
+// Bus dispatcher tests
+
+// Include C standard libraries:
+#include <stdint.h>    // C Standard integer types
+#include <stdatomic.h> // C Standard atomic operations
+#include <pthread.h>   // POSIX threads
+#include <semaphore.h> // POSIX semaphores
+
+#include "pca9685_registers.h" // PCA9685 register definitions
+#include "pca9685_bus.h"       // PCA9685 bus backend
+#include "pca9685_sim.h"       // Simulated PCA9685 bus
+#include "pca9685_cache.h"     // PCA9685 shadow register cache
+#include "pca9685_multi.h"     // PCA9685 multi-board manager
+#include "pca9685_dispatch.h"  // PCA9685 bus dispatcher
+#include "test_util.h"         // Test helpers
+
+#define NUM_TEST_BUSES 2
+
+static struct pca9685_sim sims[NUM_TEST_BUSES];
+static struct counting_bus counters[NUM_TEST_BUSES];
+static struct pca9685_multi multi;
+static struct pca9685_dispatch dispatch;
+
+// Thread that last wrote to each bus:
+static pthread_t writer[NUM_TEST_BUSES];
+
+static int duty_cycles[MAX_BOARDS * NUM_LED_CHANNELS];
+
+// Set to hold the next bus write until released:
+static atomic_int hold_write;
+static sem_t write_held;
+static sem_t write_released;
+
+static int record_write(void *context, int device_addr, int reg_addr,
+                        int *data, int bytes) {
+    struct counting_bus *counter = context;
+
+    writer[counter - counters] = pthread_self();
+
+    if (atomic_exchange(&hold_write, 0)) {
+        sem_post(&write_held);
+        sem_wait(&write_released);
+    }
+
+    return count_write(context, device_addr, reg_addr, data, bytes);
+}
+
+// Duty cycle a channel's registers give (phase offset included):
+static int channel_duty(uint8_t *reg, int led_id) {
+    uint8_t *led = &reg[LED0_ON_L + 4 * led_id];
+
+    return ((((led[3] << 8) | led[2]) - ((led[1] << 8) | led[0])) & 0xFFF);
+}
+
+// Board 0x40 on bus 0 and 0x41 on bus 1, discovered:
+static void setup(void) {
+    int bus_id;
+
+    invalidate_register_cache(ALL_DEVICES);
+
+    for (bus_id = 0; bus_id < MAX_BUSES; bus_id++) {
+        attach_bus(bus_id, NULL);
+    }
+
+    for (bus_id = 0; bus_id < NUM_TEST_BUSES; bus_id++) {
+        init_sim(&sims[bus_id]);
+        add_sim_device(&sims[bus_id], 0x40 + bus_id);
+        init_counting_bus(&counters[bus_id], &sims[bus_id].bus);
+        counters[bus_id].bus.write = record_write;
+        attach_bus(bus_id, &counters[bus_id].bus);
+    }
+
+    discover_boards(&multi);
+}
+
+static void test_route(void) {
+    int data[1] = {0x10};
+
+    setup();
+    CHECK(multi.num_boards == 2);
+    CHECK(multi.board_addr[1] == DEVICE_ID(1, 0x41));
+
+    CHECK(start_dispatch(&dispatch, 0) == 0);
+    CHECK(dispatch.running[0] && dispatch.running[1]);
+    CHECK(!dispatch.running[2] && !dispatch.running[3]);
+
+    CHECK(dispatch_write(&dispatch, DEVICE_ID(1, 0x41), LED0_OFF_L, data, 1,
+                         NULL, NULL) == 0);
+    CHECK(dispatch_duty_cycle(&dispatch, 0x40, 1, 0x200, NULL, NULL) == 0);
+
+    // No worker for buses that aren't attached:
+    CHECK(dispatch_write(&dispatch, DEVICE_ID(2, 0x40), LED0_OFF_L, data, 1,
+                         NULL, NULL) == -1);
+    CHECK(dispatch_write(&dispatch, -1, LED0_OFF_L, data, 1, NULL, NULL)
+          == -1);
+
+    CHECK(stop_dispatch(&dispatch) == 0);
+    CHECK(!dispatch.running[0] && !dispatch.running[1]);
+
+    CHECK(get_sim_registers(&sims[1], 0x41)[LED0_OFF_L] == 0x10);
+    CHECK(channel_duty(get_sim_registers(&sims[0], 0x40), 1) == 0x200);
+
+    // Each bus was written by its own worker:
+    CHECK(!pthread_equal(writer[0], writer[1]));
+    CHECK(!pthread_equal(writer[0], pthread_self()));
+    CHECK(!pthread_equal(writer[1], pthread_self()));
+
+    // Stopped:
+    CHECK(dispatch_write(&dispatch, 0x40, LED0_OFF_L, data, 1, NULL, NULL)
+          == -1);
+}
+
+static void test_duty_cycles(void) {
+    uint8_t *reg;
+    int bus_id;
+    int i;
+
+    setup();
+
+    for (i = 0; i < 2 * NUM_LED_CHANNELS; i++) {
+        duty_cycles[i] = 0x100 + i;
+    }
+
+    reset_counting_bus(&counters[0]);
+    reset_counting_bus(&counters[1]);
+
+    CHECK(start_dispatch(&dispatch, 1) == 0);
+    CHECK(dispatch_duty_cycles(&dispatch, &multi, duty_cycles) == 0);
+    CHECK(stop_dispatch(&dispatch) == 0);
+
+    // One bank write per board, each on its own bus:
+    for (bus_id = 0; bus_id < NUM_TEST_BUSES; bus_id++) {
+        reg = get_sim_registers(&sims[bus_id], 0x40 + bus_id);
+        i = bus_id * NUM_LED_CHANNELS + 15;
+
+        CHECK(counters[bus_id].writes == 1);
+        CHECK(channel_duty(reg, 15) == duty_cycles[i]);
+    }
+}
+
+static void record_status(int status, void *context) {
+    *(int *) context = status;
+}
+
+// Under overload a bank write supersedes the older channel and bank writes
+// for its board, and is itself superseded per channel:
+static void test_bank_staleness(void) {
+    uint8_t *reg;
+
+    int data[1] = {0x10};
+    int channel_status = -1;
+    int newer_status = -1;
+    int i;
+
+    setup();
+    sem_init(&write_held, 0, 0);
+    sem_init(&write_released, 0, 0);
+
+    reset_counting_bus(&counters[0]);
+    CHECK(start_dispatch(&dispatch, 0) == 0);
+
+    // Keep the bus 0 worker busy while everything else queues up:
+    atomic_store(&hold_write, 1);
+    CHECK(dispatch_write(&dispatch, 0x40, LED0_OFF_L, data, 1, NULL, NULL)
+          == 0);
+    sem_wait(&write_held);
+
+    CHECK(dispatch_duty_cycle(&dispatch, 0x40, 1, 0x300, record_status,
+                              &channel_status) == 0);
+
+    for (i = 0; i < 2 * NUM_LED_CHANNELS; i++) {
+        duty_cycles[i] = 0x100 + i;
+    }
+
+    CHECK(dispatch_duty_cycles(&dispatch, &multi, duty_cycles) == 0);
+
+    for (i = 0; i < 2 * NUM_LED_CHANNELS; i++) {
+        duty_cycles[i] = 0x200 + i;
+    }
+
+    CHECK(dispatch_duty_cycles(&dispatch, &multi, duty_cycles) == 0);
+    CHECK(dispatch_duty_cycle(&dispatch, 0x40, 2, 0x7FF, record_status,
+                              &newer_status) == 0);
+
+    sem_post(&write_released);
+    CHECK(stop_dispatch(&dispatch) == 0);
+
+    // The held write, the newest bank and the newer channel write:
+    CHECK(counters[0].writes == 3);
+    CHECK(channel_status == QUEUE_STALE);
+    CHECK(newer_status == QUEUE_DONE);
+
+    reg = get_sim_registers(&sims[0], 0x40);
+    CHECK(channel_duty(reg, 1) == 0x201);
+    CHECK(channel_duty(reg, 2) == 0x7FF);
+    CHECK(channel_duty(reg, 15) == 0x20F);
+
+    sem_destroy(&write_held);
+    sem_destroy(&write_released);
+}
+
+int main(void) {
+    test_route();
+    test_duty_cycles();
+    test_bank_staleness();
+
+    return test_result("test_dispatch");
+}
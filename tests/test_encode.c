@@ -0,0 +1,145 @@
+// Raspberry Pi PCA9685 Example
+//
+// Copyright (c) 2022 Benjamin Spencer
+// ============================================================================
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+// ============================================================================
+
+// Duty cycle encoder tests
+
+// Include C standard libraries:
+#include <stdint.h> // C Standard integer types
+
+#include "pca9685_encode.h" // PCA9685 duty cycle encoder
+#include "test_util.h"      // Test helpers
+
+// Register values worked out the long way (page 16):
+static void reference_encode(int duty_cycle, int led_delay_time,
+                             int *led_register_values) {
+    int led_on_time = led_delay_time % PWM_COUNTS;
+    int led_off_time = led_on_time + duty_cycle;
+
+    if (led_off_time >= PWM_COUNTS) {
+        led_off_time -= PWM_COUNTS;
+    }
+
+    led_register_values[0] = led_on_time & 0xFF;
+    led_register_values[1] = led_on_time >> 8;
+    led_register_values[2] = led_off_time & 0xFF;
+    led_register_values[3] = led_off_time >> 8;
+
+    if (duty_cycle <= 0) {
+        led_register_values[0] = 0;
+        led_register_values[1] = 0;
+        led_register_values[2] = 0;
+        led_register_values[3] = PWM_FULL_BIT;
+    } else if (duty_cycle >= PWM_FULL_SCALE) {
+        led_register_values[1] |= PWM_FULL_BIT;
+        led_register_values[2] = 0;
+        led_register_values[3] = 0;
+    }
+}
+
+static int same_registers(const int *a, const int *b) {
+    return (a[0] == b[0]) && (a[1] == b[1]) && (a[2] == b[2])
+           && (a[3] == b[3]);
+}
+
+static void test_every_duty_cycle(void) {
+    const int delays[4] = {0, PWM_DEFAULT_DELAY, 2048, PWM_COUNTS - 1};
+
+    int expected[LED_REG_BYTES];
+    int actual[LED_REG_BYTES];
+
+    int mismatches = 0;
+    int bad_off = 0;
+
+    int duty_cycle;
+    int i;
+
+    for (i = 0; i < 4; i++) {
+        for (duty_cycle = -1; duty_cycle <= PWM_COUNTS; duty_cycle++) {
+            reference_encode(duty_cycle, delays[i], expected);
+            encode_pwm_registers(duty_cycle, delays[i], actual);
+
+            mismatches += !same_registers(expected, actual);
+
+            // OFF count never reaches 4096 (bit 4 of OFF_H is full off):
+            bad_off += ((duty_cycle > 0) && (duty_cycle < PWM_FULL_SCALE)
+                        && (actual[3] & PWM_FULL_BIT));
+        }
+    }
+
+    CHECK(mismatches == 0);
+    CHECK(bad_off == 0);
+    CHECK(PWM_DEFAULT_DELAY == 409);
+}
+
+static void test_update(void) {
+    int registers[LED_REG_BYTES];
+    int expected[LED_REG_BYTES];
+
+    // Full off and on keep the counts and only move the full bits:
+    encode_pwm_registers(1000, PWM_DEFAULT_DELAY, registers);
+    encode_pwm_update(0, PWM_DEFAULT_DELAY, registers);
+    CHECK((registers[2] == 0x81) && (registers[3] == (0x05 | PWM_FULL_BIT)));
+
+    encode_pwm_update(PWM_FULL_SCALE, PWM_DEFAULT_DELAY, registers);
+    CHECK(registers[1] == (0x01 | PWM_FULL_BIT));
+    CHECK(registers[3] == 0x05);
+
+    encode_pwm_update(1000, PWM_DEFAULT_DELAY, registers);
+    reference_encode(1000, PWM_DEFAULT_DELAY, expected);
+    CHECK(same_registers(registers, expected));
+}
+
+static void test_bank(void) {
+    int duty_cycles[NUM_LED_CHANNELS];
+    int led_delay_times[NUM_LED_CHANNELS];
+    int led_bank[LED_BANK_BYTES];
+    int expected[LED_REG_BYTES];
+
+    int mismatches = 0;
+
+    int led_id;
+
+    for (led_id = 0; led_id < NUM_LED_CHANNELS; led_id++) {
+        duty_cycles[led_id] = (led_id * 300) - 100;
+        led_delay_times[led_id] = led_id * 256;
+    }
+
+    encode_pwm_bank(duty_cycles, led_delay_times, led_bank);
+
+    for (led_id = 0; led_id < NUM_LED_CHANNELS; led_id++) {
+        reference_encode(duty_cycles[led_id], led_delay_times[led_id],
+                         expected);
+        mismatches += !same_registers(&led_bank[led_id * LED_REG_BYTES],
+                                      expected);
+    }
+
+    CHECK(mismatches == 0);
+}
+
+int main(void) {
+    test_every_duty_cycle();
+    test_update();
+    test_bank();
+
+    return test_result("test_encode");
+}
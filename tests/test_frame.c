@@ -0,0 +1,166 @@
+// Raspberry Pi PCA9685 Example
+//
+// Copyright (c) 2022 Benjamin Spencer
+// ============================================================================
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+// ============================================================================
+
+// Double-buffered frame tests
+
+// Include C standard libraries:
+#include <stdint.h> // C Standard integer types
+
+#include "pca9685_registers.h" // PCA9685 register definitions
+#include "pca9685_bus.h"       // PCA9685 bus backend
+#include "pca9685_sim.h"       // Simulated PCA9685 bus
+#include "pca9685_cache.h"     // PCA9685 shadow register cache
+#include "pca9685_freq.h"      // PCA9685 frequency planner
+#include "pca9685_metrics.h"   // PCA9685 bus metrics (clock)
+#include "pca9685_frame.h"     // PCA9685 double-buffered frames
+#include "test_util.h"         // Test helpers
+
+#define TEST_ADDR 0x40
+
+// MODE1/MODE2 bits (pages 14 and 16):
+#define MODE1_AI_BIT (0x01 << 5)
+#define MODE2_OCH_BIT (0x01 << 3) // Set: outputs change on ACK
+
+// 4096 * (PRE_SCALE + 1) oscillator cycles:
+#define DEFAULT_PERIOD_NS (4096ULL * (0x1E + 1) * 1000000000 / 25000000)
+#define SLOW_PERIOD_NS (4096ULL * (0x79 + 1) * 1000000000 / 25000000)
+
+static struct pca9685_sim sim;
+static struct counting_bus counter;
+static struct pca9685_frame frame;
+
+// Duty cycle a channel's registers give (phase offset included):
+static int channel_duty(uint8_t *reg, int led_id) {
+    uint8_t *led = &reg[LED0_ON_L + 4 * led_id];
+
+    return ((((led[3] << 8) | led[2]) - ((led[1] << 8) | led[0])) & 0xFFF);
+}
+
+static void setup(void) {
+    init_sim(&sim);
+    add_sim_device(&sim, TEST_ADDR);
+    init_counting_bus(&counter, &sim.bus);
+    set_bus(&counter.bus);
+    invalidate_register_cache(ALL_DEVICES);
+    init_register_cache(TEST_ADDR);
+    set_clock_frequency(TEST_ADDR, 25000000);
+}
+
+static void test_init(void) {
+    int mode2[1] = {MODE2_DEFAULT | MODE2_OCH_BIT};
+    uint8_t *reg;
+
+    setup();
+    reg = get_sim_registers(&sim, TEST_ADDR);
+    write_register_cache(TEST_ADDR, MODE2, mode2, 1);
+
+    CHECK(init_frame(&frame, TEST_ADDR) == 0);
+    CHECK(frame.period_ns == DEFAULT_PERIOD_NS);
+    CHECK(frame.staged == 0);
+    CHECK(reg[MODE1] & MODE1_AI_BIT);
+    CHECK(!(reg[MODE2] & MODE2_OCH_BIT));
+
+    CHECK(init_frame(&frame, -1) < 0);
+}
+
+static void test_commit(void) {
+    uint8_t *reg;
+    int duty_cycles[NUM_LED_CHANNELS];
+    int led_id;
+
+    setup();
+    reg = get_sim_registers(&sim, TEST_ADDR);
+    CHECK(init_frame(&frame, TEST_ADDR) == 0);
+
+    CHECK(stage_duty_cycle(&frame, 3, 0x300) == 0);
+    CHECK(stage_duty_cycle(&frame, 9, 0x900) == 0);
+    CHECK(stage_duty_cycle(&frame, NUM_LED_CHANNELS, 0x100) == -1);
+    CHECK(stage_duty_cycle(&frame, -1, 0x100) == -1);
+    CHECK(frame.staged == ((1 << 3) | (1 << 9)));
+
+    // Nothing goes out until the commit, then in one transaction:
+    CHECK(channel_duty(reg, 3) == 0);
+    reset_counting_bus(&counter);
+    CHECK(commit_frame(&frame) == 0);
+    CHECK(counter.writes == 1);
+    CHECK(channel_duty(reg, 3) == 0x300);
+    CHECK(channel_duty(reg, 9) == 0x900);
+    CHECK(frame.staged == 0);
+
+    // Empty commit:
+    reset_counting_bus(&counter);
+    CHECK(commit_frame(&frame) == 0);
+    CHECK(counter.writes == 0);
+
+    // Discarded channels keep their committed values:
+    stage_duty_cycle(&frame, 3, 0x123);
+    discard_frame(&frame);
+    CHECK(commit_frame(&frame) == 0);
+    CHECK(channel_duty(reg, 3) == 0x300);
+
+    for (led_id = 0; led_id < NUM_LED_CHANNELS; led_id++) {
+        duty_cycles[led_id] = 0x40 * led_id;
+    }
+
+    CHECK(stage_duty_cycles(&frame, duty_cycles) == 0);
+    reset_counting_bus(&counter);
+    CHECK(commit_frame(&frame) == 0);
+    CHECK(counter.writes == 1);
+
+    for (led_id = 0; led_id < NUM_LED_CHANNELS; led_id++) {
+        CHECK(channel_duty(reg, led_id) == duty_cycles[led_id]);
+    }
+}
+
+// The period comes from the device, not from what the caller asked for:
+static void test_period(void) {
+    int prescale[1] = {0x79}; // ~50 Hz
+    uint64_t start_ns;
+
+    setup();
+    CHECK(init_frame(&frame, TEST_ADDR) == 0);
+
+    // Retuned after init (the device is asleep, so PRE_SCALE takes it):
+    CHECK(write_register_cache(TEST_ADDR, PRE_SCALE, prescale, 1) == 0);
+    stage_duty_cycle(&frame, 0, 0x100);
+    CHECK(commit_frame(&frame) == 0);
+    CHECK(frame.period_ns == SLOW_PERIOD_NS);
+
+    // A calibrated oscillator shortens it:
+    set_clock_frequency(TEST_ADDR, 26000000);
+    stage_duty_cycle(&frame, 0, 0x200);
+    start_ns = metrics_now();
+    CHECK(commit_frame(&frame) == 0);
+    CHECK(frame.period_ns == SLOW_PERIOD_NS * 25 / 26);
+
+    // The commit waited out the rest of the previous period:
+    CHECK(metrics_now() - start_ns >= SLOW_PERIOD_NS / 2);
+}
+
+int main(void) {
+    test_init();
+    test_commit();
+    test_period();
+
+    return test_result("test_frame");
+}
@@ -0,0 +1,142 @@
+// Raspberry Pi PCA9685 Example
+//
+// Copyright (c) 2022 Benjamin Spencer
+// ============================================================================
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+// ============================================================================
+
+// Frequency planner tests
+
+// Include C standard libraries:
+#include <stdint.h> // C Standard integer types
+
+#include "pca9685_registers.h" // PCA9685 register definitions
+#include "pca9685_bus.h"       // PCA9685 bus backend
+#include "pca9685_sim.h"       // Simulated PCA9685 bus
+#include "pca9685_cache.h"     // PCA9685 shadow register cache
+#include "pca9685_freq.h"      // PCA9685 frequency planner
+#include "test_util.h"         // Test helpers
+
+#define TEST_ADDR 0x40
+
+// MODE1 EXTCLK bit (page 14):
+#define MODE1_EXTCLK_BIT (0x01 << 6)
+
+// Distance of a prescale's output from the target, in microhertz:
+static int64_t distance_uhz(int clock_hz, int prescale, int frequency) {
+    int64_t achieved_uhz = (int64_t) clock_hz * 1000000
+                           / (4096 * (int64_t) (prescale + 1));
+    int64_t error = achieved_uhz - (int64_t) frequency * 1000000;
+
+    return (error < 0) ? -error : error;
+}
+
+// Same answer as trying every prescale:
+static void test_closest(void) {
+    const int clocks[3] = {INT_CLOCK_HZ, 24576000, EXT_CLOCK_MAX_HZ};
+
+    struct freq_plan plan;
+
+    int64_t best;
+
+    int worse = 0;
+    int clock;
+    int frequency;
+    int prescale;
+
+    for (clock = 0; clock < 3; clock++) {
+        for (frequency = 24; frequency <= 3000; frequency += 7) {
+            if (plan_frequency(clocks[clock], frequency, &plan) < 0) {
+                worse++;
+                continue;
+            }
+
+            best = distance_uhz(clocks[clock], plan.prescale, frequency);
+
+            for (prescale = PRESCALE_MIN; prescale <= PRESCALE_MAX;
+                 prescale++) {
+                // Allow for the millihertz rounding in the table:
+                if (distance_uhz(clocks[clock], prescale, frequency) + 1000
+                    < best) {
+                    worse++;
+                    break;
+                }
+            }
+        }
+    }
+
+    CHECK(worse == 0);
+}
+
+static void test_plans(void) {
+    struct freq_plan plan;
+
+    CHECK(plan_frequency(INT_CLOCK_HZ, 200, &plan) == 0);
+    CHECK(plan.prescale == PRE_SCALE_DEFAULT);
+    CHECK(plan.achieved_mhz == 196888);
+    CHECK((plan.error_ppm < -15000) && (plan.error_ppm > -16000));
+
+    // Out of range targets get the nearest end:
+    CHECK(plan_frequency(INT_CLOCK_HZ, 5000, &plan) == 0);
+    CHECK(plan.prescale == PRESCALE_MIN);
+    CHECK(plan_frequency(INT_CLOCK_HZ, 1, &plan) == 0);
+    CHECK(plan.prescale == PRESCALE_MAX);
+
+    CHECK(plan_frequency(0, 200, &plan) < 0);
+    CHECK(plan_frequency(EXT_CLOCK_MAX_HZ + 1, 200, &plan) < 0);
+    CHECK(plan_frequency(INT_CLOCK_HZ, 0, &plan) < 0);
+}
+
+static void test_clocks(void) {
+    struct pca9685_sim sim;
+
+    int prescale[1] = {PRE_SCALE_DEFAULT};
+
+    init_sim(&sim);
+    add_sim_device(&sim, TEST_ADDR);
+    set_bus(&sim.bus);
+    invalidate_register_cache(ALL_DEVICES);
+
+    CHECK(get_clock_frequency(TEST_ADDR) == INT_CLOCK_HZ);
+
+    // 196 Hz measured at PRE_SCALE 30: 196 * 4096 * 31
+    CHECK(write_register_cache(TEST_ADDR, PRE_SCALE, prescale, 1) == 0);
+    CHECK(calibrate_oscillator(TEST_ADDR, 196000) == 0);
+    CHECK(get_clock_frequency(TEST_ADDR) == 24887296);
+
+    CHECK(use_external_clock(TEST_ADDR, 24576000) == 0);
+    CHECK(get_sim_registers(&sim, TEST_ADDR)[MODE1] & MODE1_EXTCLK_BIT);
+    CHECK(get_clock_frequency(TEST_ADDR) == 24576000);
+
+    // A reset drops back to the calibrated internal oscillator:
+    CHECK(bus_power_cycle(0) == 0);
+    CHECK(invalidate_register_cache(TEST_ADDR) == 0);
+    CHECK(get_clock_frequency(TEST_ADDR) == 24887296);
+
+    CHECK(use_external_clock(TEST_ADDR, EXT_CLOCK_MAX_HZ + 1) < 0);
+    CHECK(get_clock_frequency(NUM_DEVICE_IDS) < 0);
+}
+
+int main(void) {
+    test_closest();
+    test_plans();
+    test_clocks();
+
+    return test_result("test_freq");
+}
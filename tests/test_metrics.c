@@ -0,0 +1,158 @@
+// Raspberry Pi PCA9685 Example
+//
+// Copyright (c) 2022 Benjamin Spencer
+// ============================================================================
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+// ============================================================================
+
+// Bus metrics tests
+
+// Include C standard libraries:
+#include <stdio.h>  // C Standard I/O libary
+#include <stdint.h> // C Standard integer types
+#include <string.h> // C Standard string manipulation
+#include <unistd.h> // POSIX usleep() and unlink()
+
+#include <pi_i2c.h> // Pi I2C library! (error codes)
+
+#include "pca9685_registers.h" // PCA9685 register definitions
+#include "pca9685_bus.h"       // PCA9685 bus backend
+#include "pca9685_sim.h"       // Simulated PCA9685 bus
+#include "pca9685_metrics.h"   // PCA9685 bus metrics
+#include "test_util.h"         // Test helpers
+
+#define TEST_ADDR 0x40
+#define BYTE_NS 20000 // 3 bytes per single register write: 60 us
+#define DUMP_PATH "/tmp/test_metrics.json"
+
+static struct pca9685_sim sim;
+
+static void test_buckets(void) {
+    int bucket;
+    int ordered = 1;
+
+    for (bucket = 0; bucket < 8; bucket++) {
+        CHECK(metrics_bucket_floor(bucket) == (uint64_t) bucket);
+    }
+
+    // 8 sub-buckets per power of two:
+    CHECK(metrics_bucket_floor(8) == 8);
+    CHECK(metrics_bucket_floor(16) == 16);
+    CHECK(metrics_bucket_floor(17) == 18);
+    CHECK(metrics_bucket_floor(24) == 32);
+
+    for (bucket = 1; bucket < METRICS_BUCKETS; bucket++) {
+        ordered &= metrics_bucket_floor(bucket)
+                   > metrics_bucket_floor(bucket - 1);
+    }
+
+    CHECK(ordered);
+}
+
+static void test_recording(void) {
+    struct pca9685_metrics snapshot;
+
+    uint64_t p50;
+
+    int data[1] = {0x01};
+    int i;
+
+    init_sim(&sim);
+    add_sim_device(&sim, TEST_ADDR);
+    set_bus(&sim.bus);
+    sim.byte_latency_ns = BYTE_NS;
+
+    reset_metrics();
+
+    for (i = 0; i < 20; i++) {
+        bus_write(TEST_ADDR, MODE1, data, 1);
+    }
+
+    bus_read(TEST_ADDR, MODE1, data, 1);
+    bus_write(0x41, MODE1, data, 1);
+
+    sim.bus_stuck = 1;
+    bus_write(TEST_ADDR, MODE1, data, 1);
+    sim.bus_stuck = 0;
+
+    get_metrics(&snapshot);
+
+    CHECK(snapshot.ops[METRICS_WRITE].count == 22);
+    CHECK(snapshot.ops[METRICS_READ].count == 1);
+    CHECK(snapshot.ops[METRICS_SCAN].count == 0);
+    CHECK(snapshot.errors[METRICS_ENACK] == 1);
+    CHECK(snapshot.errors[METRICS_EBUSLOCKUP] == 1);
+    CHECK(snapshot.errors[METRICS_OTHER] == 0);
+
+    // Median within one sub-bucket (12.5%) below the time held, allowing
+    // for scheduling noise above it:
+    p50 = metrics_percentile(&snapshot.ops[METRICS_WRITE], 0.50);
+    CHECK(p50 >= 3 * BYTE_NS * 7 / 8);
+    CHECK(p50 <= 3 * BYTE_NS * 2);
+    CHECK(snapshot.ops[METRICS_WRITE].max_ns >= p50);
+
+    reset_metrics();
+    get_metrics(&snapshot);
+    CHECK(snapshot.ops[METRICS_WRITE].count == 0);
+    CHECK(metrics_percentile(&snapshot.ops[METRICS_WRITE], 0.99) == 0);
+
+    CHECK(strcmp(metrics_error_name(METRICS_EDEVICEHUNG), "EDEVICEHUNG")
+          == 0);
+    CHECK(metrics_error_name(METRICS_ERRORS) == NULL);
+}
+
+static void test_dump(void) {
+    char line[4096];
+
+    FILE *dump;
+
+    int data[1] = {0x01};
+
+    unlink(DUMP_PATH);
+    sim.byte_latency_ns = 0;
+
+    bus_write(TEST_ADDR, MODE1, data, 1);
+
+    CHECK(start_metrics_dump(DUMP_PATH, 10) == 0);
+    usleep(50000);
+    CHECK(stop_metrics_dump() == 0);
+
+    dump = fopen(DUMP_PATH, "r");
+    CHECK(dump != NULL);
+
+    if (dump == NULL) {
+        return;
+    }
+
+    CHECK(fgets(line, sizeof(line), dump) != NULL);
+    CHECK(strncmp(line, "{\"time_ns\":", 11) == 0);
+    CHECK(strstr(line, "\"write\":{\"count\":1,") != NULL);
+    CHECK(strstr(line, "\"ENACK\":0") != NULL);
+
+    fclose(dump);
+    unlink(DUMP_PATH);
+}
+
+int main(void) {
+    test_buckets();
+    test_recording();
+    test_dump();
+
+    return test_result("test_metrics");
+}
@@ -0,0 +1,217 @@
+// Raspberry Pi PCA9685 Example
+//
+// Copyright (c) 2022 Benjamin Spencer
+// ============================================================================
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+// ============================================================================
+
+// Motion engine tests
+
+// Include C standard libraries:
+#include <stdint.h> // C Standard integer types
+
+#include "pca9685_registers.h" // PCA9685 register definitions
+#include "pca9685_bus.h"       // PCA9685 bus backend
+#include "pca9685_sim.h"       // Simulated PCA9685 bus
+#include "pca9685_cache.h"     // PCA9685 shadow register cache
+#include "pca9685_multi.h"     // PCA9685 multi-board manager
+#include "pca9685_motion.h"    // PCA9685 motion engine
+#include "pca9685.h"           // PCA9685 driver
+#include "test_util.h"         // Test helpers
+
+#define FREQUENCY 200 // 5000 us period
+
+static struct pca9685_sim sim;
+static struct counting_bus counter;
+static struct pca9685_multi multi;
+static struct pca9685_motion motion;
+
+static int device_duty(int device_addr, int led_id) {
+    uint8_t *reg = get_sim_registers(&sim, device_addr);
+
+    int led_register_values[LED_REG_BYTES];
+
+    int i;
+
+    for (i = 0; i < LED_REG_BYTES; i++) {
+        led_register_values[i] = reg[LED_REG(led_id) + i];
+    }
+
+    return decode_pwm_registers(led_register_values);
+}
+
+static void setup(void) {
+    init_sim(&sim);
+    add_sim_device(&sim, 0x40);
+    add_sim_device(&sim, 0x41);
+    init_counting_bus(&counter, &sim.bus);
+    set_bus(&counter.bus);
+    invalidate_register_cache(ALL_DEVICES);
+
+    discover_boards(&multi);
+}
+
+// Channels nobody moves keep what they had before the engine started:
+static void test_untracked_channels(void) {
+    uint64_t start_us;
+
+    setup();
+    CHECK(set_pwm_duty_cycle(0x40, 5, 1000) == 0);
+    CHECK(set_pwm_duty_cycle(0x41, 2, PWM_FULL_SCALE) == 0);
+
+    CHECK(init_motion(&motion, &multi, FREQUENCY) == 0);
+    CHECK(motion.period_us == 5000);
+    CHECK(motion.duty_cycles[5] == 1000);
+    CHECK(motion.duty_cycles[NUM_LED_CHANNELS + 2] == PWM_FULL_SCALE);
+
+    start_us = motion.last_tick_us;
+
+    reset_counting_bus(&counter);
+    CHECK(motion_tick(&motion, start_us) == 0);
+    CHECK(counter.writes == 0);
+
+    CHECK(push_keyframe(&motion, 0, start_us + 1000, 4000, MOTION_LINEAR)
+          == 0);
+    CHECK(motion_active(&motion) == 1);
+
+    CHECK(motion_tick(&motion, start_us + 500) == 0);
+    CHECK(counter.writes == 1);
+    CHECK(counter.last_addr == 0x40);
+    CHECK(device_duty(0x40, 0) == 2000);
+
+    CHECK(motion_tick(&motion, start_us + 1000) == 0);
+    CHECK(device_duty(0x40, 0) == 4000);
+    CHECK(motion_active(&motion) == 0);
+
+    CHECK(device_duty(0x40, 5) == 1000);
+    CHECK(device_duty(0x41, 2) == PWM_FULL_SCALE);
+    CHECK(device_duty(0x40, 6) == 0);
+}
+
+static void test_modes(void) {
+    uint64_t start_us;
+
+    int duty_cycle;
+
+    setup();
+    CHECK(init_motion(&motion, &multi, FREQUENCY) == 0);
+    start_us = motion.last_tick_us;
+
+    // Step holds until the keyframe time:
+    CHECK(push_keyframe(&motion, 1, start_us + 1000, 3000, MOTION_STEP)
+          == 0);
+    CHECK(motion_tick(&motion, start_us + 999) == 0);
+    CHECK(device_duty(0x40, 1) == 0);
+    CHECK(motion_tick(&motion, start_us + 1000) == 0);
+    CHECK(device_duty(0x40, 1) == 3000);
+
+    // S-curve is slower than linear near the start, exact at the middle:
+    CHECK(push_keyframe(&motion, 17, start_us + 2000, 2000, MOTION_S_CURVE)
+          == 0);
+    CHECK(motion_tick(&motion, start_us + 1250) == 0);
+    duty_cycle = device_duty(0x41, 1);
+    CHECK((duty_cycle > 0) && (duty_cycle < 500));
+    CHECK(motion_tick(&motion, start_us + 1500) == 0);
+    CHECK(device_duty(0x41, 1) == 1000);
+
+    // Spline passes through its keyframes:
+    CHECK(push_keyframe(&motion, 2, start_us + 3000, 1000, MOTION_SPLINE)
+          == 0);
+    CHECK(push_keyframe(&motion, 2, start_us + 4000, 3000, MOTION_SPLINE)
+          == 0);
+    CHECK(motion_tick(&motion, start_us + 3000) == 0);
+    CHECK(device_duty(0x40, 2) == 1000);
+    CHECK(motion_tick(&motion, start_us + 3500) == 0);
+    duty_cycle = device_duty(0x40, 2);
+    CHECK((duty_cycle > 1000) && (duty_cycle < 3000));
+    CHECK(motion_tick(&motion, start_us + 4000) == 0);
+    CHECK(device_duty(0x40, 2) == 3000);
+}
+
+static void test_keyframe_limits(void) {
+    uint64_t start_us;
+
+    int i;
+
+    setup();
+    CHECK(init_motion(&motion, &multi, FREQUENCY) == 0);
+    start_us = motion.last_tick_us;
+
+    CHECK(push_keyframe(&motion, 3, start_us + 100, 100, MOTION_LINEAR)
+          == 0);
+    CHECK(push_keyframe(&motion, 3, start_us + 100, 100, MOTION_LINEAR)
+          < 0);
+    CHECK(push_keyframe(&motion, 3, start_us + 200, 100, 4) < 0);
+    CHECK(push_keyframe(&motion, 2 * NUM_LED_CHANNELS, start_us + 200, 100,
+                        MOTION_LINEAR) < 0);
+
+    for (i = 2; i < MOTION_MAX_KEYFRAMES; i++) {
+        CHECK(push_keyframe(&motion, 3, start_us + 100 * i, 100,
+                            MOTION_LINEAR) == 0);
+    }
+
+    CHECK(push_keyframe(&motion, 3, start_us + 100 * i, 100, MOTION_LINEAR)
+          < 0);
+
+    // Values past full scale are clamped:
+    CHECK(set_motion_duty_cycle(&motion, 4, 5000) == 0);
+    CHECK(motion.duty_cycles[4] == PWM_FULL_SCALE);
+}
+
+// A board that fails a write gets it again on the next tick, and the
+// other boards are still updated:
+static void test_write_failure(void) {
+    uint64_t start_us;
+
+    setup();
+    CHECK(init_motion(&motion, &multi, FREQUENCY) == 0);
+    start_us = motion.last_tick_us;
+
+    CHECK(push_keyframe(&motion, 0, start_us + 100, 3000, MOTION_STEP)
+          == 0);
+    CHECK(push_keyframe(&motion, NUM_LED_CHANNELS, start_us + 100, 2000,
+                        MOTION_STEP) == 0);
+
+    sim.devices[0].hung = 1; // 0x40
+    CHECK(motion_tick(&motion, start_us + 100) < 0);
+    CHECK(motion.duty_cycles[0] == 0);
+    CHECK(device_duty(0x41, 0) == 2000);
+    CHECK(motion_active(&motion) == 0);
+
+    // The ramp is over but the channel is still resent:
+    sim.devices[0].hung = 0;
+    reset_counting_bus(&counter);
+    CHECK(motion_tick(&motion, start_us + 200) == 0);
+    CHECK(device_duty(0x40, 0) == 3000);
+    CHECK(motion.duty_cycles[0] == 3000);
+    CHECK(counter.last_addr == 0x40);
+
+    reset_counting_bus(&counter);
+    CHECK(motion_tick(&motion, start_us + 300) == 0);
+    CHECK(counter.writes == 0);
+}
+
+int main(void) {
+    test_untracked_channels();
+    test_modes();
+    test_keyframe_limits();
+    test_write_failure();
+
+    return test_result("test_motion");
+}
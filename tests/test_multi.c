@@ -0,0 +1,229 @@
+// Raspberry Pi PCA9685 Example
+//
+// Copyright (c) 2022 Benjamin Spencer
+// ============================================================================
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+// ============================================================================
+
+// Multi-board manager tests
+
+// Include C standard libraries:
+#include <stdint.h> // C Standard integer types
+
+#include "pca9685_registers.h" // PCA9685 register definitions
+#include "pca9685_bus.h"       // PCA9685 bus backend
+#include "pca9685_sim.h"       // Simulated PCA9685 bus
+#include "pca9685_cache.h"     // PCA9685 shadow register cache
+#include "pca9685_multi.h"     // PCA9685 multi-board manager
+#include "test_util.h"         // Test helpers
+
+#define ALLCALL_ADDR 0x70
+
+// MODE1 bits (page 14):
+#define MODE1_AI_BIT (0x01 << 5)
+#define MODE1_ALLCALL_BIT 0x01
+
+static struct pca9685_sim sim;
+static struct counting_bus counter;
+static struct pca9685_multi multi;
+
+static int duty_cycles[MAX_BOARDS * NUM_LED_CHANNELS];
+
+static void setup(void) {
+    init_sim(&sim);
+    init_counting_bus(&counter, &sim.bus);
+    set_bus(&counter.bus);
+    invalidate_register_cache(ALL_DEVICES);
+}
+
+static void test_discover(void) {
+    setup();
+    add_sim_device(&sim, 0x40);
+    add_sim_device(&sim, 0x41);
+
+    // 0x70 answers the scan as their ALLCALL address and is skipped:
+    CHECK(discover_boards(&multi) == 0);
+    CHECK(multi.num_boards == 2);
+    CHECK((multi.board_addr[0] == 0x40) && (multi.board_addr[1] == 0x41));
+    CHECK(multi.allcall_addr == ALLCALL_ADDR);
+    CHECK(get_sim_registers(&sim, 0x41)[MODE1]
+          == (MODE1_AI_BIT | 0x10 | MODE1_ALLCALL_BIT));
+}
+
+static void test_board_at_allcall_addr(void) {
+    uint8_t *reg;
+
+    // A lone board at 0x70 is a board:
+    setup();
+    add_sim_device(&sim, ALLCALL_ADDR);
+
+    CHECK(discover_boards(&multi) == 0);
+    CHECK(multi.num_boards == 1);
+    CHECK(multi.board_addr[0] == ALLCALL_ADDR);
+    CHECK(multi.allcall_addr == -1);
+
+    // So is one next to a board that doesn't answer ALLCALL; ALLCALL then
+    // stays off:
+    setup();
+    add_sim_device(&sim, 0x40);
+    add_sim_device(&sim, ALLCALL_ADDR);
+    reg = get_sim_registers(&sim, 0x40);
+    reg[MODE1] &= ~MODE1_ALLCALL_BIT;
+
+    CHECK(discover_boards(&multi) == 0);
+    CHECK(multi.num_boards == 2);
+    CHECK(multi.allcall_addr == -1);
+    CHECK(!(reg[MODE1] & MODE1_ALLCALL_BIT));
+    CHECK(reg[MODE1] & MODE1_AI_BIT);
+
+    CHECK(emergency_stop(&multi) == 0);
+    CHECK(reg[LED0_OFF_H] & PWM_FULL_BIT);
+
+    // With ALLCALL on, the board at 0x40 also answers 0x70:
+    setup();
+    add_sim_device(&sim, 0x40);
+    add_sim_device(&sim, ALLCALL_ADDR);
+
+    CHECK(discover_boards(&multi) == 0);
+    CHECK(multi.num_boards == 1);
+    CHECK(multi.board_addr[0] == 0x40);
+}
+
+static void test_group_writes(void) {
+    int channel;
+
+    setup();
+    add_sim_device(&sim, 0x40);
+    add_sim_device(&sim, 0x41);
+    add_sim_device(&sim, 0x42);
+    CHECK(discover_boards(&multi) == 0);
+
+    // Same value everywhere: one ALLCALL burst for all 16 channels:
+    for (channel = 0; channel < 3 * NUM_LED_CHANNELS; channel++) {
+        duty_cycles[channel] = 1000;
+    }
+
+    reset_counting_bus(&counter);
+    CHECK(set_multi_duty_cycles(&multi, duty_cycles) == 0);
+    CHECK(counter.writes == 1);
+    CHECK(counter.last_addr == ALLCALL_ADDR);
+    CHECK(get_sim_registers(&sim, 0x42)[LED15_OFF_L] == 0x81);
+
+    // Boards 0 and 2 in group 0 share a new value, board 1 differs:
+    CHECK(set_board_group(&multi, 0, 0x05) == 0);
+
+    for (channel = 0; channel < 3 * NUM_LED_CHANNELS; channel++) {
+        duty_cycles[channel] = (channel / NUM_LED_CHANNELS == 1) ? 300
+                                                                : 2000;
+    }
+
+    reset_counting_bus(&counter);
+    CHECK(set_multi_duty_cycles(&multi, duty_cycles) == 0);
+    CHECK(counter.writes == 2);
+    CHECK(get_sim_registers(&sim, 0x40)[LED7_OFF_H] == 0x09);
+    CHECK(get_sim_registers(&sim, 0x42)[LED7_OFF_H] == 0x09);
+    CHECK(get_sim_registers(&sim, 0x41)[LED7_OFF_H] == 0x02);
+
+    CHECK(set_multi_duty_cycle(&multi, 17, 0) == 0);
+    CHECK(get_sim_registers(&sim, 0x41)[LED1_OFF_H] & PWM_FULL_BIT);
+    CHECK(set_multi_duty_cycle(&multi, 3 * NUM_LED_CHANNELS, 0) < 0);
+
+    // One byte per bus stops everything:
+    reset_counting_bus(&counter);
+    CHECK(emergency_stop(&multi) == 0);
+    CHECK(counter.writes == 1);
+    CHECK(get_sim_registers(&sim, 0x42)[LED3_OFF_H] & PWM_FULL_BIT);
+}
+
+static void test_group_addr_clash(void) {
+    setup();
+    add_sim_device(&sim, 0x40);
+    add_sim_device(&sim, 0x71); // SUBADR1 by default, not enabled
+
+    CHECK(discover_boards(&multi) == 0);
+    CHECK(multi.num_boards == 2);
+
+    CHECK(set_board_group(&multi, 0, 0x01) < 0);
+    CHECK(set_board_group(&multi, 1, 0x03) == 0);
+}
+
+// Without ALLCALL every board gets its own blackout byte:
+static void test_emergency_stop_per_board(void) {
+    setup();
+    add_sim_device(&sim, 0x40);
+    add_sim_device(&sim, 0x41);
+    add_sim_device(&sim, ALLCALL_ADDR);
+    get_sim_registers(&sim, 0x40)[MODE1] &= ~MODE1_ALLCALL_BIT;
+    get_sim_registers(&sim, 0x41)[MODE1] &= ~MODE1_ALLCALL_BIT;
+    CHECK(discover_boards(&multi) == 0);
+    CHECK(multi.allcall_addr == -1);
+
+    CHECK(set_multi_duty_cycle(&multi, 2, 1000) == 0);
+
+    reset_counting_bus(&counter);
+    CHECK(emergency_stop(&multi) == 0);
+    CHECK(counter.writes == 3);
+    CHECK(counter.bytes_written == 3);
+    CHECK(get_sim_registers(&sim, 0x40)[LED2_OFF_H] & PWM_FULL_BIT);
+    CHECK(get_sim_registers(&sim, ALLCALL_ADDR)[LED9_OFF_H] & PWM_FULL_BIT);
+
+    // The caches know every channel is off:
+    reset_counting_bus(&counter);
+    CHECK(set_multi_duty_cycle(&multi, 2, 0) == 0);
+    CHECK(counter.writes == 0);
+}
+
+// Known boards are taken as given, and their ALLCALL setting kept:
+static void test_init_boards(void) {
+    int board_addrs[] = {0x40, 0x41};
+    int duplicates[] = {0x40, 0x40};
+
+    setup();
+    add_sim_device(&sim, 0x40);
+    add_sim_device(&sim, 0x41);
+    add_sim_device(&sim, 0x42);
+    get_sim_registers(&sim, 0x41)[MODE1] &= ~MODE1_ALLCALL_BIT;
+
+    CHECK(init_boards(&multi, board_addrs, 0) < 0);
+    CHECK(init_boards(&multi, board_addrs, MAX_BOARDS + 1) < 0);
+    CHECK(init_boards(&multi, duplicates, 2) < 0);
+
+    CHECK(init_boards(&multi, board_addrs, 2) == 0);
+    CHECK(multi.num_boards == 2);
+    CHECK(multi.allcall_addr == -1);
+    CHECK(get_sim_registers(&sim, 0x41)[MODE1] == (MODE1_AI_BIT | 0x10));
+    CHECK(get_sim_registers(&sim, 0x42)[MODE1] == MODE1_DEFAULT);
+
+    // Every board answers ALLCALL, so group writes can use it:
+    get_sim_registers(&sim, 0x41)[MODE1] |= MODE1_ALLCALL_BIT;
+    invalidate_register_cache(ALL_DEVICES);
+    CHECK(init_boards(&multi, board_addrs, 2) == 0);
+    CHECK(multi.allcall_addr == ALLCALL_ADDR);
+}
+
+int main(void) {
+    test_discover();
+    test_init_boards();
+    test_board_at_allcall_addr();
+    test_group_writes();
+    test_group_addr_clash();
+    test_emergency_stop_per_board();
+
+    return test_result("test_multi");
+}
@@ -0,0 +1,131 @@
+// Raspberry Pi PCA9685 Example
+//
+// Copyright (c) 2022 Benjamin Spencer
+// ============================================================================
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+// ============================================================================
+
+// Phase scheduler tests
+
+// Include C standard libraries:
+#include <stdint.h> // C Standard integer types
+
+#include "pca9685_registers.h" // PCA9685 register definitions
+#include "pca9685_bus.h"       // PCA9685 bus backend
+#include "pca9685_sim.h"       // Simulated PCA9685 bus
+#include "pca9685_cache.h"     // PCA9685 shadow register cache
+#include "pca9685_pwm.h"       // PCA9685 PWM output helpers
+#include "pca9685_phase.h"     // PCA9685 phase scheduler
+#include "pca9685.h"           // PCA9685 driver
+#include "test_util.h"         // Test helpers
+
+#define TEST_ADDR 0x40
+
+static void test_phases(void) {
+    int led_delay_times[NUM_LED_CHANNELS];
+
+    CHECK(get_channel_phase(TEST_ADDR, 5) == PWM_DEFAULT_DELAY);
+    CHECK(set_channel_phase(TEST_ADDR, 5, 1234) == 0);
+    CHECK(get_channel_phase(TEST_ADDR, 5) == 1234);
+
+    CHECK(set_channel_phase(TEST_ADDR, 5, PWM_COUNTS) < 0);
+    CHECK(set_channel_phase(TEST_ADDR, 16, 0) < 0);
+    CHECK(set_channel_phase(NUM_DEVICE_IDS, 0, 0) < 0);
+
+    CHECK(get_channel_phases(TEST_ADDR, led_delay_times) == 0);
+    CHECK((led_delay_times[5] == 1234)
+          && (led_delay_times[6] == PWM_DEFAULT_DELAY));
+}
+
+static void test_strategies(void) {
+    int duty_cycles[NUM_LED_CHANNELS];
+    int led_delay_times[NUM_LED_CHANNELS];
+
+    struct phase_stats stats;
+
+    int led_id;
+
+    for (led_id = 0; led_id < NUM_LED_CHANNELS; led_id++) {
+        duty_cycles[led_id] = 256;
+    }
+
+    // Every channel on the same tick:
+    CHECK(schedule_phases(TEST_ADDR, duty_cycles, PHASE_FIXED) == 0);
+    CHECK(get_channel_phases(TEST_ADDR, led_delay_times) == 0);
+    CHECK(get_phase_stats(duty_cycles, led_delay_times, &stats) == 0);
+    CHECK((stats.peak_on == 16) && (stats.peak_edges == 16));
+
+    // Spread evenly, 256 counts apart, so never two on at once:
+    CHECK(schedule_phases(TEST_ADDR, duty_cycles, PHASE_ROUND_ROBIN) == 0);
+    CHECK(get_channel_phases(TEST_ADDR, led_delay_times) == 0);
+    CHECK(led_delay_times[15] == 15 * 256);
+    CHECK(get_phase_stats(duty_cycles, led_delay_times, &stats) == 0);
+    CHECK((stats.peak_on == 1) && (stats.peak_edges == 1));
+
+    // Back to back, wrapping past the end of the frame:
+    for (led_id = 0; led_id < NUM_LED_CHANNELS; led_id++) {
+        duty_cycles[led_id] = 600;
+    }
+
+    duty_cycles[3] = 0;
+    duty_cycles[4] = PWM_FULL_SCALE;
+
+    CHECK(schedule_phases(TEST_ADDR, duty_cycles, PHASE_LOAD_BALANCED)
+          == 0);
+    CHECK(get_channel_phases(TEST_ADDR, led_delay_times) == 0);
+    CHECK((led_delay_times[2] == 1200) && (led_delay_times[5] == 1800));
+    CHECK(get_phase_stats(duty_cycles, led_delay_times, &stats) == 0);
+
+    // 14 * 600 counts over a 4096 frame plus one channel always on:
+    CHECK(stats.peak_on == 4);
+    CHECK(stats.peak_edges == 1);
+
+    CHECK(schedule_phases(TEST_ADDR, duty_cycles, 3) < 0);
+}
+
+// Phases are picked up by the next duty cycle write:
+static void test_written(void) {
+    struct pca9685_sim sim;
+
+    int duty_cycles[2] = {1000, 1000};
+    uint8_t *reg;
+
+    init_sim(&sim);
+    add_sim_device(&sim, 0x41);
+    set_bus(&sim.bus);
+    reg = get_sim_registers(&sim, 0x41);
+
+    CHECK(set_channel_phase(0x41, 1, 0x123) == 0);
+    CHECK(set_pwm_duty_cycles(0x41, duty_cycles, 2) == 0);
+    CHECK((reg[LED0_ON_L] == (PWM_DEFAULT_DELAY & 0xFF))
+          && (reg[LED0_ON_H] == (PWM_DEFAULT_DELAY >> 8)));
+    CHECK((reg[LED1_ON_L] == 0x23) && (reg[LED1_ON_H] == 0x01));
+    CHECK((reg[LED1_OFF_L] == 0x0B) && (reg[LED1_OFF_H] == 0x05));
+
+    CHECK(set_pwm_duty_cycle(0x41, 1, 2000) == 0);
+    CHECK((reg[LED1_ON_L] == 0x23) && (reg[LED1_ON_H] == 0x01));
+}
+
+int main(void) {
+    test_phases();
+    test_strategies();
+    test_written();
+
+    return test_result("test_phase");
+}
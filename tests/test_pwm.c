@@ -0,0 +1,293 @@
+// Raspberry Pi PCA9685 Example
+//
+// Copyright (c) 2022 Benjamin Spencer
+// ============================================================================
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+// ============================================================================
+
+// Batched PWM output tests
+
+// Include C standard libraries:
+#include <stdint.h> // C Standard integer types
+
+#include "pca9685_registers.h" // PCA9685 register definitions
+#include "pca9685_bus.h"       // PCA9685 bus backend
+#include "pca9685_sim.h"       // Simulated PCA9685 bus
+#include "pca9685_cache.h"     // PCA9685 shadow register cache
+#include "pca9685_pwm.h"       // PCA9685 PWM output helpers
+#include "pca9685.h"           // PCA9685 driver
+#include "test_util.h"         // Test helpers
+
+#define TEST_ADDR 0x40
+
+static struct pca9685_sim sim;
+static struct counting_bus counter;
+
+// Awake with auto-increment, like test_pca9685.c leaves the board:
+static void setup(void) {
+    int mode1[2] = {NORMAL_MODE, AI};
+
+    init_sim(&sim);
+    add_sim_device(&sim, TEST_ADDR);
+    init_counting_bus(&counter, &sim.bus);
+    set_bus(&counter.bus);
+    invalidate_register_cache(ALL_DEVICES);
+
+    configure_device(TEST_ADDR, MODE1, mode1, 2);
+    reset_counting_bus(&counter);
+}
+
+// Channel as the device has it: duty cycle, or -1 full off, PWM_COUNTS
+// full on:
+static int channel_duty(uint8_t *reg, int led_id) {
+    uint8_t *led = &reg[LED_REG(led_id)];
+
+    int on_time = led[0] | ((led[1] & 0x0F) << 8);
+    int off_time = led[2] | ((led[3] & 0x0F) << 8);
+
+    if (led[3] & PWM_FULL_BIT) {
+        return -1;
+    }
+
+    if (led[1] & PWM_FULL_BIT) {
+        return PWM_COUNTS;
+    }
+
+    return (off_time - on_time) & (PWM_COUNTS - 1);
+}
+
+static void test_full_bank(void) {
+    int duty_cycles[NUM_LED_CHANNELS];
+    uint8_t *reg;
+
+    int led_id;
+
+    setup();
+    reg = get_sim_registers(&sim, TEST_ADDR);
+
+    for (led_id = 0; led_id < NUM_LED_CHANNELS; led_id++) {
+        duty_cycles[led_id] = 100 + 200 * led_id;
+    }
+
+    CHECK(set_pwm_duty_cycles(TEST_ADDR, duty_cycles, NUM_LED_CHANNELS)
+          == 0);
+    CHECK(counter.writes == 1);
+    CHECK(counter.bytes_written == LED_BANK_BYTES);
+
+    for (led_id = 0; led_id < NUM_LED_CHANNELS; led_id++) {
+        CHECK(channel_duty(reg, led_id) == duty_cycles[led_id]);
+    }
+
+    // Nothing changed, nothing sent:
+    reset_counting_bus(&counter);
+    CHECK(set_pwm_duty_cycles(TEST_ADDR, duty_cycles, NUM_LED_CHANNELS)
+          == 0);
+    CHECK(counter.writes == 0);
+}
+
+static void test_runs(void) {
+    int duty_cycles[NUM_LED_CHANNELS] = {0};
+    uint8_t *reg;
+
+    int led_id;
+
+    setup();
+    reg = get_sim_registers(&sim, TEST_ADDR);
+
+    for (led_id = 0; led_id < NUM_LED_CHANNELS; led_id++) {
+        duty_cycles[led_id] = 1000;
+    }
+
+    CHECK(set_pwm_duty_cycles(TEST_ADDR, duty_cycles, NUM_LED_CHANNELS)
+          == 0);
+
+    // Channels 0 and 2 only differ in OFF_L: a 3-byte run and a whole
+    // channel between them, so two writes:
+    reset_counting_bus(&counter);
+    duty_cycles[0] = 1001;
+    duty_cycles[2] = 1001;
+    CHECK(set_pwm_duty_cycles(TEST_ADDR, duty_cycles, 3) == 0);
+    CHECK(counter.writes == 2);
+    CHECK(counter.bytes_written == 2);
+
+    // Channels 0 and 1: OFF_L of channel 0 to OFF_L of channel 1 is one
+    // run with a 3-byte gap, so still split:
+    reset_counting_bus(&counter);
+    duty_cycles[0] = 1002;
+    duty_cycles[1] = 1002;
+    CHECK(set_pwm_duty_cycles(TEST_ADDR, duty_cycles, 2) == 0);
+    CHECK(counter.writes == 2);
+
+    // OFF_L and OFF_H of channel 0 plus OFF_L of channel 1 (gap of 2) merge:
+    reset_counting_bus(&counter);
+    duty_cycles[0] = 2000;
+    duty_cycles[1] = 1003;
+    CHECK(set_pwm_duty_cycles(TEST_ADDR, duty_cycles, 2) == 0);
+    CHECK(counter.writes == 1);
+    CHECK(channel_duty(reg, 0) == 2000);
+    CHECK(channel_duty(reg, 1) == 1003);
+}
+
+static void test_mask(void) {
+    int duty_cycles[2] = {0, PWM_FULL_SCALE};
+    uint8_t *reg;
+
+    setup();
+    reg = get_sim_registers(&sim, TEST_ADDR);
+
+    CHECK(set_pwm_duty_cycles_mask(TEST_ADDR, (1 << 3) | (1 << 9),
+                                   duty_cycles) == 0);
+    CHECK(channel_duty(reg, 3) == -1);
+    CHECK(channel_duty(reg, 9) == PWM_COUNTS);
+    CHECK(channel_duty(reg, 4) == -1);
+
+    CHECK(set_pwm_duty_cycles_mask(TEST_ADDR, 1 << 16, duty_cycles) < 0);
+    CHECK(set_pwm_duty_cycles(TEST_ADDR, duty_cycles, 17) < 0);
+}
+
+// Same duty cycle everywhere is one ALL_LED write the cache knows about:
+static void test_all_led(void) {
+    int duty_cycles[NUM_LED_CHANNELS];
+    uint8_t *reg;
+
+    int led_id;
+
+    setup();
+    reg = get_sim_registers(&sim, TEST_ADDR);
+
+    CHECK(set_all_duty_cycle(TEST_ADDR, 1000) == 0);
+    CHECK(counter.writes == 1);
+    CHECK(counter.last_reg == ALL_LED_ON_L);
+    CHECK(counter.bytes_written == LED_REG_BYTES);
+
+    for (led_id = 0; led_id < NUM_LED_CHANNELS; led_id++) {
+        CHECK(channel_duty(reg, led_id) == 1000);
+        duty_cycles[led_id] = 1000;
+    }
+
+    // The cache saw it land in every channel:
+    reset_counting_bus(&counter);
+    CHECK(set_pwm_duty_cycles(TEST_ADDR, duty_cycles, NUM_LED_CHANNELS)
+          == 0);
+    CHECK(counter.writes == 0);
+
+    // Goes out again even though nothing changed (ALL_LED can't be read):
+    CHECK(set_all_duty_cycle(TEST_ADDR, 1000) == 0);
+    CHECK(counter.writes == 1);
+
+    // Off is the blackout byte:
+    reset_counting_bus(&counter);
+    CHECK(set_all_duty_cycle(TEST_ADDR, 0) == 0);
+    CHECK(counter.writes == 1);
+    CHECK(counter.last_reg == ALL_LED_OFF_H);
+    CHECK(channel_duty(reg, 15) == -1);
+}
+
+static void test_all_led_without_ai(void) {
+    int mode1[1] = {NO_AI};
+
+    setup();
+    configure_device(TEST_ADDR, MODE1, mode1, 1);
+    reset_counting_bus(&counter);
+
+    // One byte per register:
+    CHECK(set_all_duty_cycle(TEST_ADDR, 2000) == 0);
+    CHECK(counter.writes == LED_REG_BYTES);
+    CHECK(channel_duty(get_sim_registers(&sim, TEST_ADDR), 7) == 2000);
+
+    reset_counting_bus(&counter);
+    CHECK(blackout(TEST_ADDR) == 0);
+    CHECK(counter.writes == 1);
+    CHECK(channel_duty(get_sim_registers(&sim, TEST_ADDR), 7) == -1);
+}
+
+static void test_blackout(void) {
+    int duty_cycles[NUM_LED_CHANNELS];
+    uint8_t *reg;
+
+    int led_id;
+
+    setup();
+    reg = get_sim_registers(&sim, TEST_ADDR);
+
+    for (led_id = 0; led_id < NUM_LED_CHANNELS; led_id++) {
+        duty_cycles[led_id] = 100 * led_id + 1;
+    }
+
+    set_pwm_duty_cycles(TEST_ADDR, duty_cycles, NUM_LED_CHANNELS);
+
+    reset_counting_bus(&counter);
+    CHECK(blackout(TEST_ADDR) == 0);
+    CHECK(counter.writes == 1);
+    CHECK(counter.bytes_written == 1);
+
+    for (led_id = 0; led_id < NUM_LED_CHANNELS; led_id++) {
+        CHECK(channel_duty(reg, led_id) == -1);
+    }
+
+    // Coming back on rewrites OFF_H, which clears the full OFF bit:
+    CHECK(set_pwm_duty_cycles(TEST_ADDR, duty_cycles, NUM_LED_CHANNELS)
+          == 0);
+    CHECK(channel_duty(reg, 4) == 401);
+}
+
+// A full mask of all off or all on takes the ALL_LED path:
+static void test_mask_fast_path(void) {
+    int duty_cycles[NUM_LED_CHANNELS] = {0};
+    uint8_t *reg;
+
+    int led_id;
+
+    setup();
+    reg = get_sim_registers(&sim, TEST_ADDR);
+
+    CHECK(set_pwm_duty_cycles_mask(TEST_ADDR, 0xFFFF, duty_cycles) == 0);
+    CHECK(counter.writes == 1);
+    CHECK(counter.last_reg == ALL_LED_OFF_H);
+
+    for (led_id = 0; led_id < NUM_LED_CHANNELS; led_id++) {
+        duty_cycles[led_id] = PWM_FULL_SCALE + led_id; // All past full
+    }
+
+    reset_counting_bus(&counter);
+    CHECK(set_pwm_duty_cycles_mask(TEST_ADDR, 0xFFFF, duty_cycles) == 0);
+    CHECK(counter.writes == 1);
+    CHECK(counter.last_reg == ALL_LED_ON_L);
+    CHECK(channel_duty(reg, 11) == PWM_COUNTS);
+
+    // Mixed full on and full off goes through the bank:
+    duty_cycles[5] = 0;
+    reset_counting_bus(&counter);
+    CHECK(set_pwm_duty_cycles_mask(TEST_ADDR, 0xFFFF, duty_cycles) == 0);
+    CHECK(counter.last_reg != ALL_LED_ON_L);
+    CHECK(channel_duty(reg, 5) == -1);
+    CHECK(channel_duty(reg, 6) == PWM_COUNTS);
+}
+
+int main(void) {
+    test_full_bank();
+    test_runs();
+    test_mask();
+    test_all_led();
+    test_all_led_without_ai();
+    test_blackout();
+    test_mask_fast_path();
+
+    return test_result("test_pwm");
+}
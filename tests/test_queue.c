@@ -0,0 +1,194 @@
+// Raspberry Pi PCA9685 Example
+//
+// Copyright (c) 2022 Benjamin Spencer
+// ============================================================================
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+// ============================================================================
+
+// Asynchronous command queue tests
+
+// Include C standard libraries:
+#include <stdint.h>    // C Standard integer types
+#include <stdatomic.h> // C Standard atomic operations
+
+#include "pca9685_registers.h" // PCA9685 register definitions
+#include "pca9685_bus.h"       // PCA9685 bus backend
+#include "pca9685_sim.h"       // Simulated PCA9685 bus
+#include "pca9685_cache.h"     // PCA9685 shadow register cache
+#include "pca9685_pwm.h"       // PCA9685 PWM output helpers
+#include "pca9685_queue.h"     // PCA9685 asynchronous command queue
+#include "test_util.h"         // Test helpers
+
+#define TEST_ADDR 0x40
+#define NUM_UPDATES 100
+#define SLOW_BYTE_NS 50000 // Slow enough for the producer to get ahead
+
+struct outcome {
+    atomic_int done;
+    atomic_int stale;
+    atomic_int failed;
+    atomic_int last_done; // Index of the last update written
+};
+
+static struct pca9685_sim sim;
+static struct pca9685_queue queue;
+
+static struct outcome outcome;
+static int update_ids[NUM_UPDATES];
+
+static void record(int status, void *context) {
+    int *update_id = context;
+
+    if (status == QUEUE_DONE) {
+        atomic_fetch_add(&outcome.done, 1);
+        atomic_store(&outcome.last_done, *update_id);
+    } else if (status == QUEUE_STALE) {
+        atomic_fetch_add(&outcome.stale, 1);
+    } else {
+        atomic_fetch_add(&outcome.failed, 1);
+    }
+}
+
+// Awake with auto-increment so LED writes go out as one burst:
+static void setup(void) {
+    init_sim(&sim);
+    add_sim_device(&sim, TEST_ADDR);
+    get_sim_registers(&sim, TEST_ADDR)[MODE1] = 0x21;
+    set_bus(&sim.bus);
+    invalidate_register_cache(ALL_DEVICES);
+
+    atomic_init(&outcome.done, 0);
+    atomic_init(&outcome.stale, 0);
+    atomic_init(&outcome.failed, 0);
+    atomic_init(&outcome.last_done, -1);
+}
+
+static void test_writes(void) {
+    int data[2] = {0x21, 0x0C};
+    uint8_t *reg;
+
+    setup();
+    reg = get_sim_registers(&sim, TEST_ADDR);
+
+    CHECK(start_queue(&queue) == 0);
+    CHECK(queue_write(&queue, TEST_ADDR, MODE1, data, 2, record,
+                      &update_ids[0]) == 0);
+    CHECK(queue_duty_cycle(&queue, TEST_ADDR, 2, 1000, record,
+                           &update_ids[1]) == 0);
+
+    // Out of range ids and sizes are refused up front:
+    CHECK(queue_write(&queue, NUM_DEVICE_IDS, MODE1, data, 1, NULL, NULL)
+          < 0);
+    CHECK(queue_write(&queue, TEST_ADDR, MODE1, data, 0, NULL, NULL) < 0);
+    CHECK(queue_write(&queue, TEST_ADDR, MODE1, data, QUEUE_MAX_BYTES + 1,
+                      NULL, NULL) < 0);
+
+    CHECK(stop_queue(&queue) == 0);
+
+    CHECK(atomic_load(&outcome.done) == 2);
+    CHECK(reg[MODE2] == 0x0C);
+    CHECK(reg[LED2_OFF_L] == 0x81);
+}
+
+// Under overload only the newest setpoint of a channel goes out:
+static void test_staleness(void) {
+    uint8_t *reg;
+
+    int i;
+
+    setup();
+    reg = get_sim_registers(&sim, TEST_ADDR);
+    sim.byte_latency_ns = SLOW_BYTE_NS;
+
+    CHECK(start_queue(&queue) == 0);
+
+    for (i = 0; i < NUM_UPDATES; i++) {
+        update_ids[i] = i;
+        CHECK(queue_duty_cycle(&queue, TEST_ADDR, 0, 1000 + i, record,
+                               &update_ids[i]) == 0);
+    }
+
+    CHECK(stop_queue(&queue) == 0);
+
+    CHECK(atomic_load(&outcome.done) + atomic_load(&outcome.stale)
+          == NUM_UPDATES);
+    CHECK(atomic_load(&outcome.stale) > 0);
+    CHECK(atomic_load(&outcome.failed) == 0);
+    CHECK(atomic_load(&outcome.last_done) == NUM_UPDATES - 1);
+    CHECK((reg[LED0_OFF_L] | (reg[LED0_OFF_H] << 8))
+          == PWM_DEFAULT_DELAY + 1000 + NUM_UPDATES - 1);
+}
+
+// Plain register writes never go stale; a full ring refuses more:
+static void test_full(void) {
+    int data[1] = {0x00};
+
+    int refused = 0;
+
+    int i;
+
+    setup();
+    sim.byte_latency_ns = SLOW_BYTE_NS;
+
+    CHECK(start_queue(&queue) == 0);
+
+    for (i = 0; i < QUEUE_SIZE + 16; i++) {
+        refused += (queue_write(&queue, TEST_ADDR, LED0_ON_L, data, 1,
+                                record, &update_ids[0]) < 0);
+    }
+
+    CHECK(stop_queue(&queue) == 0);
+
+    CHECK(refused > 0);
+    CHECK(atomic_load(&outcome.stale) == 0);
+    CHECK(atomic_load(&outcome.done) == QUEUE_SIZE + 16 - refused);
+}
+
+// Devices on other buses have their own staleness slots:
+static void test_other_bus(void) {
+    struct pca9685_sim sim1;
+
+    uint8_t *reg;
+
+    setup();
+    init_sim(&sim1);
+    add_sim_device(&sim1, TEST_ADDR);
+    attach_bus(1, &sim1.bus);
+    reg = get_sim_registers(&sim1, TEST_ADDR);
+    reg[MODE1] = 0x21;
+
+    CHECK(start_queue(&queue) == 0);
+    CHECK(queue_duty_cycle(&queue, DEVICE_ID(1, TEST_ADDR), 0, 2000, record,
+                           &update_ids[0]) == 0);
+    CHECK(stop_queue(&queue) == 0);
+
+    CHECK(atomic_load(&outcome.done) == 1);
+    CHECK(reg[LED0_OFF_H] == 0x09);
+
+    attach_bus(1, NULL);
+}
+
+int main(void) {
+    test_writes();
+    test_staleness();
+    test_full();
+    test_other_bus();
+
+    return test_result("test_queue");
+}
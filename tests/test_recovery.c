@@ -0,0 +1,265 @@
+// Raspberry Pi PCA9685 Example
+//
+// Copyright (c) 2022 Benjamin Spencer
+// ============================================================================
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+// ============================================================================
+
+// Bus recovery tests
+
+// Include C standard libraries:
+#include <stdint.h> // C Standard integer types
+
+#include <pi_i2c.h> // Pi I2C library! (error codes)
+
+#include "pca9685_registers.h" // PCA9685 register definitions
+#include "pca9685_bus.h"       // PCA9685 bus backend
+#include "pca9685_sim.h"       // Simulated PCA9685 bus
+#include "pca9685_cache.h"     // PCA9685 shadow register cache
+#include "pca9685_recovery.h"  // PCA9685 bus recovery
+#include "test_util.h"         // Test helpers
+
+#define TEST_BUS 1
+#define HUNG_ADDR 0x40
+#define GOOD_ADDR 0x41
+
+static struct pca9685_sim sim;
+static struct counting_bus counter;
+static struct pca9685_recovery recovery;
+
+// Bus 0, which recovery on TEST_BUS must leave alone:
+static struct pca9685_sim other_sim;
+static struct counting_bus other;
+
+static int fail_writes; // Writes left to NACK
+static int delay_us;    // Slept on TEST_BUS
+static int other_delay_us;
+
+static int flaky_write(void *context, int device_addr, int reg_addr,
+                       int *data, int bytes) {
+    if (fail_writes > 0) {
+        fail_writes--;
+        return -ENACK;
+    }
+
+    return count_write(context, device_addr, reg_addr, data, bytes);
+}
+
+static int record_delay(void *context, int usec) {
+    delay_us += usec;
+
+    return 0;
+}
+
+static int record_other_delay(void *context, int usec) {
+    other_delay_us += usec;
+
+    return 0;
+}
+
+// Two boards on TEST_BUS with AI set and LED0 running, caches loaded:
+static void setup(int max_tier) {
+    uint8_t *reg;
+    int addr;
+
+    init_sim(&other_sim);
+    init_counting_bus(&other, &other_sim.bus);
+    other.bus.delay = record_other_delay;
+    set_bus(&other.bus);
+
+    init_sim(&sim);
+    init_counting_bus(&counter, &sim.bus);
+    counter.bus.write = flaky_write;
+    counter.bus.delay = record_delay;
+
+    init_recovery(&recovery, TEST_BUS, &counter.bus);
+    recovery.policy.max_tier = max_tier;
+    attach_bus(TEST_BUS, &recovery.bus);
+
+    invalidate_register_cache(ALL_DEVICES);
+
+    for (addr = HUNG_ADDR; addr <= GOOD_ADDR; addr++) {
+        add_sim_device(&sim, addr);
+        reg = get_sim_registers(&sim, addr);
+        reg[MODE1] = 0x21;
+        reg[LED0_OFF_H] = 0x08;
+        init_register_cache(DEVICE_ID(TEST_BUS, addr));
+    }
+
+    fail_writes = 0;
+    delay_us = 0;
+    other_delay_us = 0;
+}
+
+static void test_defaults(void) {
+    setup(RECOVERY_POWER_CYCLE);
+    init_recovery(&recovery, TEST_BUS, &counter.bus);
+
+    CHECK(recovery.policy.max_tier == RECOVERY_BUS_CLEAR);
+    CHECK(recovery.policy.max_retries == 3);
+    CHECK(recovery.policy.backoff_us == 100);
+
+    CHECK(recovery_error_class(-ENACK) == RECOVERY_TRANSIENT);
+    CHECK(recovery_error_class(-EBUSLOCKUP) == RECOVERY_BUS_FAULT);
+    CHECK(recovery_error_class(-EDEVICEHUNG) == RECOVERY_DEVICE_HUNG);
+}
+
+static void test_retry(void) {
+    struct recovery_stats stats;
+    int data[1] = {0x10};
+
+    setup(RECOVERY_BUS_CLEAR);
+    fail_writes = 2;
+
+    CHECK(bus_write(DEVICE_ID(TEST_BUS, GOOD_ADDR), LED0_OFF_L, data, 1)
+          == 0);
+    CHECK(get_sim_registers(&sim, GOOD_ADDR)[LED0_OFF_L] == 0x10);
+
+    // Backoff doubles and sleeps on the failing bus, not bus 0:
+    CHECK(delay_us == 100 + 200);
+    CHECK(other_delay_us == 0);
+
+    get_recovery_stats(&recovery, &stats);
+    CHECK(stats.errors[RECOVERY_TRANSIENT] == 1);
+    CHECK(stats.attempts[RECOVERY_RETRY] == 1);
+    CHECK(stats.recovered[RECOVERY_RETRY] == 1);
+    CHECK(stats.attempts[RECOVERY_BUS_CLEAR] == 0);
+    CHECK(stats.unrecovered == 0);
+}
+
+static void test_bus_clear(void) {
+    struct recovery_stats stats;
+    int data[1];
+
+    setup(RECOVERY_BUS_CLEAR);
+    sim.bus_stuck = 1;
+
+    CHECK(bus_read(DEVICE_ID(TEST_BUS, GOOD_ADDR), LED0_OFF_H, data, 1)
+          == 0);
+    CHECK(data[0] == 0x08);
+    CHECK(!sim.bus_stuck);
+    CHECK(delay_us == 0); // Bus faults skip the retries
+
+    get_recovery_stats(&recovery, &stats);
+    CHECK(stats.errors[RECOVERY_BUS_FAULT] == 1);
+    CHECK(stats.attempts[RECOVERY_RETRY] == 0);
+    CHECK(stats.recovered[RECOVERY_BUS_CLEAR] == 1);
+}
+
+// By default a hung board is taken out of service, not the whole bus reset:
+static void test_breaker(void) {
+    struct recovery_stats stats;
+    int data[1] = {0x10};
+
+    setup(RECOVERY_BUS_CLEAR);
+    sim.devices[0].hung = 1;
+
+    CHECK(bus_write(DEVICE_ID(TEST_BUS, HUNG_ADDR), LED0_OFF_L, data, 1)
+          == -EDEVICEHUNG);
+    CHECK(breaker_open(&recovery, HUNG_ADDR) == 1);
+    CHECK(breaker_open(&recovery, GOOD_ADDR) == 0);
+
+    // The other board was not reset:
+    CHECK(get_sim_registers(&sim, GOOD_ADDR)[MODE1] == 0x21);
+    CHECK(get_sim_registers(&sim, GOOD_ADDR)[LED0_OFF_H] == 0x08);
+
+    // Refused without touching the bus while the breaker is open:
+    reset_counting_bus(&counter);
+    CHECK(bus_write(DEVICE_ID(TEST_BUS, HUNG_ADDR), LED0_OFF_L, data, 1)
+          == -EDEVICEHUNG);
+    CHECK(counter.writes == 0);
+    CHECK(bus_write(DEVICE_ID(TEST_BUS, GOOD_ADDR), LED0_OFF_L, data, 1)
+          == 0);
+
+    get_recovery_stats(&recovery, &stats);
+    CHECK(stats.errors[RECOVERY_DEVICE_HUNG] == 1);
+    CHECK(stats.attempts[RECOVERY_SOFT_RESET] == 0);
+    CHECK(stats.attempts[RECOVERY_POWER_CYCLE] == 0);
+    CHECK(stats.unrecovered == 1);
+    CHECK(stats.breaker_trips == 1);
+    CHECK(stats.rejected == 1);
+
+    // Board replaced:
+    sim.devices[0].hung = 0;
+    CHECK(reset_breaker(&recovery, HUNG_ADDR) == 0);
+    CHECK(breaker_open(&recovery, HUNG_ADDR) == 0);
+    CHECK(bus_write(DEVICE_ID(TEST_BUS, HUNG_ADDR), LED0_OFF_L, data, 1)
+          == 0);
+    CHECK(reset_breaker(&recovery, NUM_DEVICE_ADDR) == -1);
+}
+
+// A breaker that has run out gets one retry and no recovery:
+static void test_half_open(void) {
+    struct recovery_stats stats;
+    int data[1] = {0x10};
+
+    setup(RECOVERY_BUS_CLEAR);
+    recovery.policy.breaker_ms = 0;
+    sim.devices[0].hung = 1;
+
+    CHECK(bus_write(DEVICE_ID(TEST_BUS, HUNG_ADDR), LED0_OFF_L, data, 1)
+          == -EDEVICEHUNG);
+    CHECK(bus_write(DEVICE_ID(TEST_BUS, HUNG_ADDR), LED0_OFF_L, data, 1)
+          == -EDEVICEHUNG);
+
+    get_recovery_stats(&recovery, &stats);
+    CHECK(stats.errors[RECOVERY_DEVICE_HUNG] == 2);
+    CHECK(stats.attempts[RECOVERY_BUS_CLEAR] == 0); // Hung starts at tier 3
+    CHECK(stats.breaker_trips == 1);
+    CHECK(stats.unrecovered == 2);
+
+    sim.devices[0].hung = 0;
+    CHECK(bus_write(DEVICE_ID(TEST_BUS, HUNG_ADDR), LED0_OFF_L, data, 1)
+          == 0);
+    CHECK(recovery.devices[HUNG_ADDR].open_until_ns == 0);
+}
+
+// Opted in, a software reset frees the board and restores both from cache:
+static void test_soft_reset(void) {
+    struct recovery_stats stats;
+    int data[1];
+
+    setup(RECOVERY_SOFT_RESET);
+    sim.devices[0].hung = 1;
+
+    CHECK(bus_read(DEVICE_ID(TEST_BUS, HUNG_ADDR), LED0_OFF_H, data, 1)
+          == 0);
+    CHECK(data[0] == 0x08);
+    CHECK(get_sim_registers(&sim, GOOD_ADDR)[MODE1] == 0x21);
+    CHECK(get_sim_registers(&sim, GOOD_ADDR)[LED0_OFF_H] == 0x08);
+    CHECK(breaker_open(&recovery, HUNG_ADDR) == 0);
+
+    get_recovery_stats(&recovery, &stats);
+    CHECK(stats.attempts[RECOVERY_RETRY] == 0);
+    CHECK(stats.recovered[RECOVERY_SOFT_RESET] == 1);
+    CHECK(stats.attempts[RECOVERY_POWER_CYCLE] == 0);
+    CHECK(stats.breaker_trips == 0);
+    CHECK(other.writes == 0);
+}
+
+int main(void) {
+    test_defaults();
+    test_retry();
+    test_bus_clear();
+    test_breaker();
+    test_half_open();
+    test_soft_reset();
+
+    return test_result("test_recovery");
+}
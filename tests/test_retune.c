@@ -0,0 +1,231 @@
+// Raspberry Pi PCA9685 Example
+//
+// Copyright (c) 2022 Benjamin Spencer
+// ============================================================================
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+// ============================================================================
+
+// Frequency retune tests
+
+// Include C standard libraries:
+#include <stdint.h> // C Standard integer types
+
+#include "pca9685_registers.h" // PCA9685 register definitions
+#include "pca9685_bus.h"       // PCA9685 bus backend
+#include "pca9685_sim.h"       // Simulated PCA9685 bus
+#include "pca9685_cache.h"     // PCA9685 shadow register cache
+#include "pca9685_freq.h"      // PCA9685 frequency planner
+#include "pca9685.h"           // PCA9685 driver
+#include "test_util.h"         // Test helpers
+
+#define ALLCALL_ADDR 0x70
+#define NEW_PRESCALE 0x3C // 100 Hz on the internal oscillator
+
+// MODE1 bits (page 14):
+#define MODE1_RESTART_BIT (0x01 << 7)
+#define MODE1_SLEEP_BIT (0x01 << 4)
+
+static struct pca9685_sim sim;
+static struct counting_bus counter;
+
+// A second bus for boards on bus 1:
+static struct pca9685_sim other_sim;
+static struct counting_bus other_counter;
+
+static int allcall_writes;
+static int delay_us;
+static int other_delay_us;
+
+static int record_write(void *context, int device_addr, int reg_addr,
+                        int *data, int bytes) {
+    allcall_writes += (device_addr == ALLCALL_ADDR);
+
+    return count_write(context, device_addr, reg_addr, data, bytes);
+}
+
+static int record_delay(void *context, int usec) {
+    delay_us += usec;
+
+    return 0;
+}
+
+static int record_other_delay(void *context, int usec) {
+    other_delay_us += usec;
+
+    return 0;
+}
+
+// Three boards with LED0 running, awake, caches loaded:
+static void setup(int awake) {
+    int mode1 = awake ? 0x21 : 0x31; // AI + ALLCALL, SLEEP if not awake
+    int led0[4] = {0x00, 0x00, 0x00, 0x08};
+    int addr;
+
+    init_sim(&sim);
+    init_counting_bus(&counter, &sim.bus);
+    counter.bus.write = record_write;
+    counter.bus.delay = record_delay;
+    set_bus(&counter.bus);
+    invalidate_register_cache(ALL_DEVICES);
+
+    for (addr = 0x40; addr <= 0x42; addr++) {
+        add_sim_device(&sim, addr);
+        init_register_cache(addr);
+        write_register_cache(addr, MODE1, &mode1, 1);
+        write_register_cache(addr, LED0_ON_L, led0, 4);
+    }
+
+    reset_counting_bus(&counter);
+    allcall_writes = 0;
+    delay_us = 0;
+}
+
+static void check_running(int device_addr, int prescale) {
+    uint8_t *reg = get_sim_registers(&sim, device_addr);
+
+    CHECK(reg[PRE_SCALE] == prescale);
+    CHECK(!(reg[MODE1] & (MODE1_SLEEP_BIT | MODE1_RESTART_BIT)));
+}
+
+// 0x42 answers ALLCALL too but isn't in the list, so no broadcasts:
+static void test_partial_list(void) {
+    const int device_addrs[2] = {0x40, 0x41};
+
+    setup(1);
+
+    CHECK(retune_devices(2, device_addrs, ALLCALL_ADDR, 100) == 0);
+    CHECK(allcall_writes == 0);
+    CHECK(delay_us == OSCILLATOR_SETTLE_US);
+
+    check_running(0x40, NEW_PRESCALE);
+    check_running(0x41, NEW_PRESCALE);
+    check_running(0x42, PRE_SCALE_DEFAULT);
+}
+
+static void test_whole_bus(void) {
+    const int device_addrs[3] = {0x40, 0x41, 0x42};
+
+    int mode1[1];
+
+    setup(1);
+
+    // Sleep, PRE_SCALE, wake and RESTART each go out once:
+    CHECK(retune_devices(3, device_addrs, ALLCALL_ADDR, 100) == 0);
+    CHECK(allcall_writes == 4);
+    CHECK(counter.writes == 4);
+    CHECK(delay_us == OSCILLATOR_SETTLE_US);
+
+    check_running(0x40, NEW_PRESCALE);
+    check_running(0x42, NEW_PRESCALE);
+
+    // Caches followed:
+    CHECK(read_register_cache(0x42, PRE_SCALE, mode1, 1) == 0);
+    CHECK(mode1[0] == NEW_PRESCALE);
+    CHECK(read_register_cache(0x42, MODE1, mode1, 1) == 0);
+    CHECK(mode1[0] == 0x21);
+
+    // Already there: nothing to do:
+    reset_counting_bus(&counter);
+    delay_us = 0;
+    CHECK(retune_devices(3, device_addrs, ALLCALL_ADDR, 100) == 0);
+    CHECK(counter.writes == 0);
+    CHECK(delay_us == 0);
+}
+
+// A board that had ALLCALL turned off doesn't block the broadcast, but
+// one in the list without it does:
+static void test_allcall_disabled(void) {
+    const int device_addrs[2] = {0x40, 0x41};
+
+    int mode1 = 0x20;
+
+    setup(1);
+    CHECK(write_register_cache(0x42, MODE1, &mode1, 1) == 0);
+    reset_counting_bus(&counter);
+
+    CHECK(retune_devices(2, device_addrs, ALLCALL_ADDR, 100) == 0);
+    CHECK(allcall_writes == 4);
+    check_running(0x42, PRE_SCALE_DEFAULT);
+
+    setup(1);
+    CHECK(write_register_cache(0x41, MODE1, &mode1, 1) == 0);
+    reset_counting_bus(&counter);
+
+    CHECK(retune_devices(2, device_addrs, ALLCALL_ADDR, 200) == 0);
+    CHECK(allcall_writes == 0);
+    check_running(0x41, PRE_SCALE_DEFAULT);
+}
+
+// Sleeping devices are woken and still get the oscillator wait, even
+// when PRE_SCALE is already right:
+static void test_asleep(void) {
+    setup(0);
+
+    CHECK(retune_device(0x40, 200) == 0);
+    CHECK(delay_us == OSCILLATOR_SETTLE_US);
+    check_running(0x40, PRE_SCALE_DEFAULT);
+
+    delay_us = 0;
+    CHECK(retune_device(0x41, 100) == 0);
+    CHECK(delay_us == OSCILLATOR_SETTLE_US);
+    check_running(0x41, NEW_PRESCALE);
+}
+
+// Boards on two buses: each bus waits for its own oscillators, and a bus
+// with nothing retuned isn't waited on:
+static void test_two_buses(void) {
+    const int device_addrs[2] = {0x40, DEVICE_ID(1, 0x40)};
+
+    int mode1 = 0x21;
+
+    setup(1);
+    init_sim(&other_sim);
+    add_sim_device(&other_sim, 0x40);
+    init_counting_bus(&other_counter, &other_sim.bus);
+    other_counter.bus.delay = record_other_delay;
+    attach_bus(1, &other_counter.bus);
+    other_delay_us = 0;
+
+    init_register_cache(device_addrs[1]);
+    write_register_cache(device_addrs[1], MODE1, &mode1, 1);
+
+    CHECK(retune_devices(2, device_addrs, -1, 100) == 0);
+    CHECK(delay_us == OSCILLATOR_SETTLE_US);
+    CHECK(other_delay_us == OSCILLATOR_SETTLE_US);
+    check_running(0x40, NEW_PRESCALE);
+    CHECK(get_sim_registers(&other_sim, 0x40)[PRE_SCALE] == NEW_PRESCALE);
+
+    delay_us = 0;
+    other_delay_us = 0;
+    CHECK(retune_device(device_addrs[1], 200) == 0);
+    CHECK(delay_us == 0);
+    CHECK(other_delay_us == OSCILLATOR_SETTLE_US);
+
+    attach_bus(1, NULL);
+}
+
+int main(void) {
+    test_partial_list();
+    test_whole_bus();
+    test_allcall_disabled();
+    test_asleep();
+    test_two_buses();
+
+    return test_result("test_retune");
+}
@@ -0,0 +1,186 @@
+// Raspberry Pi PCA9685 Example
+//
+// Copyright (c) 2022 Benjamin Spencer
+// ============================================================================
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+// ============================================================================
+
+// Simulated PCA9685 bus tests
+
+// Include C standard libraries:
+#include <stdint.h> // C Standard integer types
+
+#include <pi_i2c.h> // Pi I2C library! (error codes)
+
+#include "pca9685_registers.h" // PCA9685 register definitions
+#include "pca9685_bus.h"       // PCA9685 bus backend
+#include "pca9685_sim.h"       // Simulated PCA9685 bus
+#include "test_util.h"         // Test helpers
+
+#define TEST_ADDR 0x40
+#define OTHER_ADDR 0x41
+#define ALLCALL_ADDR 0x70
+
+static struct pca9685_sim sim;
+
+static void setup(void) {
+    init_sim(&sim);
+    add_sim_device(&sim, TEST_ADDR);
+    add_sim_device(&sim, OTHER_ADDR);
+    set_bus(&sim.bus);
+}
+
+static void test_power_on_state(void) {
+    uint8_t *reg;
+
+    setup();
+    reg = get_sim_registers(&sim, TEST_ADDR);
+
+    CHECK(reg[MODE1] == MODE1_DEFAULT);
+    CHECK(reg[MODE2] == MODE2_DEFAULT);
+    CHECK(reg[PRE_SCALE] == PRE_SCALE_DEFAULT);
+    CHECK(reg[LED7_OFF_H] == LEDN_OFF_H_DEFAULT);
+    CHECK(get_sim_registers(&sim, 0x42) == NULL);
+}
+
+static void test_auto_increment(void) {
+    int data[4] = {0x01, 0x02, 0x03, 0x04};
+    int mode1 = 0x21; // AI + ALLCALL, awake
+    int back[4];
+    uint8_t *reg;
+
+    setup();
+    reg = get_sim_registers(&sim, TEST_ADDR);
+
+    // Without AI every byte lands on the same register:
+    CHECK(bus_write(TEST_ADDR, LED0_ON_L, data, 4) == 0);
+    CHECK(reg[LED0_ON_L] == 0x04);
+    CHECK(reg[LED0_ON_H] == 0x00);
+
+    CHECK(bus_write(TEST_ADDR, MODE1, &mode1, 1) == 0);
+    CHECK(bus_write(TEST_ADDR, LED0_ON_L, data, 4) == 0);
+    CHECK(bus_read(TEST_ADDR, LED0_ON_L, back, 4) == 0);
+    CHECK((back[0] == 1) && (back[1] == 2) && (back[2] == 3)
+          && (back[3] == 4));
+}
+
+static void test_prescale_lock(void) {
+    int prescale = 0x79;
+    int mode1 = 0x01; // Awake
+    uint8_t *reg;
+
+    setup();
+    reg = get_sim_registers(&sim, TEST_ADDR);
+
+    // Asleep at power on, so the write is taken:
+    CHECK(bus_write(TEST_ADDR, PRE_SCALE, &prescale, 1) == 0);
+    CHECK(reg[PRE_SCALE] == 0x79);
+
+    CHECK(bus_write(TEST_ADDR, MODE1, &mode1, 1) == 0);
+    prescale = 0x03;
+    CHECK(bus_write(TEST_ADDR, PRE_SCALE, &prescale, 1) == 0);
+    CHECK(reg[PRE_SCALE] == 0x79);
+
+    // Values under 3 are forced to 3:
+    mode1 = MODE1_DEFAULT;
+    CHECK(bus_write(TEST_ADDR, MODE1, &mode1, 1) == 0);
+    prescale = 0x01;
+    CHECK(bus_write(TEST_ADDR, PRE_SCALE, &prescale, 1) == 0);
+    CHECK(reg[PRE_SCALE] == 0x03);
+}
+
+static void test_all_led_and_allcall(void) {
+    int value = 0x10;
+    int back = 0xFF;
+    uint8_t *reg;
+    uint8_t *other;
+
+    setup();
+    reg = get_sim_registers(&sim, TEST_ADDR);
+    other = get_sim_registers(&sim, OTHER_ADDR);
+
+    value = 0x00;
+    CHECK(bus_write(ALLCALL_ADDR, ALL_LED_OFF_H, &value, 1) == 0);
+    CHECK((reg[LED0_OFF_H] == 0x00) && (reg[LED15_OFF_H] == 0x00));
+    CHECK((other[LED0_OFF_H] == 0x00) && (other[LED15_OFF_H] == 0x00));
+
+    // Write only:
+    CHECK(bus_read(TEST_ADDR, ALL_LED_OFF_H, &back, 1) == 0);
+    CHECK(back == 0);
+    CHECK(bus_read(ALLCALL_ADDR, MODE1, &back, 1) == -ENACK);
+
+    // Group address gone once ALLCALL is cleared on every device:
+    value = 0x10;
+    CHECK(bus_write(ALLCALL_ADDR, MODE1, &value, 1) == 0);
+    CHECK(bus_write(ALLCALL_ADDR, MODE1, &value, 1) == -ENACK);
+}
+
+static void test_faults(void) {
+    int value = 0x01;
+    int data = 0;
+    uint8_t *reg;
+
+    setup();
+    reg = get_sim_registers(&sim, TEST_ADDR);
+
+    CHECK(bus_write(0x42, MODE1, &value, 1) == -ENACK);
+
+    sim.bus_stuck = 1;
+    CHECK(bus_read(TEST_ADDR, MODE1, &data, 1) == -EBUSLOCKUP);
+    CHECK(bus_clear(0) == 0);
+    CHECK(bus_read(TEST_ADDR, MODE1, &data, 1) == 0);
+
+    // A hung device is only freed by a software reset:
+    CHECK(bus_write(TEST_ADDR, MODE1, &value, 1) == 0);
+    sim.devices[0].hung = 1;
+    CHECK(bus_read(TEST_ADDR, MODE1, &data, 1) == -EDEVICEHUNG);
+    CHECK(bus_write(0x00, 0x06, NULL, 0) == 0);
+    CHECK(bus_read(TEST_ADDR, MODE1, &data, 1) == 0);
+    CHECK(reg[MODE1] == MODE1_DEFAULT);
+
+    // Power loss resets every device:
+    CHECK(bus_write(OTHER_ADDR, MODE1, &value, 1) == 0);
+    CHECK(bus_power_cycle(0) == 0);
+    CHECK(get_sim_registers(&sim, OTHER_ADDR)[MODE1] == MODE1_DEFAULT);
+
+    sim.nack_one_in = 1;
+    CHECK(bus_read(TEST_ADDR, MODE1, &data, 1) == -ENACK);
+}
+
+static void test_scan(void) {
+    int address_book[SIM_ADDRESS_BOOK];
+
+    setup();
+
+    CHECK(bus_scan(address_book) == 0);
+    CHECK(address_book[TEST_ADDR] && address_book[OTHER_ADDR]);
+    CHECK(address_book[ALLCALL_ADDR]);
+    CHECK(!address_book[0x42]);
+}
+
+int main(void) {
+    test_power_on_state();
+    test_auto_increment();
+    test_prescale_lock();
+    test_all_led_and_allcall();
+    test_faults();
+    test_scan();
+
+    return test_result("test_sim");
+}
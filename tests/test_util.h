@@ -0,0 +1,138 @@
+// Raspberry Pi PCA9685 Example
+//
+// Copyright (c) 2022 Benjamin Spencer
+// ============================================================================
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+// ============================================================================
+
+// Minimal test helpers
+//
+// Each test program includes this once. CHECK() reports a failed condition
+// with its location and keeps going so one run shows every failure;
+// test_result() prints the summary and gives the exit status for main().
+// A counting bus sits in front of another backend to check what went over
+// the wire.
+
+#ifndef TEST_UTIL_H
+#define TEST_UTIL_H
+
+#include <stdio.h> // C Standard I/O libary
+
+#include "pca9685_bus.h" // PCA9685 bus backend
+
+static int test_checks;
+static int test_failures;
+
+#define CHECK(cond)                                                        \
+    do {                                                                   \
+        test_checks++;                                                     \
+        if (!(cond)) {                                                     \
+            test_failures++;                                               \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__,         \
+                    __LINE__, #cond);                                      \
+        }                                                                  \
+    } while (0)
+
+struct counting_bus {
+    const struct pca9685_bus *target; // Bus doing the actual work
+
+    int reads;
+    int writes;
+    int bytes_written;
+    int last_addr; // Address of the last write
+    int last_reg;  // First register of the last write
+
+    struct pca9685_bus bus;
+};
+
+static inline int count_read(void *context, int device_addr, int reg_addr,
+                             int *data, int bytes) {
+    struct counting_bus *counter = context;
+
+    counter->reads++;
+
+    return counter->target->read(counter->target->context, device_addr,
+                                 reg_addr, data, bytes);
+}
+
+static inline int count_write(void *context, int device_addr, int reg_addr,
+                              int *data, int bytes) {
+    struct counting_bus *counter = context;
+
+    counter->writes++;
+    counter->bytes_written += bytes;
+    counter->last_addr = device_addr;
+    counter->last_reg = reg_addr;
+
+    return counter->target->write(counter->target->context, device_addr,
+                                  reg_addr, data, bytes);
+}
+
+static inline int count_scan(void *context, int *address_book) {
+    struct counting_bus *counter = context;
+
+    return counter->target->scan(counter->target->context, address_book);
+}
+
+static inline int count_power_cycle(void *context) {
+    struct counting_bus *counter = context;
+
+    return counter->target->power_cycle(counter->target->context);
+}
+
+static inline int count_bus_clear(void *context) {
+    struct counting_bus *counter = context;
+
+    return counter->target->bus_clear(counter->target->context);
+}
+
+// Forward to target and start counting from zero:
+static inline void init_counting_bus(struct counting_bus *counter,
+                                     const struct pca9685_bus *target) {
+    counter->target = target;
+
+    counter->bus.read = count_read;
+    counter->bus.write = count_write;
+    counter->bus.scan = count_scan;
+    counter->bus.power_cycle = target->power_cycle ? count_power_cycle
+                                                   : NULL;
+    counter->bus.delay = NULL; // Real sleeps
+    counter->bus.bus_clear = target->bus_clear ? count_bus_clear : NULL;
+    counter->bus.context = counter;
+
+    counter->reads = 0;
+    counter->writes = 0;
+    counter->bytes_written = 0;
+    counter->last_addr = -1;
+    counter->last_reg = -1;
+}
+
+static inline void reset_counting_bus(struct counting_bus *counter) {
+    counter->reads = 0;
+    counter->writes = 0;
+    counter->bytes_written = 0;
+}
+
+static int test_result(const char *name) {
+    printf("%s: %d checks, %d failed\n", name, test_checks, test_failures);
+
+    return test_failures ? 1 : 0;
+}
+
+#endif
@@ -0,0 +1,216 @@
+// Raspberry Pi PCA9685 Example
+//
+// Copyright (c) 2022 Benjamin Spencer
+// ============================================================================
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+// ============================================================================
+
+// Readback verification tests
+
+// Include C standard libraries:
+#include <stdint.h> // C Standard integer types
+#include <time.h>   // C Standard date and time manipulation
+
+#include <pi_i2c.h> // Pi I2C library! (error codes)
+
+#include "pca9685_registers.h" // PCA9685 register definitions
+#include "pca9685_bus.h"       // PCA9685 bus backend
+#include "pca9685_sim.h"       // Simulated PCA9685 bus
+#include "pca9685_cache.h"     // PCA9685 shadow register cache
+#include "pca9685_queue.h"     // PCA9685 asynchronous command queue
+#include "pca9685_verify.h"    // PCA9685 readback verification
+#include "test_util.h"         // Test helpers
+
+#define TEST_ADDR 0x40
+#define STEPS_PER_PASS (1 + LED_BANK_BYTES / VERIFY_CHUNK_BYTES)
+
+static struct pca9685_sim sim;
+static struct counting_bus counter;
+static struct pca9685_verify verify;
+static struct pca9685_queue queue;
+
+static int last_event;
+static int last_reg;
+static int events;
+
+static void record_event(int event, int device_addr, int reg_addr,
+                         void *context) {
+    last_event = event;
+    last_reg = reg_addr;
+    events++;
+}
+
+// Awake with auto-increment and LED0 running, verified with repair on:
+static void setup(int repair) {
+    int mode1[1] = {0x21};
+    int led0[4] = {0x00, 0x00, 0x00, 0x08};
+
+    init_sim(&sim);
+    add_sim_device(&sim, TEST_ADDR);
+    init_counting_bus(&counter, &sim.bus);
+    set_bus(&counter.bus);
+    invalidate_register_cache(ALL_DEVICES);
+    init_register_cache(TEST_ADDR);
+    write_register_cache(TEST_ADDR, MODE1, mode1, 1);
+    write_register_cache(TEST_ADDR, LED0_ON_L, led0, 4);
+
+    init_verify(&verify, 1000000, 1000, repair);
+    add_verify_device(&verify, TEST_ADDR);
+    set_verify_callback(&verify, record_event, NULL);
+
+    last_event = -1;
+    last_reg = -1;
+    events = 0;
+}
+
+static void run_pass(void) {
+    int step;
+
+    for (step = 0; step < STEPS_PER_PASS; step++) {
+        CHECK(verify_step(&verify) == 1);
+    }
+}
+
+static void test_clean_pass(void) {
+    setup(1);
+    reset_counting_bus(&counter);
+
+    run_pass();
+    CHECK(verify.stats.passes == 1);
+    CHECK(verify.stats.reads == STEPS_PER_PASS);
+    CHECK(verify.stats.bytes == 2 + LED_BANK_BYTES);
+    CHECK(verify.stats.mismatches == 0);
+    CHECK(events == 0);
+    CHECK(counter.writes == 0);
+
+    // Bad arguments:
+    CHECK(init_verify(&verify, 100, 0, 0) == -1);
+    CHECK(init_verify(&verify, -1, 10, 0) == -1);
+    CHECK(add_verify_device(&verify, -1) == -1);
+    CHECK(add_verify_device(&verify, NUM_DEVICE_IDS) == -1);
+}
+
+static void test_mismatch(void) {
+    uint8_t *reg;
+
+    // Reported and written back:
+    setup(1);
+    reg = get_sim_registers(&sim, TEST_ADDR);
+    reg[LED5_OFF_L] = 0x55;
+
+    run_pass();
+    CHECK(verify.stats.mismatches == 1);
+    CHECK(verify.stats.repairs == 1);
+    CHECK(last_event == VERIFY_MISMATCH);
+    CHECK(last_reg == LED5_OFF_L);
+    CHECK(reg[LED5_OFF_L] == 0x00);
+
+    // Reported only:
+    setup(0);
+    reg = get_sim_registers(&sim, TEST_ADDR);
+    reg[LED14_ON_H] = 0x01;
+
+    run_pass();
+    CHECK(verify.stats.mismatches == 1);
+    CHECK(verify.stats.repairs == 0);
+    CHECK(last_reg == LED14_ON_H);
+    CHECK(reg[LED14_ON_H] == 0x01);
+}
+
+static void test_mode_error(void) {
+    uint8_t *reg;
+
+    setup(1);
+    reg = get_sim_registers(&sim, TEST_ADDR);
+    reg[MODE2] ^= 0x10; // INVRT
+
+    CHECK(verify_step(&verify) == 1);
+    CHECK(verify.stats.mode_errors == 1);
+    CHECK(last_event == VERIFY_MODE);
+    CHECK(reg[MODE2] == MODE2_DEFAULT);
+    CHECK(verify.stats.repairs == 1);
+}
+
+// A power-on MODE1 means a reset; the whole register file comes back:
+static void test_brownout(void) {
+    uint8_t *reg;
+
+    setup(1);
+    reg = get_sim_registers(&sim, TEST_ADDR);
+    sim.bus.power_cycle(sim.bus.context);
+    CHECK(reg[MODE1] == MODE1_DEFAULT);
+
+    CHECK(verify_step(&verify) == 1);
+    CHECK(verify.stats.brownouts == 1);
+    CHECK(last_event == VERIFY_BROWNOUT);
+    CHECK((reg[MODE1] & ~0x80) == 0x21);
+    CHECK(reg[LED0_OFF_H] == 0x08);
+}
+
+static void test_budget(void) {
+    setup(1);
+
+    // Nothing to check:
+    init_verify(&verify, 1000000, 1000, 1);
+    CHECK(verify_step(&verify) == 0);
+    CHECK(verify_idle_ns(&verify) == verify.period_ns);
+
+    // One read uses up a 1 us budget; the rest waits for the next period:
+    init_verify(&verify, 1, 1000, 1);
+    add_verify_device(&verify, TEST_ADDR);
+    CHECK(verify_idle_ns(&verify) == 0);
+    CHECK(verify_step(&verify) == 1);
+    CHECK(verify_step(&verify) == 0);
+    CHECK(verify.stats.reads == 1);
+    CHECK(verify_idle_ns(&verify) > 0);
+    CHECK(verify_idle_ns(&verify) <= verify.period_ns);
+
+    // Failed reads are counted and passed on:
+    setup(1);
+    sim.devices[0].hung = 1;
+    CHECK(verify_step(&verify) == -EDEVICEHUNG);
+    CHECK(verify.stats.errors == 1);
+}
+
+// The queue worker verifies while it has nothing to send:
+static void test_verified_queue(void) {
+    struct timespec wait = {0, 20000000};
+
+    setup(1);
+    get_sim_registers(&sim, TEST_ADDR)[LED3_OFF_L] = 0x33;
+
+    CHECK(start_verified_queue(&queue, &verify) == 0);
+    nanosleep(&wait, NULL);
+    CHECK(stop_queue(&queue) == 0);
+
+    CHECK(verify.stats.passes >= 1);
+    CHECK(verify.stats.repairs >= 1);
+    CHECK(get_sim_registers(&sim, TEST_ADDR)[LED3_OFF_L] == 0x00);
+}
+
+int main(void) {
+    test_clean_pass();
+    test_mismatch();
+    test_mode_error();
+    test_brownout();
+    test_budget();
+    test_verified_queue();
+
+    return test_result("test_verify");
+}